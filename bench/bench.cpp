@@ -0,0 +1,352 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <driver.hpp>
+#include "generator.hpp"
+
+// Compiles generated programs phase by phase and prints one JSON object per
+// line for every shape and size, so runs of different versions can be
+// diffed or loaded into anything that reads JSON Lines. Every case runs in
+// a child process of its own, which makes peak_rss_kb the peak of that case
+// alone. Phase times are the best of --repeat runs. With --calls it JIT
+// runs deeply nested, recursive programs instead and times their calls
+// with each way of reaching outer frames.
+
+namespace {
+
+using namespace plc;
+
+struct BenchOptions{
+    uint64_t seed = 1;
+    std::vector<size_t> sizes{1 << 10, 64 << 10, 1 << 20};
+    std::vector<ProgramShape> shapes{ProgramShape::Mixed, ProgramShape::Nesting, ProgramShape::Expressions, ProgramShape::Procedures};
+    int repeat = 3;
+    int opt_level = 1;
+    std::string emit;           // write the first program here and stop
+    std::vector<uint32_t> nestings;     // run call programs this deep instead
+};
+
+// the innermost procedure of a call program recurses this deep, this often
+constexpr uint32_t call_depth = 10000;
+constexpr uint32_t call_rounds = 100;
+
+struct Measurement{
+    size_t bytes = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    size_t quadruples = 0;
+    size_t asm_bytes = 0;
+    double lex = 0, parse = 0, inlining = 0, fold = 0, ir = 0, codegen = 0;
+};
+
+// counts what the backend writes instead of keeping it
+class CountingBuffer : public std::streambuf{
+    public:
+    size_t count = 0;
+    protected:
+    int_type overflow(int_type c) override{
+        if (c != traits_type::eof()) count++;
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char*, std::streamsize n) override{
+        count += static_cast<size_t>(n);
+        return n;
+    }
+};
+
+void printUsage(std::ostream& os){
+    os << "usage: plc_bench [options]\n"
+       << "  --seed N          generator seed (default 1)\n"
+       << "  --sizes LIST      comma separated source sizes, K/M suffixes allowed (default 1K,64K,1M)\n"
+       << "  --shapes LIST     any of mixed,nesting,expressions,procedures (default: all)\n"
+       << "  --repeat N        runs per case, the fastest counts (default 3)\n"
+       << "  -O0, -O           optimization level as in plc (default: constant folding)\n"
+       << "  --emit FILE       write the first generated program to FILE and exit\n"
+       << "  --calls LIST      comma separated procedure nestings: run recursive call programs\n"
+       << "                    with a display and with static links instead of compiling shapes\n";
+}
+
+Result<size_t> parseSize(const std::string& text){
+    char* end;
+    unsigned long long value = strtoull(text.c_str(), &end, 10);
+    std::string suffix(end);
+    if (end == text.c_str() || value == 0) return Error<size_t>(ErrorType::InvalidSyntax);
+    if (suffix == "K" || suffix == "k") value <<= 10;
+    else if (suffix == "M" || suffix == "m") value <<= 20;
+    else if (!suffix.empty()) return Error<size_t>(ErrorType::InvalidSyntax);
+    return Ok(static_cast<size_t>(value));
+}
+
+std::vector<std::string> split(const std::string& list){
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= list.size()){
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > start) parts.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return parts;
+}
+
+Result<BenchOptions> parseArguments(int argc, char** argv){
+    BenchOptions options;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "-O0") options.opt_level = 0;
+        else if (arg == "-O" || arg == "-O2") options.opt_level = 2;
+        else if (i + 1 < argc && (arg == "--seed" || arg == "--repeat" || arg == "--sizes" || arg == "--shapes" || arg == "--emit" || arg == "--calls")){
+            std::string value = argv[++i];
+            if (arg == "--seed") options.seed = strtoull(value.c_str(), nullptr, 10);
+            else if (arg == "--repeat") options.repeat = std::max(1, atoi(value.c_str()));
+            else if (arg == "--emit") options.emit = value;
+            else if (arg == "--calls"){
+                options.nestings.clear();
+                for (const std::string& part : split(value)){
+                    uint32_t nesting = static_cast<uint32_t>(strtoul(part.c_str(), nullptr, 10));
+                    if (nesting == 0){
+                        std::cerr << "plc_bench: invalid nesting '" << part << "'\n";
+                        return Error<BenchOptions>(ErrorType::InvalidSyntax);
+                    }
+                    options.nestings.push_back(nesting);
+                }
+            }
+            else if (arg == "--sizes"){
+                options.sizes.clear();
+                for (const std::string& part : split(value)){
+                    Result<size_t> size = parseSize(part);
+                    if (!size.isOk){
+                        std::cerr << "plc_bench: invalid size '" << part << "'\n";
+                        return Error<BenchOptions>(ErrorType::InvalidSyntax);
+                    }
+                    options.sizes.push_back(*size);
+                }
+            }else{
+                options.shapes.clear();
+                for (const std::string& part : split(value)){
+                    Result<ProgramShape> shape = shapeFromName(part);
+                    if (!shape.isOk){
+                        std::cerr << "plc_bench: unknown shape '" << part << "'\n";
+                        return Error<BenchOptions>(ErrorType::InvalidSyntax);
+                    }
+                    options.shapes.push_back(*shape);
+                }
+            }
+        }else{
+            printUsage(std::cerr);
+            return Error<BenchOptions>(ErrorType::InvalidSyntax);
+        }
+    }
+    if (options.sizes.empty() || options.shapes.empty()) return Error<BenchOptions>(ErrorType::Empty);
+    if (!options.nestings.empty()) options.shapes.clear();
+    return Ok(options);
+}
+
+double seconds(const std::function<void()>& phase){
+    auto start = std::chrono::steady_clock::now();
+    phase();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the phases the driver runs, each timed on its own
+Result<Measurement> measure(const std::string& file, int opt_level){
+    Measurement m;
+    CompilationContext ctx;
+    std::ostream null_stream(nullptr);
+    ctx.out = &null_stream;
+    ctx.reset();
+
+    KeyWordInterpreter lexer(LexerMode::DFA, ctx.interner);
+    Result<TokenList> tokens = Error<TokenList>(ErrorType::Empty);
+    m.lex = seconds([&]{tokens = lexer.interpretFile(file);});
+    if (!tokens.isOk) return Error<Measurement>(tokens);
+    m.bytes = tokens->source->view().size();
+    m.tokens = tokens->tokens.size();
+
+    Result<std::pair<size_t,NodeId>> program = ErrorPair(ErrorType::Empty);
+    m.parse = seconds([&]{program = GrammarInterpreter(tokens->tokens, ctx).interpretProgram(0);});
+    if (!program.isOk) return Error<Measurement>(program);
+    m.nodes = ctx.ast.size();
+
+    if (opt_level > 0){
+        m.inlining = seconds([&]{inlineProcedures(ctx.ast, DriverOptions().inline_budget);});
+        m.fold = seconds([&]{foldConstants(ctx.ast);});
+    }
+    Result<QuadOperand> ir = Error<QuadOperand>(ErrorType::Empty);
+    m.ir = seconds([&]{ir = ctx.ast.getQuaternary(ctx);});
+    if (!ir.isOk) return Error<Measurement>(ir);
+    if (opt_level > 0) m.fold += seconds([&]{foldConstants(ctx);});
+    m.quadruples = ctx.code.size();
+
+    CodegenOptions codegen;
+    codegen.allocate_registers = opt_level >= 2;
+    codegen.peephole = opt_level > 0;
+    NASMLinuxELF64 compiler(codegen);
+    CountingBuffer counter;
+    std::ostream asm_stream(&counter);
+    Result<int> res = Error<int>(ErrorType::Empty);
+    m.codegen = seconds([&]{res = compiler.write(ctx, asm_stream);});
+    if (!res.isOk) return Error<Measurement>(res);
+    m.asm_bytes = counter.count;
+    return Ok(m);
+}
+
+// compiles file into jit the way plc --jit does and returns the best run time
+Result<double> timeCalls(const std::string& file, const BenchOptions& options, FrameLinks links, int64_t& sum){
+    CompilationContext ctx;
+    std::ostream null_stream(nullptr);
+    ctx.out = &null_stream;
+    ctx.reset();
+    Result<TokenList> tokens = KeyWordInterpreter(LexerMode::DFA, ctx.interner).interpretFile(file);
+    if (!tokens.isOk) return Error<double>(tokens);
+    Result<std::pair<size_t,NodeId>> program = GrammarInterpreter(tokens->tokens, ctx).interpretProgram(0);
+    if (!program.isOk) return Error<double>(program);
+    if (options.opt_level > 0){
+        inlineProcedures(ctx.ast, DriverOptions().inline_budget);
+        foldConstants(ctx.ast);
+    }
+    Result<QuadOperand> ir = ctx.ast.getQuaternary(ctx);
+    if (!ir.isOk) return Error<double>(ir);
+    if (options.opt_level > 0) foldConstants(ctx);
+
+    CodegenOptions codegen;
+    codegen.allocate_registers = options.opt_level >= 2;
+    codegen.peephole = options.opt_level > 0;
+    codegen.strength_reduce = options.opt_level > 0;
+    codegen.frame_links = links;
+    JITLinuxX64 jit(codegen);
+    Result<int> res = jit.load(ctx);
+    if (!res.isOk) return Error<double>(res);
+    double best = 0;
+    for (int i = 0; i < options.repeat; i++){
+        double s = seconds([&]{res = jit.run();});
+        if (!res.isOk) return Error<double>(res);
+        best = i ? std::min(best, s) : s;
+    }
+    Result<int64_t> value = jit.global(ctx, "sum");
+    if (!value.isOk) return Error<double>(value);
+    sum = *value;
+    return Ok(best);
+}
+
+// both ways must compute the same sum, or the faster one is not worth timing
+int runCalls(const std::string& file, uint32_t nesting, const BenchOptions& options){
+    uint64_t calls = uint64_t(call_rounds) * (call_depth + nesting);
+    int64_t expected = 0;
+    for (FrameLinks links : {FrameLinks::Display, FrameLinks::StaticLink}){
+        int64_t sum = 0;
+        Result<double> s = timeCalls(file, options, links, sum);
+        std::cout << "{\"nesting\":" << nesting << ",\"frames\":\"" << (links == FrameLinks::Display ? "display" : "static_link")
+                  << "\",\"opt_level\":" << options.opt_level;
+        if (!s.isOk){
+            std::cout << ",\"error\":\"" << static_cast<std::string>(Result<int>(s.unwrapErr())) << "\"}" << std::endl;
+            return 1;
+        }
+        if (links == FrameLinks::Display) expected = sum;
+        else if (sum != expected){
+            std::cout << ",\"error\":\"sum " << sum << " differs from " << expected << "\"}" << std::endl;
+            return 1;
+        }
+        std::cout << ",\"calls\":" << calls << ",\"run_s\":" << *s
+                  << ",\"calls_per_s\":" << (*s > 0 ? calls / *s : 0.0) << ",\"sum\":" << sum << "}" << std::endl;
+    }
+    return 0;
+}
+
+void printCase(std::ostream& os, ProgramShape shape, size_t size, const BenchOptions& options){
+    os << "{\"shape\":\"" << shapeName(shape) << "\",\"target_bytes\":" << size
+       << ",\"seed\":" << options.seed << ",\"opt_level\":" << options.opt_level;
+}
+
+// runs in the child; returns the exit status
+int runCase(const std::string& file, ProgramShape shape, size_t size, const BenchOptions& options){
+    Measurement best;
+    for (int i = 0; i < options.repeat; i++){
+        Result<Measurement> m = measure(file, options.opt_level);
+        if (!m.isOk){
+            printCase(std::cout, shape, size, options);
+            std::cout << ",\"error\":\"" << static_cast<std::string>(Result<int>(m.unwrapErr())) << "\"}" << std::endl;
+            return 1;
+        }
+        if (i == 0){
+            best = *m;
+            continue;
+        }
+        best.lex = std::min(best.lex, m->lex);
+        best.parse = std::min(best.parse, m->parse);
+        best.inlining = std::min(best.inlining, m->inlining);
+        best.ir = std::min(best.ir, m->ir);
+        best.fold = std::min(best.fold, m->fold);
+        best.codegen = std::min(best.codegen, m->codegen);
+    }
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto rate = [](size_t count, double s){return s > 0 ? count / s : 0.0;};
+    double total = best.lex + best.parse + best.inlining + best.ir + best.fold + best.codegen;
+    printCase(std::cout, shape, size, options);
+    std::cout << ",\"bytes\":" << best.bytes << ",\"tokens\":" << best.tokens << ",\"nodes\":" << best.nodes
+              << ",\"quadruples\":" << best.quadruples << ",\"asm_bytes\":" << best.asm_bytes
+              << ",\"lex_s\":" << best.lex << ",\"parse_s\":" << best.parse << ",\"inline_s\":" << best.inlining << ",\"ir_s\":" << best.ir
+              << ",\"fold_s\":" << best.fold << ",\"codegen_s\":" << best.codegen << ",\"total_s\":" << total
+              << ",\"tokens_per_s\":" << rate(best.tokens, best.lex) << ",\"nodes_per_s\":" << rate(best.nodes, best.parse)
+              << ",\"quadruples_per_s\":" << rate(best.quadruples, best.ir)
+              << ",\"mb_per_s\":" << rate(best.bytes, total) / (1024.0 * 1024.0)
+              << ",\"peak_rss_kb\":" << usage.ru_maxrss << "}" << std::endl;
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv){
+    Result<BenchOptions> parsed = parseArguments(argc, argv);
+    if (!parsed.isOk) return 2;
+    const BenchOptions& options = *parsed;
+    std::cout.precision(6);
+
+    if (!options.emit.empty()){
+        std::ofstream f(options.emit, std::ios::binary);
+        if (!options.nestings.empty()) f << generateCallProgram(options.nestings[0], call_depth, call_rounds);
+        else f << generateProgram(GeneratorOptions{options.seed, options.sizes[0], options.shapes[0]});
+        return f ? 0 : 1;
+    }
+
+    namespace fs = std::filesystem;
+    fs::path file = fs::temp_directory_path() / ("plc_bench_" + std::to_string(getpid()) + ".pl0");
+    int failed = 0;
+    for (uint32_t nesting : options.nestings){
+        {
+            std::ofstream f(file, std::ios::binary | std::ios::trunc);
+            f << generateCallProgram(nesting, call_depth, call_rounds);
+            if (!f){
+                std::cerr << "plc_bench: cannot write " << file << "\n";
+                return 1;
+            }
+        }
+        failed += runCalls(file.string(), nesting, options);
+    }
+    for (ProgramShape shape : options.shapes){
+        for (size_t size : options.sizes){
+            {
+                std::ofstream f(file, std::ios::binary | std::ios::trunc);
+                f << generateProgram(GeneratorOptions{options.seed, size, shape});
+                if (!f){
+                    std::cerr << "plc_bench: cannot write " << file << "\n";
+                    return 1;
+                }
+            }
+            std::cout.flush();
+            pid_t child = fork();
+            if (child == 0) _exit(runCase(file.string(), shape, size, options));
+            int status = 0;
+            if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+        }
+    }
+    std::error_code ec;
+    fs::remove(file, ec);
+    return failed ? 1 : 0;
+}
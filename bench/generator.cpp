@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <vector>
+#include "generator.hpp"
+
+namespace plc {
+
+namespace {
+
+struct ShapeLimits{
+    uint32_t procedure_depth;       // levels of procedures inside procedures
+    uint32_t children;              // most procedures declared in one nested block
+    uint32_t statement_depth;       // if/while/begin inside each other
+    uint32_t compound_percent;      // chance a statement nests another one
+    uint32_t min_statements, max_statements;
+    uint32_t min_terms, max_terms;
+};
+
+ShapeLimits limits(ProgramShape shape){
+    switch (shape){
+        case ProgramShape::Nesting: return {12, 1, 24, 85, 1, 3, 1, 4};
+        case ProgramShape::Expressions: return {0, 0, 2, 15, 2, 6, 40, 200};
+        case ProgramShape::Procedures: return {0, 0, 2, 20, 1, 3, 1, 4};
+        case ProgramShape::Mixed: break;
+    }
+    return {3, 2, 4, 35, 2, 6, 1, 8};
+}
+
+constexpr const char* relations[] = {"=", "#", "<>", "<", "<=", ">", ">="};
+
+// upper bounds of what one name, operand or operator adds
+constexpr size_t max_name = 13;         // v<id>_<i>
+constexpr size_t max_term = 3 + max_name;
+// each loop runs at most this often between resets of w
+constexpr uint32_t loop_bound = 3;
+// calls that are not just the block calling its own procedures
+constexpr uint32_t call_budget = 64;
+
+// Every loop counts the shared w up to loop_bound after setting it to 0, and
+// nothing else writes w, so anything run inside a loop leaves it unchanged
+// or past the bound and each loop entry ends. Random calls only reach
+// procedures whose body is already complete, so calls never recurse, and they
+// use up a global budget. Growth stops once the program with everything still
+// left to close would pass the target size: that remainder is held in reserve_.
+class ProgramGenerator{
+    public:
+    explicit ProgramGenerator(const GeneratorOptions& options):
+        target_(options.target_bytes),limits_(limits(options.shape)),state_(options.seed){}
+
+    std::string run(){
+        out_ += "const c0 = 7, c1 = 85, c2 = 1000, c3 = 3;\nvar g0, g1, g2, g3, g4, g5, g6, g7, w, budget;\n";
+        for (int i = 0; i < 4; i++) constants_.push_back("c" + std::to_string(i));
+        for (int i = 0; i < 8; i++) variables_.push_back("g" + std::to_string(i));
+        hold(bodyCost(0, true) + 2);
+        while (fits(procedureCost())) procedure(0);
+        body(0);
+        release(2);
+        out_ += ".\n";
+        return std::move(out_);
+    }
+
+    private:
+    struct Procedure{
+        std::string name;
+        size_t call_cost;       // held until the block calls it
+        bool complete;
+    };
+
+    // splitmix64, so a seed means the same program everywhere
+    uint64_t next(){
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    uint32_t below(uint32_t n){
+        return n ? static_cast<uint32_t>(next() % n) : 0;
+    }
+
+    uint32_t between(uint32_t low, uint32_t high){
+        return low + below(high - low + 1);
+    }
+
+    bool fits(size_t bytes) const {return out_.size() + reserve_ + bytes <= target_;}
+    void hold(size_t bytes){reserve_ += bytes;}
+    void release(size_t bytes){reserve_ -= bytes;}
+
+    size_t lineCost(uint32_t indent) const {return 1 + 4 * static_cast<size_t>(indent);}
+    // an assignment of one operand on its own line
+    size_t simpleCost(uint32_t indent) const {return lineCost(indent) + max_name + 4 + max_name;}
+    // begin, the first statement and end of a block whose header is at indent;
+    // the main program also sets the call budget
+    size_t bodyCost(uint32_t indent, bool main = false) const {
+        return lineCost(indent) + 5 + (main ? lineCost(1) + 13 : 0) + simpleCost(indent + 1) + lineCost(indent) + 3;
+    }
+    // the header, body and ; of a procedure declared here, and its call
+    size_t procedureCost() const {
+        return lineCost(indent_) + 22 + lineCost(indent_ + 1) + 5 + 3 * (2 + max_name)
+            + bodyCost(indent_) + 1 + 1 + lineCost(indent_ + 1) + 16;
+    }
+
+    void newline(){
+        out_ += '\n';
+        out_.append(4 * indent_, ' ');
+    }
+
+    void procedure(uint32_t level){
+        uint32_t id = procedure_count_++;
+        std::string name = "p" + std::to_string(id);
+        uint32_t header = indent_;
+        size_t call_cost = 1 + lineCost(header + 1) + 5 + name.size();
+        hold(bodyCost(header) + 1 + call_cost);
+        newline();
+        out_ += "procedure " + name + ";";
+        procedures_.push_back(Procedure{name, call_cost, false});
+        size_t variables = variables_.size(), procedures = procedures_.size();
+        indent_++;
+        uint32_t locals = between(1, 3);
+        newline();
+        out_ += "var ";
+        for (uint32_t i = 0; i < locals; i++){
+            std::string local = "v" + std::to_string(id) + "_" + std::to_string(i);
+            out_ += (i ? ", " : "") + local;
+            variables_.push_back(local);
+        }
+        out_ += ";";
+        if (level < limits_.procedure_depth){
+            uint32_t children = between(1, limits_.children);
+            for (uint32_t i = 0; i < children && fits(procedureCost()); i++) procedure(level + 1);
+        }
+        indent_--;
+        body(procedures);
+        release(1);
+        out_ += ";";
+        variables_.resize(variables);
+        procedures_.resize(procedures);
+        procedures_.back().complete = true;
+    }
+
+    // ends by calling the procedures of the block, procedures_ from declared
+    // on, so that none of them is unreachable and dropped by the inliner
+    void body(size_t declared){
+        bool main = indent_ == 0 && declared == 0;
+        release(lineCost(indent_) + 5);
+        newline();
+        out_ += "begin";
+        indent_++;
+        if (main){
+            release(lineCost(indent_) + 13);
+            newline();
+            out_ += "budget := " + std::to_string(call_budget) + ";";
+        }
+        statements(0);
+        for (size_t i = declared; i < procedures_.size(); i++){
+            release(procedures_[i].call_cost);
+            out_ += ";";
+            newline();
+            out_ += "call " + procedures_[i].name;
+        }
+        indent_--;
+        release(lineCost(indent_) + 3);
+        newline();
+        out_ += "end";
+    }
+
+    // the first statement was held by the caller
+    void statements(uint32_t depth){
+        uint32_t count = between(limits_.min_statements, limits_.max_statements);
+        for (uint32_t i = 0; i < count; i++){
+            if (i){
+                if (!fits(1 + simpleCost(indent_))) break;
+                out_ += ";";
+            }else release(simpleCost(indent_));
+            newline();
+            statement(depth);
+        }
+    }
+
+    // the statement after then or in a loop, on its own line one level in
+    void nested(uint32_t depth){
+        indent_++;
+        release(simpleCost(indent_));
+        newline();
+        statement(depth);
+        indent_--;
+    }
+
+    // room for simpleCost(indent_) is there when this is called
+    void statement(uint32_t depth){
+        uint32_t roll = below(100);
+        if (depth < limits_.statement_depth && roll < limits_.compound_percent && compound(depth)) return;
+        if (!procedures_.empty() && roll >= 85){
+            const Procedure& p = procedures_[below(static_cast<uint32_t>(procedures_.size()))];
+            std::string call = "if budget > 0 then begin budget := budget - 1; call " + p.name + " end";
+            if (p.complete && fits(call.size())){
+                out_ += call;
+                return;
+            }
+        }
+        out_ += variables_[below(static_cast<uint32_t>(variables_.size()))] + " := ";
+        expression();
+    }
+
+    bool compound(uint32_t depth){
+        uint32_t i = indent_;
+        size_t condition_cost = 2 * max_name + 4;
+        switch (below(3)){
+            case 0:{
+                size_t head = 3 + condition_cost + 5;
+                if (!fits(head + simpleCost(i + 1))) return false;
+                hold(head + simpleCost(i + 1));
+                out_ += "if ";
+                condition();
+                out_ += " then";
+                release(head);
+                nested(depth + 1);
+                return true;
+            }
+            case 1:{
+                size_t head = 5 + lineCost(i + 1) + 7 + lineCost(i + 1) + 14 + lineCost(i + 1) + 5;
+                size_t tail = 1 + lineCost(i + 2) + 10 + lineCost(i + 1) + 3 + lineCost(i) + 3;
+                if (!fits(head + simpleCost(i + 2) + tail)) return false;
+                hold(tail + simpleCost(i + 2));
+                out_ += "begin";
+                indent_++;
+                newline();
+                out_ += "w := 0;";
+                newline();
+                out_ += "while w < " + std::to_string(loop_bound) + " do";
+                newline();
+                out_ += "begin";
+                nested(depth + 1);
+                release(tail);
+                out_ += ";";
+                indent_++;
+                newline();
+                out_ += "w := w + 1";
+                indent_--;
+                newline();
+                out_ += "end";
+                indent_--;
+                newline();
+                out_ += "end";
+                return true;
+            }
+            default:{
+                size_t end = lineCost(i) + 3;
+                if (!fits(5 + simpleCost(i + 1) + end)) return false;
+                hold(simpleCost(i + 1) + end);
+                out_ += "begin";
+                indent_++;
+                statements(depth + 1);
+                indent_--;
+                release(end);
+                newline();
+                out_ += "end";
+                return true;
+            }
+        }
+    }
+
+    void condition(){
+        if (below(100) < 15){
+            out_ += "odd ";
+            operand();
+            return;
+        }
+        expression();
+        out_ += std::string(" ") + relations[below(7)] + " ";
+        expression();
+    }
+
+    // one precedence level per expression, so a program stays flat and
+    // shallow; divisors are constants from 1 to 9
+    void expression(){
+        uint32_t terms = between(limits_.min_terms, limits_.max_terms);
+        bool additive = below(100) < 70;
+        operand();
+        for (uint32_t i = 1; i < terms && fits(max_term); i++){
+            if (additive){
+                out_ += below(2) ? " + " : " - ";
+                operand();
+            }else if (below(100) < 20){
+                out_ += " / " + std::to_string(between(1, 9));
+            }else{
+                out_ += " * ";
+                operand();
+            }
+        }
+    }
+
+    void operand(){
+        uint32_t roll = below(100);
+        if (roll < 55) out_ += variables_[below(static_cast<uint32_t>(variables_.size()))];
+        else if (roll < 70) out_ += constants_[below(static_cast<uint32_t>(constants_.size()))];
+        else out_ += std::to_string(below(1000));
+    }
+
+    std::string out_;
+    size_t target_;
+    size_t reserve_ = 0;
+    ShapeLimits limits_;
+    uint64_t state_;
+    uint32_t indent_ = 0;
+    uint32_t procedure_count_ = 0;
+    std::vector<std::string> constants_;
+    std::vector<std::string> variables_;        // visible here, innermost last
+    std::vector<Procedure> procedures_;         // visible here, innermost last
+};
+
+}
+
+std::string_view shapeName(ProgramShape shape){
+    switch (shape){
+        case ProgramShape::Mixed: return "mixed";
+        case ProgramShape::Nesting: return "nesting";
+        case ProgramShape::Expressions: return "expressions";
+        case ProgramShape::Procedures: return "procedures";
+    }
+    return "mixed";
+}
+
+Result<ProgramShape> shapeFromName(std::string_view name){
+    for (ProgramShape shape : {ProgramShape::Mixed, ProgramShape::Nesting, ProgramShape::Expressions, ProgramShape::Procedures}){
+        if (shapeName(shape) == name) return Ok(shape);
+    }
+    return Error<ProgramShape>(ErrorType::ValueNotFoundError);
+}
+
+std::string generateProgram(const GeneratorOptions& options){
+    return ProgramGenerator(options).run();
+}
+
+std::string generateCallProgram(uint32_t nesting, uint32_t depth, uint32_t rounds){
+    nesting = std::max(nesting, 1u);
+    std::string out = "var n, r, sum;\n";
+    for (uint32_t level = 1; level <= nesting; level++){
+        std::string id = std::to_string(level);
+        out.append(4 * (level - 1), ' ');
+        out += "procedure p" + id + "; var a" + id + ";\n";
+    }
+    std::string innermost = std::to_string(nesting);
+    std::string total = "sum";
+    for (uint32_t level = 1; level <= nesting; level++) total += " + a" + std::to_string(level);
+    out.append(4 * nesting, ' ');
+    out += "begin a" + innermost + " := n; sum := " + total + "; if n > 0 then begin n := n - 1; call p" + innermost + " end end;\n";
+    for (uint32_t level = nesting - 1; level >= 1; level--){
+        std::string id = std::to_string(level);
+        out.append(4 * level, ' ');
+        out += "begin a" + id + " := " + id + "; call p" + std::to_string(level + 1) + " end;\n";
+    }
+    out += "begin\n    r := 0;\n    while r < " + std::to_string(rounds) + " do begin n := " + std::to_string(depth)
+         + "; call p1; r := r + 1 end\nend.\n";
+    return out;
+}
+
+}
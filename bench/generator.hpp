@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "error.hpp"
+
+namespace plc {
+
+enum class ProgramShape{
+    Mixed,          // a little of everything
+    Nesting,        // procedures and statements nested as deep as the parser allows
+    Expressions,    // long flat expressions
+    Procedures,     // many small sibling procedures calling each other
+};
+
+[[nodiscard]] std::string_view shapeName(ProgramShape shape);
+[[nodiscard]] Result<ProgramShape> shapeFromName(std::string_view name);
+
+struct GeneratorOptions{
+    uint64_t seed = 1;
+    size_t target_bytes = 1024;     // the program stops growing once it is this large
+    ProgramShape shape = ProgramShape::Mixed;
+};
+
+// Returns a valid PL/0 program of at most target_bytes, unless even the
+// smallest one is larger, that every backend accepts: each expression stays
+// on one precedence level and has no leading sign. The same options give the same program on every platform. Every
+// block calls the procedures it declares. The programs also run cleanly:
+// loops count up to a fixed bound, calls never recurse, and every divisor
+// is a constant from 1 to 9.
+[[nodiscard]] std::string generateProgram(const GeneratorOptions& options);
+
+// A program meant to be run: procedures nested nesting deep, the innermost
+// calling itself depth times in each of rounds rounds. Every call adds the
+// variables of all the procedures around it to the global sum.
+[[nodiscard]] std::string generateCallProgram(uint32_t nesting, uint32_t depth, uint32_t rounds);
+
+}
@@ -1,39 +1,65 @@
 #pragma once
 
-#include "ast.hpp"
+#include "context.hpp"
+#include "instruction.hpp"
+#include "peephole.hpp"
+#include "regalloc.hpp"
+#include "ssa.hpp"
 
 namespace plc {
 
+enum class ElfType;
+
 struct Label{
     std::string name;
-    std::vector<std::string> lines;
+    std::vector<Instruction> lines;
     Label(const std::string& name);
-    explicit operator std::string() const;
+    void print(std::ostream& os) const;
     bool operator==(const Label& other) const;
 };
 
-template<typename T>
-struct MacroConstant{
-    std::string name;
-    T value;
-    MacroConstant(const std::string& name, const T& value);
-    bool operator==(const std::string& other) const;
+// How code reaches the variables of the procedures around it. Every
+// procedure has an rbp based activation record: the caller passes the frame
+// pointer of the callee's parent in rax, and the callee pushes rbp, sets rbp
+// to rsp, pushes its links and then makes room for its variables. The main
+// program's frame pointer is rbp of _start, or the globals with a globals base.
+enum class FrameLinks : uint8_t{
+    StaticLink,     // [rbp-8] is the parent's frame pointer: one load per level out
+    Display,        // [rbp-8*(k+1)] is level k's frame pointer, copied on entry: one load
 };
 
+// slots between rbp and the variables of a procedure at depth
+[[nodiscard]] uint32_t linkSlots(FrameLinks links, uint32_t depth);
+// push rbp and the links of a procedure at depth, rax holding its parent's frame pointer
+void enterFrame(std::vector<Instruction>& out, FrameLinks links, uint32_t depth);
+// puts the frame pointer of level, which is below depth, into r
+void loadFrame(std::vector<Instruction>& out, FrameLinks links, uint32_t depth, uint32_t level, Reg r);
+// rax = the frame pointer that a procedure declared at level expects from code at depth
+void passFrame(std::vector<Instruction>& out, FrameLinks links, uint32_t depth, uint32_t level);
+// stores 0 into the variable slots of a frame at depth through rax: the
+// given slots, or all vars of them
+void zeroVariables(std::vector<Instruction>& out, FrameLinks links, uint32_t depth, uint32_t vars, const std::vector<uint32_t>* slots = nullptr);
+// offset of var from the frame pointer of its scope
+[[nodiscard]] int64_t frameOffset(const SymbolTable& table, SymbolIndex var, FrameLinks links, bool globals_base);
+
+// Codegen view of one parser scope. Variables of this scope live at fixed
+// offsets from rbp or in the register the allocator gave them; those of an
+// enclosing scope are reached through the frame pointer loadFrame() puts
+// into a scratch register. With a globals base the main program's rbp is
+// the globals, its variables live at [rbp+8*slot].
 struct Scope {
     int label_ptr;
-    std::vector<MacroConstant<int>> constants;
-    std::vector<std::string> vars;
-    Scope *father;
-    Scope();
-    Scope(Scope *father);
-    Scope(Scope* father, size_t label_ptr);
-    Result<size_t> findVarPos(const std::string& name) const;
-    Result<std::string> findVar(const std::string& var) const;
-    Result<std::string> findConst(const std::string& con) const;
-    Result<std::string> findRValue(const std::string& val) const;
-    void addVar(const std::string& var);
-    void addConst(const std::string& name, int value);
+    ScopeId id;
+    uint32_t depth;
+    const SymbolTable* table;
+    const RegisterAssignment* registers;
+    Reg globals_base;
+    FrameLinks links;
+    Scope(const SymbolTable& table, ScopeId id, size_t label_ptr, FrameLinks links, const RegisterAssignment* registers = nullptr, Reg globals_base = Reg::none);
+    // appends the loads of an enclosing frame pointer into scratch to out
+    Result<Operand> findVar(SymbolIndex var, std::vector<Instruction>& out, Reg scratch) const;
+    Result<Operand> findConst(SymbolIndex con) const;
+    Result<Operand> findRValue(const AST& ast, NodeId val, std::vector<Instruction>& out, Reg scratch) const;
 };
 
 struct Section{
@@ -41,29 +67,111 @@ struct Section{
     std::vector<Label> labels;
     std::vector<std::string> lines;
     explicit Section(const std::string& name);
-    explicit operator std::string() const;
-    void addLine(size_t label_ptr, const std::string& line);
-    void addFreeScopeLine(const Scope&s);
+    // writes the section as NASM text, nothing when it is empty
+    void print(std::ostream& os) const;
+    void addLine(size_t label_ptr, Instruction line);
+};
+
+// Codegen is split into jobs: job 0 is the program body under _start and
+// every procedure body is a job of its own. Jobs are numbered in the order
+// the serial walk would open their labels, and each one starts its temp
+// labels where the serial walk would be, so jobs can run in any order and
+// still merge into the same text.
+struct CodegenJob{
+    NodeId node;
+    int temp_label_base;
+    int temp_label_count;
+};
+
+// Where the values of one SSA function live: a register, a stack slot or,
+// for constants, an immediate.
+struct SSAAllocation{
+    std::vector<Operand> location;  // by ValueId
+    std::vector<Reg> saved;         // registers it uses, pushed on entry by a procedure
+    uint32_t spill_slots = 0;
+    size_t allocated = 0;
+    size_t spilled = 0;
+};
+
+// Linear scan over one live interval per value, in block layout order. A
+// value live into a block laid out before its definition, as around a loop,
+// is live across everything in between. Expects critical edges split.
+[[nodiscard]] SSAAllocation allocateSSA(const SSAFunction& f);
+
+struct CodegenPlan{
+    std::vector<std::string> procedure_labels;
+    RegisterAssignment registers;
+    std::vector<CodegenJob> jobs;
+    std::unordered_map<NodeId, size_t> job_of_node;
+    // lowering through SSA: one job per function
+    SSAProgram ssa;
+    std::vector<SSAAllocation> allocations;
+    void clear();
 };
 
 class ASMGenerator {
     public:
     virtual ~ASMGenerator() = default;
-    [[nodiscard]] virtual Result<std::string> generate(const AST& input) = 0;
-    [[nodiscard]] virtual Result<int> compile(const AST& input, const std::string &asmfile, const std::string &objfile, const std::string &exefile) = 0;
+    [[nodiscard]] virtual Result<std::string> generate(CompilationContext& ctx) = 0;
+    [[nodiscard]] virtual Result<int> compile(CompilationContext& ctx, const std::string &asmfile, const std::string &objfile, const std::string &exefile) = 0;
+};
+
+// callee-saved in the System V ABI and used by generated code; rbp is the frame pointer
+constexpr std::array<Reg, 6> host_saved_registers = {Reg::rbx, Reg::rbp, Reg::r12, Reg::r13, Reg::r14, Reg::r15};
+
+struct CodegenOptions{
+    size_t threads = 1;             // > 1 generates procedure bodies concurrently
+    bool allocate_registers = false;
+    bool peephole = false;          // rewrite each job's instructions once generated
+    bool strength_reduce = false;   // multiply and divide by constants with shifts and multiply-high
+    bool ssa = false;               // lower through the SSA IR instead of walking the AST
+    bool ssa_passes = false;        // fold, simplify the CFG and remove dead stores and code on it
+    FrameLinks frame_links = FrameLinks::Display;
+    // _start is called like a function with the main program's variables
+    // at rdi, and returns instead of exiting
+    bool host_call = false;
 };
 
 class NASMLinuxELF64 : public ASMGenerator{
     public:
-    NASMLinuxELF64();
-    [[nodiscard]] Result<int> generate(const AST& input, Scope& s);
-    [[nodiscard]] Result<std::string> generate(const AST& input) override;
-    [[nodiscard]] Result<int> compile(const AST& input, const std::string &asmfile = "a.asm", const std::string &objfile = "a.o", const std::string &exefile = "a.out") override;
+    explicit NASMLinuxELF64(CodegenOptions options = {});
+    [[nodiscard]] Result<std::string> generate(CompilationContext& ctx) override;
+    // generates the program and streams its text to os section by section,
+    // without building it as one string first
+    [[nodiscard]] Result<int> write(CompilationContext& ctx, std::ostream& os);
+    // runs nasm and ld on the text; an empty exefile stops at the object
+    [[nodiscard]] Result<int> compile(CompilationContext& ctx, const std::string &asmfile = "a.asm", const std::string &objfile = "a.o", const std::string &exefile = "a.out") override;
+    // encodes the instructions itself and writes the ELF file directly
+    [[nodiscard]] Result<int> emitELF(CompilationContext& ctx, const std::string& file, ElfType type);
+    // generates textSection() without rendering it
+    [[nodiscard]] Result<int> lower(CompilationContext& ctx);
+    [[nodiscard]] const Section& textSection() const {return text;}
     std::string addTempLabelName();
     std::string getCurrentTempLabelName();
+    [[nodiscard]] const PeepholeStats& peepholeStats() const {return peephole_stats_;}
+    [[nodiscard]] const RegisterAssignment& registers() const {return own_plan_.registers;}
+    [[nodiscard]] const SSAStats& ssaStats() const {return ssa_stats_;}
+    // the program lower() generated code from with options.ssa
+    [[nodiscard]] const SSAProgram& ssaProgram() const {return own_plan_.ssa;}
     private:
+    [[nodiscard]] Result<int> generate(const AST& ast, NodeId input, Scope& s);
+    [[nodiscard]] Result<int> generateCalc(const AST& ast, NodeId calc, Scope& s);
+    [[nodiscard]] Result<int> generateJob(const AST& ast, size_t job);
+    [[nodiscard]] Result<int> lowerSSA(CompilationContext& ctx);
+    [[nodiscard]] Result<int> generateSSA(const AST& ast, size_t function);
+    // runs generate on a private generator per job, concurrently with
+    // options.threads, and appends the jobs' labels to text in job order
+    [[nodiscard]] Result<int> runJobs(CompilationContext& ctx, size_t jobs, const std::function<Result<int>(NASMLinuxELF64&, size_t)>& generate);
+    void store(size_t label_ptr, const Operand& dst, const Operand& src);
+    void assignProcedureLabels(const AST& ast);
+    void planJobs(const AST& ast, NodeId n, int& temp_labels);
     Section text,bss,data;
     int temp_label_ptr;
+    CodegenOptions options_;
+    CodegenPlan own_plan_;
+    const CodegenPlan* plan_ = nullptr;
+    PeepholeStats peephole_stats_;
+    SSAStats ssa_stats_;
 };
 
 enum class JWASMInstructionSet{
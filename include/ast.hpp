@@ -1,38 +1,99 @@
 #pragma once
 
-#include "keyword.hpp"
+#include "quaternary.hpp"
 
 namespace plc {
 
-struct Quaternary{
-    std::string cmd,value1,value2,result;
-    Quaternary() = delete;
-    Quaternary(std::string cmd, std::string value1, std::string value2, std::string result);
-    explicit operator std::string() const;
+class CompilationContext;
+
+using NodeId = uint32_t;
+constexpr NodeId no_node = UINT32_MAX;
+
+enum class NodeKind : uint8_t{
+    Program,
+    Block,
+    Const,
+    Var,
+    Procedure,
+    Sequence,
+    Assign,
+    Call,
+    If,
+    While,
+    Condition,
+    Calc,
+    EmptyStatement,
+    // leaves, the meaning of ASTNode::value depends on the kind
+    Ident,      // SymbolIndex into AST::symbols
+    Number,     // index into AST::numbers
+    Operator,   // TokenKind
+};
+
+[[nodiscard]] std::string_view kindName(NodeKind kind);
+
+// 16 bytes per node; the children of a node are the NodeIds
+// edges[first, first+count), written once when the node is created.
+// Block nodes keep their ScopeId and Procedure nodes their SymbolIndex
+// in value.
+struct ASTNode{
+    NodeKind kind;
+    uint32_t value;
+    uint32_t first;
+    uint32_t count;
 };
 
+struct ChildRange{
+    const NodeId* begin_;
+    const NodeId* end_;
+    [[nodiscard]] const NodeId* begin() const {return begin_;}
+    [[nodiscard]] const NodeId* end() const {return end_;}
+    [[nodiscard]] size_t size() const {return end_ - begin_;}
+    [[nodiscard]] bool empty() const {return begin_ == end_;}
+    NodeId operator[](size_t i) const {return begin_[i];}
+};
+
+// All nodes of one program live in a single contiguous pool and refer to
+// each other by 32-bit index. Nodes are built bottom-up: a parent is only
+// created once all of its children exist.
 class AST{
 public:
-    AST(std::string name);
-    AST(std::string name, AST child1);
-    AST(std::string name, AST child1, AST child2);
-    AST(std::string name, AST child1, AST child2, AST child3);
-    AST(std::string name, std::vector<AST> children);
-    void addChild(AST child);
-    void addChild(std::string childname);
-    void print(std::ofstream& log_file) const;
-    [[nodiscard]] Result<std::string> getQuaternary();
-    [[nodiscard]] Result<size_t> output(std::string log_file_name) const;
-    static std::string getTempName();
+    explicit AST(Interner& interner);
+    NodeId addLeaf(NodeKind kind, uint32_t value);
+    NodeId addIdent(SymbolIndex symbol);
+    NodeId addNumber(int64_t number);
+    NodeId addOperator(TokenKind op);
+    NodeId addNode(NodeKind kind, const NodeId* children, size_t count, uint32_t value = 0);
+    NodeId addNode(NodeKind kind, std::initializer_list<NodeId> children, uint32_t value = 0);
+
+    [[nodiscard]] const ASTNode& operator[](NodeId n) const {return nodes[n];}
+    [[nodiscard]] NodeKind kind(NodeId n) const {return nodes[n].kind;}
+    [[nodiscard]] ChildRange children(NodeId n) const;
+    [[nodiscard]] NodeId child(NodeId n, size_t i) const {return edges[nodes[n].first + i];}
+    [[nodiscard]] SymbolIndex symbol(NodeId n) const {return nodes[n].value;}
+    [[nodiscard]] SymbolId ident(NodeId n) const {return symbols[nodes[n].value].name;}
+    [[nodiscard]] int64_t number(NodeId n) const {return numbers[nodes[n].value];}
+    [[nodiscard]] TokenKind op(NodeId n) const {return static_cast<TokenKind>(nodes[n].value);}
+    [[nodiscard]] bool isOperator(NodeId n, TokenKind op) const;
+    [[nodiscard]] std::string name(NodeId n) const;
+    [[nodiscard]] size_t size() const {return nodes.size();}
+    [[nodiscard]] size_t memoryUsage() const;
+    void clear();
+
+    void print(std::ostream& os) const;
+    void print(NodeId n, std::ostream& os) const;
+    [[nodiscard]] Result<QuadOperand> getQuaternary(CompilationContext& ctx) const;
+    [[nodiscard]] Result<QuadOperand> getQuaternary(NodeId n, CompilationContext& ctx) const;
+    [[nodiscard]] Result<QuadOperand> calcQuaternary(NodeId n, CompilationContext& ctx) const;
 
 public:
-    std::string name;
-    std::vector<AST> children;
-    static size_t temp_name;
-    static std::vector<Quaternary> code;
-    static std::map<std::string,size_t> procedure_line;
+    NodeId root = no_node;
+    std::vector<ASTNode> nodes;
+    std::vector<NodeId> edges;
+    std::vector<int64_t> numbers;
+    SymbolTable symbols;
+    Interner* interner;
 };
 
-Result<std::pair<size_t, AST>> ErrorPair(ErrorType err);
+Result<std::pair<size_t, NodeId>> ErrorPair(ErrorType err);
 
-}
\ No newline at end of file
+}
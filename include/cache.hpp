@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+#include "context.hpp"
+
+namespace plc {
+
+// FNV-1a, continued from seed
+[[nodiscard]] uint64_t hashBytes(std::string_view bytes, uint64_t seed = 0xcbf29ce484222325ull);
+
+// Keeps the optimized AST and quadruples of a unit in <dir>/<key>.plcir so an
+// unchanged source skips lexing, parsing and folding. A file is a header with
+// the format version, the key, a checksum of the payload and one
+// (offset, count) pair per section, followed by the sections as flat arrays;
+// load() maps it and copies the sections straight into the context.
+// Entries are written to a temporary name and renamed into place, so
+// concurrent compilers only ever see complete files. Once the directory
+// grows past max_bytes the least recently used entries are removed.
+class IRCache{
+    public:
+    static constexpr uint32_t version = 3;
+    static constexpr uint64_t default_max_bytes = 64ull << 20;
+
+    explicit IRCache(std::string dir, uint64_t max_bytes = default_max_bytes);
+
+    // the source text together with everything in the options that changes the IR
+    [[nodiscard]] static uint64_t key(std::string_view source, std::string_view options);
+    [[nodiscard]] std::string path(uint64_t key) const;
+
+    // ValueNotFoundError on a miss, IOError when the entry is damaged or from
+    // another version; the damaged entry is removed and ctx is left reset
+    [[nodiscard]] Result<size_t> load(uint64_t key, CompilationContext& ctx) const;
+    [[nodiscard]] Result<size_t> store(uint64_t key, const CompilationContext& ctx) const;
+    // returns the number of entries removed
+    size_t evict() const;
+
+    private:
+    std::string dir_;
+    uint64_t max_bytes_;
+};
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ast.hpp"
+#include "report.hpp"
+
+namespace plc {
+
+// Everything one compilation writes to. Nothing in the front end or the
+// backends keeps process-wide state, so independent contexts can compile
+// concurrently on different threads. reset() empties the context but keeps
+// the capacity of its pools, so a long-lived worker reuses its allocations.
+class CompilationContext{
+    public:
+    CompilationContext();
+    CompilationContext(const CompilationContext&) = delete;
+    CompilationContext& operator=(const CompilationContext&) = delete;
+
+    void reset();
+    QuadOperand newTemp();
+    // a Constant operand for v, one pool entry per distinct value
+    QuadOperand constant(int64_t v);
+    [[nodiscard]] int64_t constantValue(QuadOperand op) const {return constants[op.index()];}
+    [[nodiscard]] std::string format(QuadOperand op) const;
+    [[nodiscard]] std::string format(const Quaternary& q) const;
+    [[nodiscard]] Result<size_t> output(std::string log_file_name) const;
+
+    public:
+    Interner interner;
+    AST ast;
+    std::vector<Quaternary> code;
+    std::vector<int64_t> constants;
+    std::unordered_map<int64_t,uint32_t> constant_index;
+    uint32_t temp_name = 0;
+    std::unordered_map<SymbolIndex,size_t> procedure_line;
+    std::unordered_map<SymbolIndex,size_t> procedure_end;     // first quadruple after the body
+    std::ostream* out = &std::cout;
+    std::ostream* diagnostics = &std::cerr;
+    TimeReport* report = nullptr;       // null: nothing is measured
+};
+
+}
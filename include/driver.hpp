@@ -0,0 +1,70 @@
+#pragma once
+
+#include <thread>
+#include "asm.hpp"
+#include "cache.hpp"
+#include "elf.hpp"
+#include "jit.hpp"
+#include "grammar.hpp"
+#include "inline.hpp"
+#include "optimize.hpp"
+#include "vm.hpp"
+
+namespace plc {
+
+enum class TimeReportFormat{
+    None,
+    Text,       // a table on the diagnostics stream
+    JSON,       // one object on stdout
+};
+
+struct DriverOptions{
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    size_t codegen_jobs = 1;    // threads per unit for procedure codegen
+    std::string output_dir;     // empty: next to each input
+    LexerMode lexer = LexerMode::DFA;
+    int opt_level = 1;          // 0: none, 1: constant folding and peephole, 2: + register allocation
+    size_t inline_budget = 40;  // AST nodes of a procedure inlined at every call, with opt_level > 0
+    bool assemble = true;       // false (-S): stop at the .asm
+    bool link = true;           // false (-c): relocatable <stem>.o instead of an executable
+    bool use_nasm = false;      // build through nasm and ld instead of the built-in encoder
+    bool ssa = false;           // generate code through the SSA form instead of straight from the AST
+    FrameLinks frame_links = FrameLinks::Display;
+    bool jit = false;           // run in-process and print the main program's variables, write no binary
+    bool interpret = false;     // like jit, but run the quadruples on the VM instead of generating code
+    bool emit_ir = false;       // <stem>.ir.txt with the quadruples, and <stem>.ssa.txt with --ssa
+    bool emit_log = false;      // <stem>.log.txt with the parser log
+    bool dump_ast = false;
+    bool stats = false;         // optimizer counts in each unit's diagnostics
+    TimeReportFormat time_report = TimeReportFormat::None;
+    std::string cache_dir;      // empty: no IR cache
+    uint64_t cache_max_bytes = IRCache::default_max_bytes;
+    std::vector<std::string> inputs;
+};
+
+struct UnitResult{
+    bool ok = false;
+    size_t bytes = 0;
+    std::string diagnostics;
+    TimeReport report;          // empty unless options.time_report
+};
+
+struct BatchStats{
+    size_t files = 0;
+    size_t failed = 0;
+    size_t bytes = 0;
+    double seconds = 0;
+    TimeReport report;          // every unit's added up
+};
+
+[[nodiscard]] Result<DriverOptions> parseArguments(int argc, char** argv, std::ostream& err);
+void printUsage(std::ostream& os);
+
+// lex -> parse -> IR -> asm for one file; ctx is reset first and reused
+[[nodiscard]] UnitResult compileUnit(const std::string& input, const DriverOptions& options, CompilationContext& ctx);
+
+// compiles every input on a work-stealing pool of options.jobs workers and
+// writes each unit's diagnostics to diagnostics in input order
+BatchStats compileBatch(const DriverOptions& options, std::ostream& diagnostics);
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "x86.hpp"
+
+namespace plc {
+
+enum class ElfType{
+    Executable,     // static, entry at _start, loaded at elf_base_address
+    Relocatable,    // .o for ld; code is position independent so no relocations
+};
+
+constexpr uint64_t elf_base_address = 0x400000;
+
+// Writes the code as the .text of an ELF64 file with a symbol for every
+// label. Returns the number of bytes written.
+[[nodiscard]] Result<size_t> writeELF(const std::string& path, const MachineCode& code, ElfType type);
+
+}
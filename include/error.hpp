@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdexcept>
+#include <string>
+#include <utility>
+
 namespace plc {
 
 enum class ErrorType{
@@ -11,6 +15,7 @@ enum class ErrorType{
     CompileError,
     ValueNotFoundError,
     SymbolLookupError,
+    RuntimeError,
 };
 
 template <class T>
@@ -21,8 +26,8 @@ private:
 public:
     bool isOk;
     Result() = delete;
-    explicit Result(T res, ErrorType err) : value(res), isOk(false), err(err) {};
-    explicit Result(T res) : value(res), isOk(true) {};
+    explicit Result(T res, ErrorType err) : value(std::move(res)), isOk(false), err(err) {};
+    explicit Result(T res) : value(std::move(res)), isOk(true) {};
     explicit Result(ErrorType err) : err(err), isOk(false) {};
     T operator*() const{
         if(isOk) return value;
@@ -32,6 +37,10 @@ public:
         if(isOk) return value;
         else throw std::runtime_error(std::string("attempting to unwrap an error result ")+static_cast<std::string>(*this));
     }
+    T &unwrap(){
+        if(isOk) return value;
+        else throw std::runtime_error(std::string("attempting to unwrap an error result ")+static_cast<std::string>(*this));
+    }
     const T* operator->() const{
         if(isOk) return &value;
         else throw std::runtime_error(std::string("attempting to dereference an error result ")+static_cast<std::string>(*this));
@@ -66,6 +75,9 @@ public:
                     break;
                 case ErrorType::SymbolLookupError:
                     errstring = "SymbolLookupError";
+                    break;
+                case ErrorType::RuntimeError:
+                    errstring = "RuntimeError";
             }
             return "Error(" + errstring + ")";
         }
@@ -73,8 +85,8 @@ public:
 };
 
 template<class T>
-Result<T> Ok(const T &res) {
-    return Result<T>(res);
+Result<T> Ok(T res) {
+    return Result<T>(std::move(res));
 }
 
 template<class T>
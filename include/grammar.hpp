@@ -1,39 +1,57 @@
 #pragma once
 #include <filesystem>
-#include "ast.hpp"
+#include "context.hpp"
 
 namespace plc{
 
-enum class IdentType{
-    ProcedureIdent,
-    ConstIdent,
-    VarIdent,
-};
-
 class GrammarInterpreter{
     public:
-    GrammarInterpreter() = default;
-    explicit GrammarInterpreter(const std::vector<Token>& tokens);
-    GrammarInterpreter(const std::vector<Token>& tokens, std::string log_file_name);
+    GrammarInterpreter(const std::vector<Token>& tokens, CompilationContext& ctx);
+    GrammarInterpreter(const std::vector<Token>& tokens, CompilationContext& ctx, std::string log_file_name);
 
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretProgram(size_t n) noexcept;
+    // builds ctx.ast and returns its root
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretProgram(size_t n) noexcept;
+
+    // Blocks and statements open inside each other at most this deep; the
+    // passes after parsing recurse once per level, so deeper input is
+    // rejected with a diagnostic instead of overflowing their stack.
+    // Parentheses are not counted, every walk over an expression is iterative.
+    static constexpr size_t max_nesting = 10000;
 
     private:
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretBlock(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretConstDecl(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretVarDecl(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretStatement(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretStatementSequence(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretCondition(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretExpression(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretTerm(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretFactor(size_t n);
-    [[nodiscard]] Result<std::pair<size_t,AST>> interpretProcedure(size_t n);
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretBlock(size_t n);
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretConstDecl(size_t n);
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretVarDecl(size_t n);
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretStatement(size_t n);
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretStatementSequence(size_t n);
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretCondition(size_t n);
+    // iterative, so nesting depth costs heap instead of native stack
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretExpression(size_t n);
+    [[nodiscard]] Result<std::pair<size_t,NodeId>> interpretProcedure(size_t n);
     void error(const std::string& name, size_t n);
+    // whether the open blocks and statements exceed max_nesting; reports it at token n
+    [[nodiscard]] bool tooDeep(size_t n);
+    [[nodiscard]] Result<SymbolIndex> declare(IdentType type, size_t n, int64_t value = 0);
+    [[nodiscard]] Result<SymbolIndex> resolve(size_t n, bool allow_var, bool allow_const, bool allow_procedure);
+    NodeId operatorLeaf(size_t n);
+    Result<NodeId> number(size_t n);
+    // creates a node from the children pushed onto stack_ since mark
+    NodeId reduce(NodeKind kind, size_t mark, uint32_t value = 0);
+    // the single child since mark, or a Calc node of all of them
+    NodeId collapse(size_t mark);
+
+    struct ExpressionFrame{
+        size_t expression_mark;
+        size_t term_mark;
+    };
 
-    std::vector<std::pair<IdentType,std::string>> symbol_table;
     std::vector<Token> token_list;
     std::ofstream log_file;
+    CompilationContext& ctx_;
+    AST& ast_;
+    std::vector<NodeId> stack_;
+    std::vector<ExpressionFrame> frames_;   // expressions enclosing an open '('
+    size_t depth_ = 0;                      // blocks and statements being parsed
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ast.hpp"
+
+namespace plc {
+
+struct InlineStats{
+    size_t inlined = 0;     // calls replaced by the body of the procedure
+    size_t removed = 0;     // procedures no call reaches any more
+};
+
+// Walks the call graph of the program callees first and replaces a call
+// with a copy of the called procedure's statement when the procedure has
+// at most budget AST nodes there, or is called from only one place.
+// Recursive procedures and procedures declaring procedures that are still
+// called are never inlined. The variables of a copied body become
+// variables of the caller's scope, one set per caller and callee, and
+// each copy starts by setting the ones it uses to zero, as a call would.
+// Procedures that no call from the main program reaches any more are
+// removed. A budget of 0 leaves the AST alone.
+InlineStats inlineProcedures(AST& ast, size_t budget);
+
+}
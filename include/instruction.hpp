@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace plc {
+
+// numbered like the x86-64 register encoding
+enum class Reg : uint8_t{
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15,
+    none = UINT8_MAX,
+};
+
+[[nodiscard]] std::string_view regName(Reg reg);
+
+enum class OperandKind : uint8_t{
+    None,
+    Register,
+    Memory,     // qword [reg+value]
+    Immediate,
+};
+
+struct Operand{
+    OperandKind kind = OperandKind::None;
+    Reg reg = Reg::none;
+    int64_t value = 0;
+
+    [[nodiscard]] bool isReg() const {return kind == OperandKind::Register;}
+    [[nodiscard]] bool isReg(Reg r) const {return kind == OperandKind::Register && reg == r;}
+    [[nodiscard]] bool isMem() const {return kind == OperandKind::Memory;}
+    [[nodiscard]] bool isImm() const {return kind == OperandKind::Immediate;}
+    [[nodiscard]] bool isNone() const {return kind == OperandKind::None;}
+    // x86-64 only takes sign-extended 32-bit immediates outside of mov reg,imm64
+    [[nodiscard]] bool isImm32() const {return isImm() && value >= INT32_MIN && value <= INT32_MAX;}
+    bool operator==(const Operand& other) const {return kind == other.kind && reg == other.reg && value == other.value;}
+    bool operator!=(const Operand& other) const {return !(*this == other);}
+    void print(std::ostream& os) const;
+};
+
+[[nodiscard]] inline Operand reg(Reg r) {return Operand{OperandKind::Register, r, 0};}
+[[nodiscard]] inline Operand mem(Reg base, int64_t disp) {return Operand{OperandKind::Memory, base, disp};}
+[[nodiscard]] inline Operand imm(int64_t value) {return Operand{OperandKind::Immediate, Reg::none, value};}
+
+enum class Opcode : uint8_t{
+    Label,      // local label definition, name in target
+    Mov, Add, Sub, Imul, Idiv, Cqo, Cmp, Test, Xor, Shl, Shr, Sar, Neg,
+    Push, Pop,
+    Jmp, Je, Jne, Jl, Jle, Jg, Jge, Jz, Jnz,
+    Call, Ret, Syscall,
+};
+
+[[nodiscard]] std::string_view opcodeName(Opcode op);
+[[nodiscard]] bool isConditionalJump(Opcode op);
+[[nodiscard]] Opcode invertJump(Opcode op);
+
+// One line of a Label. Jumps, calls and label definitions name their label
+// in target; everything else uses up to two operands in Intel order.
+struct Instruction{
+    Opcode op;
+    Operand dst;
+    Operand src;
+    std::string target;
+
+    Instruction(Opcode op, Operand dst = {}, Operand src = {});
+    Instruction(Opcode op, std::string target);
+    [[nodiscard]] bool isJump() const {return op == Opcode::Jmp || isConditionalJump(op);}
+    // jumps, calls, returns and labels: the points the scratch registers die at
+    [[nodiscard]] bool isControl() const;
+    // NASM syntax, without indentation or newline
+    void print(std::ostream& os) const;
+    explicit operator std::string() const;
+};
+
+}
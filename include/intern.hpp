@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace plc {
+
+using SymbolId = uint32_t;
+constexpr SymbolId no_symbol = UINT32_MAX;
+
+// Maps every distinct identifier spelling to a dense id starting at 0.
+// Spellings are copied once into chunked storage that never moves, so the
+// views handed out by str() stay valid for the interner's lifetime.
+class Interner{
+    public:
+    Interner() = default;
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    SymbolId intern(std::string_view name);
+    [[nodiscard]] SymbolId find(std::string_view name) const;
+    [[nodiscard]] std::string_view str(SymbolId id) const {return strings_[id];}
+    [[nodiscard]] size_t size() const {return strings_.size();}
+
+    // forgets every spelling but keeps the first storage chunk and the table's buckets
+    void clear();
+
+    private:
+    const char* store(std::string_view name);
+
+    static constexpr size_t chunk_size = 16384;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    size_t chunk_used_ = chunk_size;
+    std::vector<std::string_view> strings_;
+    std::unordered_map<std::string_view, SymbolId> ids_;
+};
+
+}
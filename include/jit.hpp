@@ -0,0 +1,49 @@
+#pragma once
+
+#include "x86.hpp"
+
+namespace plc {
+
+// Runs a program inside this process. The text is encoded into an anonymous
+// mapping that becomes executable once written, and _start is called as
+// void(int64_t* globals): the main program's variables live in globals() by
+// declaration slot, so the caller reads them back after run().
+class JITLinuxX64 : public ASMGenerator{
+    public:
+    explicit JITLinuxX64(CodegenOptions options = {});
+    ~JITLinuxX64() override;
+    JITLinuxX64(const JITLinuxX64&) = delete;
+    JITLinuxX64& operator=(const JITLinuxX64&) = delete;
+
+    [[nodiscard]] Result<std::string> generate(CompilationContext& ctx) override;
+    // loads the code, writing its text to asmfile unless that is empty; nothing is linked
+    [[nodiscard]] Result<int> compile(CompilationContext& ctx, const std::string &asmfile = "", const std::string &objfile = "", const std::string &exefile = "") override;
+    [[nodiscard]] Result<int> load(CompilationContext& ctx);
+    // zeroes the globals and runs the loaded program once on a stack of its
+    // own; a division by zero or overflowing one, and recursion that runs out
+    // of that stack, is a RuntimeError, as on the interpreter
+    [[nodiscard]] Result<int> run();
+
+    // reserved for the program's stack, about 256 bytes for each of the
+    // VM::max_call_depth calls the interpreter allows
+    static constexpr size_t stack_size = size_t{256} << 20;
+
+    [[nodiscard]] const std::vector<int64_t>& globals() const {return globals_;}
+    [[nodiscard]] Result<int64_t> global(const CompilationContext& ctx, std::string_view name) const;
+    [[nodiscard]] const NASMLinuxELF64& backend() const {return backend_;}
+    [[nodiscard]] size_t codeSize() const {return code_size_;}
+
+    private:
+    void unload();
+
+    NASMLinuxELF64 backend_;
+    void* code_ = nullptr;
+    void* stack_ = nullptr;
+    std::vector<char> signal_stack_;
+    size_t mapped_ = 0;
+    size_t code_size_ = 0;
+    uint64_t entry_ = 0;
+    std::vector<int64_t> globals_;
+};
+
+}
@@ -7,7 +7,10 @@
 #include <fstream>
 #include <stdexcept>
 #include <sstream>
+#include <string_view>
 #include "error.hpp"
+#include "intern.hpp"
+#include "source.hpp"
 
 namespace plc{
 
@@ -20,30 +23,82 @@ enum class TokenType{
     EndOfFile   = 6,
 };
 
+enum class TokenKind : uint8_t{
+    Identifier,
+    Literal,
+    EndOfFile,
+    // keywords
+    Begin, End, If, Then, While, Do, Procedure, Call, Const, Var, Odd,
+    // delimiters
+    Becomes, Period, Semicolon, Comma, LParen, RParen,
+    // operators
+    Equal, Hash, Less, LessEqual, Greater, GreaterEqual, NotEqual, Plus, Minus, Times, Slash,
+};
+
+[[nodiscard]] TokenKind keywordKind(std::string_view word);
+[[nodiscard]] TokenKind symbolKind(std::string_view word);
+[[nodiscard]] std::string_view kindSpelling(TokenKind kind);
+
+enum class LexerMode{
+    DFA,
+    Regex,
+};
+
+// value_ points into the SourceBuffer the token was scanned from, id_ is the
+// interned identifier for TokenKind::Identifier and no_symbol otherwise
 class Token{
     public:
     TokenType type_;
-    std::string value_;
+    TokenKind kind_ = TokenKind::EndOfFile;
+    SymbolId id_ = no_symbol;
+    std::string_view value_;
+    uint32_t line_ = 0;
+    uint32_t column_ = 0;
     Token() = default;
-    Token(TokenType type, std::string value);
+    Token(TokenType type, std::string_view value);
+    Token(TokenType type, TokenKind kind, SymbolId id, std::string_view value, uint32_t line, uint32_t column);
     explicit operator std::string() const;
     bool operator==(const Token &other) const;
 };
 
+// tokens together with the buffer that backs their values
+class TokenList{
+    public:
+    std::shared_ptr<const SourceBuffer> source;
+    std::vector<Token> tokens;
+    TokenList() = default;
+    TokenList(std::shared_ptr<const SourceBuffer> source, std::vector<Token> tokens);
+    [[nodiscard]] std::vector<Token>::const_iterator begin() const {return tokens.begin();}
+    [[nodiscard]] std::vector<Token>::const_iterator end() const {return tokens.end();}
+    [[nodiscard]] size_t size() const {return tokens.size();}
+    const Token& operator[](size_t n) const {return tokens[n];}
+    bool operator==(const TokenList &other) const {return tokens == other.tokens;}
+};
+
 class KeyWordInterpreter{
     public:
-    KeyWordInterpreter();
-    explicit KeyWordInterpreter(const std::vector<std::pair<TokenType, std::string>> &keyword_regex_pair);
+    // identifiers are interned into the compilation's interner
+    explicit KeyWordInterpreter(Interner &interner);
+    KeyWordInterpreter(LexerMode mode, Interner &interner);
+    KeyWordInterpreter(const std::vector<std::pair<TokenType, std::string>> &keyword_regex_pair, Interner &interner);
 
     [[nodiscard]] Result<Token> interpret(const std::string &input) const noexcept;
     [[nodiscard]] Result<Token> interpretCheckAmbiguity(const std::string &input) const noexcept;
-    [[nodiscard]] Result<std::vector<Token>> interpretString(const std::string &input) const noexcept;
-    [[nodiscard]] Result<std::vector<Token>> interpretFile(const std::string &filename) const noexcept;
+    [[nodiscard]] Result<TokenList> interpretString(const std::string &input) const noexcept;
+    [[nodiscard]] Result<TokenList> interpretFile(const std::string &filename) const noexcept;
+    [[nodiscard]] Result<TokenList> interpretSource(const std::shared_ptr<const SourceBuffer> &source) const noexcept;
+
+    // single pass over the raw buffer, no regex involved
+    [[nodiscard]] static Result<TokenList> scanSource(const std::shared_ptr<const SourceBuffer> &source, Interner &interner) noexcept;
+    // reference path: splitString followed by one regex match per word
+    [[nodiscard]] Result<TokenList> interpretSourceRegex(const std::shared_ptr<const SourceBuffer> &source) const noexcept;
 
     static Result<std::string> splitString(const std::string &input) noexcept;
 
     public:
     std::vector<std::pair<TokenType, std::string>> keyword_regex_pair_;
+    LexerMode mode_ = LexerMode::DFA;
+    Interner* interner_;
 
     private:
     bool debug_ = true;
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "context.hpp"
+
+namespace plc {
+
+// Compile-time arithmetic shared by the AST and quadruple passes. Both
+// return false when the result must be left to run time (division by zero,
+// INT64_MIN / -1, or an operator that is not arithmetic / relational).
+[[nodiscard]] bool foldArithmetic(TokenKind op, int64_t lhs, int64_t rhs, int64_t& result);
+[[nodiscard]] bool foldCondition(TokenKind op, int64_t lhs, int64_t rhs, bool& result);
+
+// Folds literal expressions, replaces references to `const` symbols with
+// their value, drops `+0`/`*1` style operands and resolves if/while whose
+// condition is known. The AST is rewritten in place; returns the number of
+// nodes changed.
+size_t foldConstants(AST& ast);
+
+// Runs on ctx.code after getQuaternary: propagates consts, literals and
+// copies inside basic blocks, folds arithmetic and known conditional jumps,
+// drops dead temporaries and unreachable code, then renumbers the jumps,
+// ctx.procedure_line and ctx.procedure_end. Returns the number of
+// quadruples removed.
+size_t foldConstants(CompilationContext& ctx);
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+#include "instruction.hpp"
+
+namespace plc {
+
+struct PeepholeStats{
+    size_t removed = 0;     // instructions and labels dropped
+    size_t rewritten = 0;   // instructions replaced by a cheaper form
+    PeepholeStats& operator+=(const PeepholeStats& other);
+};
+
+// Rewrites the lines of one label until nothing changes: store/load round
+// trips, load-op-store through rax, stack adjustments, multiplications by a
+// constant, jump chains, jumps to the next line and unreachable code.
+// rax, rbx, rcx and rdx are assumed dead at every jump, call and label,
+// which is what the NASM backend relies on between statements, except for
+// the frame pointer a call passes in rax.
+PeepholeStats peephole(std::vector<Instruction>& code);
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <functional>
+#include "keyword.hpp"
+#include "symbol.hpp"
+
+namespace plc {
+
+// The arithmetic and conditional jump opcodes follow TokenKind's operator
+// order, so converting between the two is an offset.
+enum class QuadOp : uint8_t{
+    Assign,
+    Add, Sub, Mul, Div,
+    Jump,
+    JumpEqual, JumpHash, JumpLess, JumpLessEqual, JumpGreater, JumpGreaterEqual, JumpNotEqual,
+    JumpOdd,
+};
+
+// Arithmetic ops for Plus..Slash, conditional jumps for Equal..NotEqual and Odd.
+[[nodiscard]] QuadOp arithmeticOp(TokenKind op);
+[[nodiscard]] QuadOp jumpOp(TokenKind op);
+// the TokenKind a QuadOp was made from, Becomes for Assign and Jump
+[[nodiscard]] TokenKind quadKind(QuadOp op);
+[[nodiscard]] std::string quadSpelling(QuadOp op);
+
+[[nodiscard]] inline bool isJump(QuadOp op){return op >= QuadOp::Jump;}
+[[nodiscard]] inline bool isConditionalJump(QuadOp op){return op > QuadOp::Jump;}
+
+enum class QuadOperandKind : uint8_t{
+    None,
+    Slot,       // SymbolIndex of a variable or const
+    Constant,   // index into CompilationContext::constants
+    Temp,       // temporary number
+    Label,      // quadruple index
+};
+
+// 32 bits: the kind in the top 3, its index in the rest.
+class QuadOperand{
+    public:
+    static constexpr uint32_t index_bits = 29;
+    static constexpr uint32_t max_index = (1u << index_bits) - 1;
+
+    constexpr QuadOperand() = default;
+    constexpr QuadOperand(QuadOperandKind kind, uint32_t index):bits_(static_cast<uint32_t>(kind) << index_bits | index){}
+
+    static constexpr QuadOperand slot(SymbolIndex sym) {return {QuadOperandKind::Slot, sym};}
+    static constexpr QuadOperand temp(uint32_t n) {return {QuadOperandKind::Temp, n};}
+    static constexpr QuadOperand label(size_t quad) {return {QuadOperandKind::Label, static_cast<uint32_t>(quad)};}
+
+    [[nodiscard]] constexpr QuadOperandKind kind() const {return static_cast<QuadOperandKind>(bits_ >> index_bits);}
+    [[nodiscard]] constexpr uint32_t index() const {return bits_ & max_index;}
+    [[nodiscard]] constexpr uint32_t bits() const {return bits_;}
+    [[nodiscard]] constexpr bool isNone() const {return kind() == QuadOperandKind::None;}
+    [[nodiscard]] constexpr bool isSlot() const {return kind() == QuadOperandKind::Slot;}
+    [[nodiscard]] constexpr bool isConstant() const {return kind() == QuadOperandKind::Constant;}
+    [[nodiscard]] constexpr bool isTemp() const {return kind() == QuadOperandKind::Temp;}
+
+    constexpr bool operator==(QuadOperand other) const {return bits_ == other.bits_;}
+    constexpr bool operator!=(QuadOperand other) const {return bits_ != other.bits_;}
+
+    private:
+    uint32_t bits_ = 0;
+};
+
+// 16 bytes; a jump keeps its target as a Label in result. The textual
+// "(op, a, b, r)" form is only built by CompilationContext::format.
+struct Quaternary{
+    QuadOp op;
+    QuadOperand a;
+    QuadOperand b;
+    QuadOperand result;
+};
+
+}
+
+template <>
+struct std::hash<plc::QuadOperand>{
+    size_t operator()(plc::QuadOperand op) const noexcept {return std::hash<uint32_t>()(op.bits());}
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include "ast.hpp"
+#include "instruction.hpp"
+
+namespace plc {
+
+// rax, rbx, rcx and rdx are scratch for expressions and comparisons, rsp and
+// rbp are the frame; everything else can hold a variable.
+constexpr std::array<Reg, 10> allocatable_registers = {
+    Reg::rsi, Reg::rdi, Reg::r8, Reg::r9, Reg::r10, Reg::r11, Reg::r12, Reg::r13, Reg::r14, Reg::r15,
+};
+constexpr uint8_t no_register = UINT8_MAX;
+
+struct LiveInterval{
+    SymbolIndex var;
+    uint32_t start;
+    uint32_t end;
+};
+
+// Where each variable lives after allocation. A procedure saves the
+// registers its own variables occupy on entry, so the caller's registers
+// survive a call.
+struct RegisterAssignment{
+    std::vector<uint8_t> reg;       // by SymbolIndex, no_register: stack slot
+    std::vector<uint16_t> used;     // by ScopeId, bit i: allocatable_registers[i]
+    std::vector<uint16_t> cleared;  // by ScopeId, the registers of used read before they are written
+    std::vector<std::vector<uint32_t>> frame_slots;     // by ScopeId, slots of the variables left in memory
+    size_t allocated = 0;
+    size_t spilled = 0;
+
+    [[nodiscard]] bool inRegister(SymbolIndex var) const {return var < reg.size() && reg[var] != no_register;}
+    [[nodiscard]] Reg location(SymbolIndex var) const {return allocatable_registers[reg[var]];}
+    [[nodiscard]] std::vector<Reg> saved(const SymbolTable& table, ScopeId scope) const;
+    // every register the variables of scope occupy
+    [[nodiscard]] std::vector<Reg> registers(ScopeId scope) const;
+    // the registers of scope to zero on entry: a variable written before it
+    // is ever read needs no zero
+    [[nodiscard]] std::vector<Reg> zeroed(ScopeId scope) const;
+    void clear();
+};
+
+// Liveness over the linearized statements of each scope, then linear scan
+// per scope. Variables a nested procedure reaches into stay in memory, and
+// a variable referenced inside a while loop is kept live across the loop.
+// Variables start at zero, so one that may be read before it is written is
+// live from the start of its scope, where its register or slot is cleared.
+class LinearScanAllocator{
+    public:
+    explicit LinearScanAllocator(const AST& ast);
+    [[nodiscard]] RegisterAssignment run();
+
+    private:
+    void walk(NodeId n, ScopeId scope);
+    void expression(NodeId n, ScopeId scope);
+    void use(NodeId ident, ScopeId scope, bool write = false);
+    void allocate(std::vector<LiveInterval>& intervals, ScopeId scope, RegisterAssignment& out) const;
+
+    const AST& ast_;
+    uint32_t position_ = 0;
+    std::vector<LiveInterval> intervals_;   // by SymbolIndex
+    std::vector<char> escapes_;             // by SymbolIndex
+    std::vector<char> written_first_;       // by SymbolIndex: first referenced by an unconditional Assign
+    std::vector<uint32_t> entry_;           // by ScopeId, position of its block
+    uint32_t conditional_ = 0;              // If and While being walked
+    std::vector<std::vector<std::pair<uint32_t,uint32_t>>> loops_;   // by ScopeId
+};
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace plc {
+
+// Codegen's sub-passes run inside it and are reported under it.
+enum class Phase : uint8_t{
+    Lex, Parse, Inline, FoldAST, IR, FoldIR, Cache, Codegen, SSA, SSAOptimize, RegisterAllocation, Peephole, Encode, Output, Run,
+};
+constexpr size_t phase_count = static_cast<size_t>(Phase::Run) + 1;
+
+[[nodiscard]] const char* phaseName(Phase phase);
+
+struct AllocationCounters{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// What this thread allocated through operator new so far. Only programs
+// that link src/allocations.cpp, such as plc, count; the library alone does
+// not replace operator new, so embedders see zero allocations per phase.
+[[nodiscard]] AllocationCounters threadAllocations();
+void countAllocation(size_t bytes);
+
+struct PhaseStats{
+    double seconds = 0;
+    uint64_t calls = 0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+};
+
+// Time and allocations per phase plus what the phases produced. Reports of
+// several units add up; the times then sum over every worker.
+class TimeReport{
+    public:
+    void add(Phase phase, double seconds, AllocationCounters allocated = {});
+    TimeReport& operator+=(const TimeReport& other);
+    [[nodiscard]] const PhaseStats& operator[](Phase phase) const {return phases_[static_cast<size_t>(phase)];}
+
+    // a table like -ftime-report, or one JSON object
+    void print(std::ostream& os) const;
+    void printJSON(std::ostream& os) const;
+
+    uint64_t files = 0;
+    uint64_t tokens = 0;
+    uint64_t nodes = 0;
+    uint64_t quadruples = 0;
+    uint64_t labels = 0;
+    uint64_t instructions = 0;
+
+    private:
+    std::array<PhaseStats, phase_count> phases_{};
+};
+
+// Charges the time and the allocations of its lifetime on this thread to
+// phase. With a null report it reads neither the clock nor the counters.
+class ScopedTimer{
+    public:
+    ScopedTimer(TimeReport* report, Phase phase):report_(report),phase_(phase){
+        if (report_) start();
+    }
+    ~ScopedTimer(){
+        if (report_) stop();
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+    void start();
+    void stop();
+
+    TimeReport* report_;
+    Phase phase_;
+    std::chrono::steady_clock::time_point start_;
+    AllocationCounters allocated_;
+};
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include "error.hpp"
+
+namespace plc {
+
+// Owns the bytes of one translation unit. Files are mmap'd read-only when the
+// platform allows it, otherwise read once into a single heap buffer. Tokens
+// keep string_views into this buffer, so it must outlive them.
+class SourceBuffer{
+    public:
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    ~SourceBuffer();
+
+    [[nodiscard]] static Result<std::shared_ptr<const SourceBuffer>> fromFile(const std::string &filename) noexcept;
+    [[nodiscard]] static std::shared_ptr<const SourceBuffer> fromString(std::string text);
+
+    [[nodiscard]] std::string_view view() const {return {data_, size_};}
+    [[nodiscard]] const std::string& name() const {return name_;}
+    [[nodiscard]] bool mapped() const {return mapped_;}
+
+    private:
+    SourceBuffer() = default;
+    static std::shared_ptr<SourceBuffer> makeOwned(std::string text);
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::string owned_;
+    std::string name_;
+};
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ast.hpp"
+
+namespace plc {
+
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+constexpr ValueId no_value = UINT32_MAX;
+constexpr BlockId no_block = UINT32_MAX;
+
+enum class SSAOp : uint8_t{
+    Const,      // constant, belongs to no block unless folded into one
+    Phi,        // args: one per predecessor of its block, in the same order
+    Add, Sub, Mul, Div,
+    Load,       // symbol: a variable kept in memory
+    Store,      // symbol, args[0]: the value written
+    Call,       // symbol: the procedure
+};
+
+[[nodiscard]] std::string_view ssaOpName(SSAOp op);
+
+struct SSAValue{
+    SSAOp op;
+    BlockId block = no_block;
+    SymbolIndex symbol = no_symbol_index;   // Load, Store, Call; the variable a Phi merges
+    int64_t constant = 0;
+    std::vector<ValueId> args;
+};
+
+enum class SSATerminator : uint8_t{
+    Jump,       // to succs[0]
+    Branch,     // to succs[0] when lhs relation rhs holds, else succs[1]; odd has no rhs
+    Return,
+};
+
+struct SSABlock{
+    std::vector<ValueId> code;      // phis first, then the rest in execution order
+    std::vector<BlockId> preds;
+    std::vector<BlockId> succs;
+    SSATerminator terminator = SSATerminator::Return;
+    TokenKind relation = TokenKind::Equal;
+    ValueId lhs = no_value;
+    ValueId rhs = no_value;
+};
+
+// The main program or one procedure as a CFG of basic blocks in SSA form.
+// Variables of its own scope that no nested procedure touches are SSA
+// values; all others are reached through Load and Store. Block 0 is the
+// entry, and the blocks are laid out in the order they are stored.
+struct SSAFunction{
+    SymbolIndex procedure = no_symbol_index;    // no_symbol_index: the main program
+    ScopeId scope = 0;
+    std::vector<SSABlock> blocks;
+    std::vector<SSAValue> values;
+
+    [[nodiscard]] bool isConst(ValueId v) const {return values[v].op == SSAOp::Const;}
+    // values placed in blocks, phis included
+    [[nodiscard]] size_t instructionCount() const;
+};
+
+struct SSAProgram{
+    std::vector<SSAFunction> functions;     // the main program first, then procedures in source order
+    std::vector<char> promoted;             // by SymbolIndex: the variable lives in SSA values
+
+    void print(std::ostream& os, const AST& ast) const;
+};
+
+// Builds one function per procedure straight from the AST. Promoted
+// variables start as 0, like the interpreter's; the main program stores
+// their final values before it returns, since those are its result.
+[[nodiscard]] Result<SSAProgram> buildSSA(const AST& ast);
+
+struct SSAStats{
+    size_t values = 0;      // instructions and phis removed or folded away
+    size_t stores = 0;      // dead stores removed
+    size_t blocks = 0;      // unreachable or merged blocks removed
+    size_t hoisted = 0;     // loop-invariant values moved in front of their loop
+    size_t inductions = 0;  // induction variable products turned into induction variables
+    SSAStats& operator+=(const SSAStats& other);
+};
+
+// Folds constant arithmetic and branches, removes unreachable blocks and
+// merges straight-line ones, then removes dead stores and dead code, until
+// nothing changes; then optimizes the loops and cleans up after them.
+SSAStats optimizeSSA(SSAFunction& f, const SymbolTable& symbols);
+
+// Single passes, each returning what it removed.
+SSAStats foldSSA(SSAFunction& f);
+SSAStats simplifyCFG(SSAFunction& f);
+SSAStats eliminateDeadStores(SSAFunction& f, const SymbolTable& symbols);
+SSAStats eliminateDeadCode(SSAFunction& f);
+
+// Gives every natural loop a preheader and hoists into it what the loop
+// computes from values defined outside it, and loads of variables it
+// neither stores nor can change through a call. In a loop with one back
+// edge, i*c for an induction variable i stepped by a constant becomes a
+// variable of its own, stepped by the product.
+SSAStats optimizeLoops(SSAFunction& f);
+
+// Puts an empty block on every edge from a branch to a block with phis,
+// right before that block, so phi copies have a place of their own.
+void splitCriticalEdges(SSAFunction& f);
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include "instruction.hpp"
+
+namespace plc {
+
+// m and s such that n / d == hi64(n * m) >> s, rounded down, for every
+// int64 n; m is taken as a signed multiplier and may need n added back
+struct DivisionMagic{
+    int64_t multiplier;
+    int shift;
+};
+
+// for 2 < d < 2^63 that is not a power of two
+[[nodiscard]] DivisionMagic divisionMagic(int64_t d);
+
+// Appends r *= factor: nothing, xor, neg or shifts where the factor allows,
+// else imul r,imm. scratch holds a factor beyond 32 bits. Flags are clobbered.
+void multiplyByConstant(std::vector<Instruction>& out, Reg r, int64_t factor, Reg scratch);
+
+// Appends rax /= divisor rounded toward zero like idiv, through shifts for
+// powers of two and a multiply-high otherwise; clobbers rbx, rdx and the
+// flags. False for 0, -1 and INT64_MIN, which stay with idiv.
+[[nodiscard]] bool divideByConstant(std::vector<Instruction>& out, int64_t divisor);
+
+}
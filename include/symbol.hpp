@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include "error.hpp"
+#include "intern.hpp"
+
+namespace plc {
+
+enum class IdentType{
+    ProcedureIdent,
+    ConstIdent,
+    VarIdent,
+};
+
+using ScopeId = uint32_t;
+using SymbolIndex = uint32_t;
+constexpr ScopeId no_scope = UINT32_MAX;
+constexpr SymbolIndex no_symbol_index = UINT32_MAX;
+
+struct SymbolInfo{
+    SymbolId name;
+    IdentType kind;
+    ScopeId scope;          // scope the symbol is declared in
+    uint32_t depth;         // procedure nesting level of that scope, 0 for the main program
+    uint32_t slot;          // VarIdent: frame slot in declaration order
+    int64_t value;          // ConstIdent: the constant
+    ScopeId body;           // ProcedureIdent: scope of the procedure body
+    SymbolIndex shadowed;   // binding of the same name hidden by this one
+    SymbolIndex origin = no_symbol_index;   // VarIdent made by the inliner: the callee's variable it stands for
+};
+
+struct ScopeInfo{
+    ScopeId parent;
+    uint32_t depth;
+    uint32_t vars;          // number of variable slots
+    SymbolIndex procedure;  // owning procedure, no_symbol_index for the main program
+};
+
+// Lexically scoped symbol table. Lookups go through a flat array indexed by
+// the interned SymbolId, which always points at the innermost visible
+// binding, so they cost one load no matter how deep the scope chain is.
+// Scopes and symbols are never discarded: popScope() only hides the
+// bindings, so later phases can still reach every declaration by index.
+class SymbolTable{
+    public:
+    SymbolTable() = default;
+
+    ScopeId pushScope(SymbolIndex procedure = no_symbol_index);
+    void popScope();
+    [[nodiscard]] Result<SymbolIndex> declare(SymbolId name, IdentType kind, int64_t value = 0);
+    [[nodiscard]] SymbolIndex lookup(SymbolId name) const;
+    void clear();
+
+    [[nodiscard]] const SymbolInfo& operator[](SymbolIndex n) const {return symbols[n];}
+    [[nodiscard]] const ScopeInfo& scope(ScopeId n) const {return scopes[n];}
+    [[nodiscard]] ScopeId current() const {return current_;}
+    [[nodiscard]] size_t size() const {return symbols.size();}
+
+    std::vector<SymbolInfo> symbols;
+    std::vector<ScopeInfo> scopes;
+
+    private:
+    std::vector<SymbolIndex> visible_;
+    std::vector<SymbolIndex> open_symbols_;
+    std::vector<size_t> open_marks_;
+    ScopeId current_ = no_scope;
+};
+
+}
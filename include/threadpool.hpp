@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <vector>
+
+namespace plc {
+
+// Fixed set of workers, each with its own task deque. A worker pops from the
+// back of its own deque and, when that is empty, steals from the front of the
+// others, so long and short jobs even out without a central queue.
+class ThreadPool{
+    public:
+    using Task = std::function<void(size_t worker)>;
+
+    // Stack reserved for each worker. The passes over the AST recurse once
+    // per nested block and statement, which the parser allows far deeper
+    // than the default stack of a thread holds; untouched pages cost nothing.
+    static constexpr size_t stack_size = size_t{256} << 20;
+
+    explicit ThreadPool(size_t threads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    // called from a worker the task lands in that worker's deque, otherwise round-robin
+    void submit(Task task);
+    // blocks until every submitted task has finished
+    void wait();
+    [[nodiscard]] size_t size() const {return threads_.size();}
+
+    private:
+    struct Queue{
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    struct Worker{
+        ThreadPool* pool;
+        size_t index;
+    };
+
+    static void* start(void* worker);
+    void run(size_t worker);
+    bool pop(size_t worker, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<Worker> workers_;
+    std::vector<pthread_t> threads_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    size_t queued_ = 0;
+    size_t pending_ = 0;
+    bool stop_ = false;
+    std::atomic<size_t> next_queue_{0};
+};
+
+}
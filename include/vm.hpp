@@ -0,0 +1,62 @@
+#pragma once
+
+#include "context.hpp"
+
+namespace plc {
+
+enum class VMOp : uint8_t{
+    Move, Add, Sub, Mul, Div,
+    Jump, JumpEq, JumpNe, JumpLt, JumpLe, JumpGt, JumpGe, JumpOdd,
+    Call, Ret, Halt,
+};
+
+// Operands are frame slots; literals get read-only slots of their own.
+// Jumps and calls keep their target pc in c, calls their procedure in a.
+struct VMInstruction{
+    VMOp op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+struct VMProcedure{
+    uint32_t locals_begin;      // range of local_slots_ saved across an activation
+    uint32_t locals_end;
+};
+
+// Runs ctx.code directly. Every variable, constant and temporary gets one
+// slot of a flat int64_t frame, found through the SymbolIndex, pool entry or
+// temp number of the operand. Calls save the callee's locals and returns
+// restore them, so recursion sees fresh variables and a nested procedure
+// always reaches the most recent activation of its parent. Dispatch is direct-threaded
+// through computed goto where the compiler supports it.
+class QuaternaryInterpreter{
+    public:
+    [[nodiscard]] Result<int> load(const CompilationContext& ctx);
+    // step_limit 0: unbounded; RuntimeError on division by zero, a call
+    // stack deeper than max_call_depth or running past step_limit
+    [[nodiscard]] Result<int> run(uint64_t step_limit = 0);
+
+    [[nodiscard]] uint64_t executed() const {return executed_;}
+    [[nodiscard]] int64_t value(SymbolIndex var) const;
+    [[nodiscard]] const std::vector<VMInstruction>& code() const {return code_;}
+
+    static constexpr size_t max_call_depth = 1 << 20;
+
+    private:
+    uint32_t slot(SymbolIndex sym);
+    uint32_t constant(int64_t v);
+    Result<uint32_t> operand(const CompilationContext& ctx, QuadOperand op);
+
+    std::vector<VMInstruction> code_;
+    std::vector<VMProcedure> procedures_;
+    std::vector<uint32_t> local_slots_;
+    std::vector<int64_t> initial_;          // frame contents before a run: constants, zero elsewhere
+    std::vector<int64_t> frame_;
+    std::vector<uint32_t> symbol_slot_;     // by SymbolIndex, UINT32_MAX: none yet
+    std::vector<uint32_t> temp_slot_;       // by temp number, UINT32_MAX: none yet
+    std::unordered_map<int64_t, uint32_t> constant_slot_;
+    uint64_t executed_ = 0;
+};
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "asm.hpp"
+
+namespace plc {
+
+struct MachineCode{
+    std::vector<uint8_t> bytes;
+    std::vector<std::pair<std::string, uint64_t>> symbols;  // section labels and their offsets
+};
+
+// Encodes the labels of a text section back to back. Jumps start out short
+// and are widened to rel32 until every displacement fits; calls are always
+// rel32. Fails on an operand form x86-64 has no encoding for.
+[[nodiscard]] Result<MachineCode> encodeX86(const std::vector<Label>& labels);
+
+}
@@ -0,0 +1,43 @@
+#include <cstdlib>
+#include <new>
+#include "../include/report.hpp"
+
+// Counting every allocation is what makes the per-phase numbers of
+// --time-report possible. This replaces operator new for the whole program,
+// so it is linked into plc only, never into plc_core. Over-aligned
+// allocations keep the library's own operators.
+
+void* operator new(std::size_t size){
+    plc::countAllocation(size);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size){
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept{
+    plc::countAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept{
+    std::free(p);
+}
@@ -6,109 +6,117 @@ namespace plc{
 
 Label::Label(const std::string& name):name(name){}
 
-Label::operator std::string() const{
-    std::string res = name + ":\n";
-    for (const auto& line : lines){
-        res += "\t" + line + "\n";
+void Label::print(std::ostream& os) const{
+    os << name << ":\n";
+    for (const Instruction& line : lines){
+        os << '\t';
+        line.print(os);
+        os << '\n';
     }
-    return res;
 }
 
 bool Label::operator==(const Label& other) const{
     return name == other.name;
 }
 
-template<>
-MacroConstant<int>::MacroConstant(const std::string& name, const int& value):name(name),value(value){}
-
-template<typename T>
-bool MacroConstant<T>::operator==(const std::string& other) const{
-    return name == other;
-}
-
 Section::Section(const std::string& name):name(name){}
 
-Section::operator std::string() const{
-    if (lines.empty() && labels.empty()) return "";
-    std::string res = "section " + name + "\n";
+void Section::print(std::ostream& os) const{
+    if (lines.empty() && labels.empty()) return;
+    os << "section " << name << '\n';
     for (const std::string& l:lines){
-        res += l + "\n";
-    }
-    for (const auto& label : labels){
-        res += static_cast<std::string>(label);
+        os << l << '\n';
     }
-    return res;
+    for (const auto& label : labels) label.print(os);
 }
 
-void Section::addLine(size_t label_ptr, const std::string& line){
+void Section::addLine(size_t label_ptr, Instruction line){
     if (label_ptr >= labels.size()) return;
-    labels[label_ptr].lines.emplace_back(line);
+    labels[label_ptr].lines.push_back(std::move(line));
 }
 
-void Section::addFreeScopeLine(const Scope& scope){
-    if (!scope.vars.empty()) {
-        size_t free_size = scope.vars.size();
-        if (scope.vars[0]=="ret") free_size-=1;
-        if (free_size) addLine(scope.label_ptr, "add rsp,"+std::to_string(8*free_size));
-    }
+void CodegenPlan::clear(){
+    procedure_labels.clear();
+    registers.clear();
+    jobs.clear();
+    job_of_node.clear();
+    ssa = SSAProgram();
+    allocations.clear();
 }
 
-Scope::Scope():father(nullptr),label_ptr(0){}
-
-Scope::Scope(Scope* father):father(father),label_ptr(father->label_ptr){}
-
-Scope::Scope(Scope* father, size_t label_ptr):father(father),label_ptr(label_ptr){}
-
-void Scope::addVar(const std::string& var){
-    vars.emplace_back(var);
+uint32_t linkSlots(FrameLinks links, uint32_t depth){
+    if (!depth) return 0;
+    return links == FrameLinks::Display ? depth : 1;
 }
 
-void Scope::addConst(const std::string& name, int value){
-    constants.emplace_back(name, value);
+void enterFrame(std::vector<Instruction>& out, FrameLinks links, uint32_t depth){
+    out.emplace_back(Opcode::Push, reg(Reg::rbp));
+    out.emplace_back(Opcode::Mov, reg(Reg::rbp), reg(Reg::rsp));
+    if (links == FrameLinks::Display){
+        // the parent's display, then the parent itself
+        for (uint32_t level = 0; level + 1 < depth; level++) out.emplace_back(Opcode::Push, mem(Reg::rax, -8*static_cast<int64_t>(level + 1)));
+    }
+    out.emplace_back(Opcode::Push, reg(Reg::rax));
 }
 
-Result<size_t> Scope::findVarPos(const std::string& var) const{
-    if (auto ptr = std::find(vars.begin(), vars.end(), var); ptr!= vars.end()){
-        size_t distance = std::distance(ptr, vars.end()) - 1;
-        return Ok(distance);
-    }else if (father){
-        Result<size_t> res = father->findVarPos(var);
-        if (res.isOk) return Ok(*res+vars.size());
-        else return res;
+void zeroVariables(std::vector<Instruction>& out, FrameLinks links, uint32_t depth, uint32_t vars, const std::vector<uint32_t>* slots){
+    if (slots ? slots->empty() : !vars) return;
+    int64_t first = linkSlots(links, depth);
+    out.emplace_back(Opcode::Xor, reg(Reg::rax), reg(Reg::rax));
+    if (slots){
+        for (uint32_t slot : *slots) out.emplace_back(Opcode::Mov, mem(Reg::rbp, -8*(first + slot + 1)), reg(Reg::rax));
+        return;
     }
-    return Error<size_t>(ErrorType::ValueNotFoundError);
+    for (uint32_t slot = 0; slot < vars; slot++) out.emplace_back(Opcode::Mov, mem(Reg::rbp, -8*(first + slot + 1)), reg(Reg::rax));
 }
 
-Result<std::string> Scope::findConst(const std::string& con) const{
-    if (auto ptr = std::find(constants.begin(), constants.end(), con); ptr!= constants.end()){
-        return Ok(std::to_string(ptr->value));
-    }else if (father){
-        Result<std::string> res = father->findConst(con);
-        if (res.isOk) return Ok(*res);
-        else return res;
+void loadFrame(std::vector<Instruction>& out, FrameLinks links, uint32_t depth, uint32_t level, Reg r){
+    if (links == FrameLinks::Display){
+        out.emplace_back(Opcode::Mov, reg(r), mem(Reg::rbp, -8*static_cast<int64_t>(level + 1)));
+        return;
     }
-    return Error<std::string>(ErrorType::ValueNotFoundError);
+    out.emplace_back(Opcode::Mov, reg(r), mem(Reg::rbp, -8));
+    for (uint32_t d = depth - 1; d > level; d--) out.emplace_back(Opcode::Mov, reg(r), mem(r, -8));
 }
 
-Result<std::string> Scope::findVar(const std::string& var) const{
-    Result<size_t> pos = findVarPos(var);
-    if (!pos.isOk) return Error<std::string>(pos);
-    if (*pos == 0) return Ok(std::string("[rsp]"));
-    return Ok("[rsp+" + std::to_string(*pos*8)+"]");
+void passFrame(std::vector<Instruction>& out, FrameLinks links, uint32_t depth, uint32_t level){
+    if (level == depth) out.emplace_back(Opcode::Mov, reg(Reg::rax), reg(Reg::rbp));
+    else loadFrame(out, links, depth, level, Reg::rax);
 }
 
-Result<std::string> Scope::findRValue(const std::string& val) const{
-    Result<std::string> res = findConst(val);
-    if (!res.isOk){
-        res = findVar(val);
-        if (!res.isOk){
-            char* p;
-            strtol(val.c_str(), &p, 10);
-            if (*p) return Error<std::string>(res);
-            return Ok(val);
-        }
-        return Ok(*res);
-    }return Ok(*res);
+int64_t frameOffset(const SymbolTable& table, SymbolIndex var, FrameLinks links, bool globals_base){
+    const SymbolInfo& sym = table[var];
+    if (sym.scope == 0 && globals_base) return 8*static_cast<int64_t>(sym.slot);
+    return -8*static_cast<int64_t>(linkSlots(links, sym.depth) + sym.slot + 1);
 }
 
+Scope::Scope(const SymbolTable& table, ScopeId id, size_t label_ptr, FrameLinks links, const RegisterAssignment* registers, Reg globals_base):
+    label_ptr(static_cast<int>(label_ptr)),id(id),depth(table.scope(id).depth),table(&table),registers(registers),globals_base(globals_base),links(links){}
+
+Result<Operand> Scope::findConst(SymbolIndex con) const{
+    const SymbolInfo& sym = (*table)[con];
+    if (sym.kind != IdentType::ConstIdent) return Error<Operand>(ErrorType::ValueNotFoundError);
+    return Ok(imm(sym.value));
+}
+
+Result<Operand> Scope::findVar(SymbolIndex var, std::vector<Instruction>& out, Reg scratch) const{
+    const SymbolInfo& sym = (*table)[var];
+    if (sym.kind != IdentType::VarIdent || sym.depth > depth) return Error<Operand>(ErrorType::ValueNotFoundError);
+    bool global = globals_base != Reg::none && sym.scope == 0;
+    if (registers && registers->inRegister(var) && sym.scope == id && !global){
+        return Ok(reg(registers->location(var)));
+    }
+    int64_t offset = frameOffset(*table, var, links, global);
+    if (sym.depth == depth) return Ok(mem(Reg::rbp, offset));
+    loadFrame(out, links, depth, sym.depth, scratch);
+    return Ok(mem(scratch, offset));
+}
+
+Result<Operand> Scope::findRValue(const AST& ast, NodeId val, std::vector<Instruction>& out, Reg scratch) const{
+    if (ast.kind(val) == NodeKind::Number) return Ok(imm(ast.number(val)));
+    if (ast.kind(val) != NodeKind::Ident) return Error<Operand>(ErrorType::ValueNotFoundError);
+    Result<Operand> res = findConst(ast.symbol(val));
+    if (!res.isOk) return findVar(ast.symbol(val), out, scratch);
+    return res;
+}
 }
\ No newline at end of file
@@ -1,140 +1,262 @@
-#include "../include/ast.hpp"
+#include "../include/context.hpp"
 
 namespace plc {
-size_t AST::temp_name = 0;
-std::vector<Quaternary> AST::code;
-std::map<std::string,size_t> AST::procedure_line;
 
-Quaternary::Quaternary(std::string cmd, std::string value1, std::string value2, std::string result):
-    cmd(std::move(cmd)),value1(std::move(value1)),value2(std::move(value2)),result(std::move(result)){}
+std::string_view kindName(NodeKind kind){
+    switch (kind){
+        case NodeKind::Program: return "Program";
+        case NodeKind::Block: return "Block";
+        case NodeKind::Const: return "Const";
+        case NodeKind::Var: return "Var";
+        case NodeKind::Procedure: return "Procedure";
+        case NodeKind::Sequence: return "Sequence";
+        case NodeKind::Assign: return "Assign";
+        case NodeKind::Call: return "Call";
+        case NodeKind::If: return "If";
+        case NodeKind::While: return "While";
+        case NodeKind::Condition: return "Condition";
+        case NodeKind::Calc: return "Calc";
+        case NodeKind::EmptyStatement: return "EmptyStatement";
+        case NodeKind::Ident: return "Ident";
+        case NodeKind::Number: return "Number";
+        case NodeKind::Operator: return "Operator";
+    }
+    return "Unknown";
+}
 
-Quaternary::operator std::string() const{
-    return std::string("(") + cmd + ", " + value1 + ", " + value2 + ", " + result + ")";
+AST::AST(Interner& interner) : interner(&interner) {}
+
+NodeId AST::addLeaf(NodeKind kind, uint32_t value){
+    nodes.push_back(ASTNode{kind, value, static_cast<uint32_t>(edges.size()), 0});
+    return static_cast<NodeId>(nodes.size() - 1);
 }
 
-std::string AST::getTempName(){
-    return "T" + std::to_string(temp_name++);
+NodeId AST::addIdent(SymbolIndex symbol){
+    return addLeaf(NodeKind::Ident, symbol);
 }
 
-AST::AST(std::string name) : name(std::move(name)) {}
-AST::AST(std::string name, AST child1) : name(std::move(name)) {
-    children.push_back(std::move(child1));
+NodeId AST::addNumber(int64_t number){
+    numbers.push_back(number);
+    return addLeaf(NodeKind::Number, static_cast<uint32_t>(numbers.size() - 1));
 }
-AST::AST(std::string name, AST child1, AST child2) : name(std::move(name)) {
-    children.push_back(std::move(child1));
-    children.push_back(std::move(child2));
+
+NodeId AST::addOperator(TokenKind op){
+    return addLeaf(NodeKind::Operator, static_cast<uint32_t>(op));
 }
-AST::AST(std::string name, AST child1, AST child2, AST child3) : name(std::move(name)) {
-    children.push_back(std::move(child1));
-    children.push_back(std::move(child2));
-    children.push_back(std::move(child3));
+
+NodeId AST::addNode(NodeKind kind, const NodeId* children, size_t count, uint32_t value){
+    auto first = static_cast<uint32_t>(edges.size());
+    edges.insert(edges.end(), children, children + count);
+    nodes.push_back(ASTNode{kind, value, first, static_cast<uint32_t>(count)});
+    return static_cast<NodeId>(nodes.size() - 1);
+}
+
+NodeId AST::addNode(NodeKind kind, std::initializer_list<NodeId> children, uint32_t value){
+    return addNode(kind, children.begin(), children.size(), value);
 }
 
-AST::AST(std::string name, std::vector<AST> children) : name(std::move(name)), children(std::move(children)) {}
+ChildRange AST::children(NodeId n) const{
+    const NodeId* begin = edges.data() + nodes[n].first;
+    return ChildRange{begin, begin + nodes[n].count};
+}
 
-void AST::addChild(AST child) {children.push_back(std::move(child));}
-void AST::addChild(std::string childname) {children.emplace_back(std::move(childname));}
+bool AST::isOperator(NodeId n, TokenKind op) const{
+    return nodes[n].kind == NodeKind::Operator && static_cast<TokenKind>(nodes[n].value) == op;
+}
 
-void AST::print(std::ofstream& log_file) const {
-    if (children.empty()) {
-        std::cout << name;
-        log_file << name;
-        return;
+std::string AST::name(NodeId n) const{
+    switch (nodes[n].kind){
+        case NodeKind::Ident: return std::string(interner->str(ident(n)));
+        case NodeKind::Number: return std::to_string(numbers[nodes[n].value]);
+        case NodeKind::Operator: return std::string(kindSpelling(op(n)));
+        default: return std::string(kindName(nodes[n].kind));
     }
-    std::cout << name << "(";
-    log_file << name << "(";
-    for (auto& child : children) {
-        child.print(log_file);
-        if (&child!= &children.back()){
-            std::cout << ", ";
-            log_file << ", ";
+}
+
+size_t AST::memoryUsage() const{
+    return nodes.capacity() * sizeof(ASTNode) + edges.capacity() * sizeof(NodeId) + numbers.capacity() * sizeof(int64_t)
+        + symbols.symbols.capacity() * sizeof(SymbolInfo) + symbols.scopes.capacity() * sizeof(ScopeInfo);
+}
+
+void AST::clear(){
+    root = no_node;
+    nodes.clear();
+    edges.clear();
+    numbers.clear();
+    symbols.clear();
+}
+
+void AST::print(std::ostream& os) const {
+    if (root != no_node) print(root, os);
+}
+
+void AST::print(NodeId n, std::ostream& os) const {
+    // each entry is a node and how many of its children are printed
+    std::vector<std::pair<NodeId, size_t>> stack{{n, 0}};
+    while (!stack.empty()) {
+        auto [node, printed] = stack.back();
+        ChildRange ch = children(node);
+        if (ch.empty()) {
+            os << name(node);
+            stack.pop_back();
+            continue;
+        }
+        if (printed == ch.size()) {
+            os << ")";
+            stack.pop_back();
+            continue;
         }
+        os << (printed ? ", " : std::string(kindName(nodes[node].kind)) + "(");
+        stack.back().second++;
+        stack.push_back({ch[printed], 0});
     }
-    std::cout << ")";
-    log_file << ")";
 }
 
-Result<size_t> AST::output(std::string log_file_name) const{
-    size_t n = 0;
-    std::ofstream log_file(std::move(log_file_name));
-    for (const Quaternary& q: code){
-        log_file<<(std::string)q<<std::endl;
-        n++;
-    }
-    return Ok(n);
+Result<QuadOperand> AST::getQuaternary(CompilationContext& ctx) const{
+    if (root == no_node) return Error<QuadOperand>(ErrorType::Empty);
+    return getQuaternary(root, ctx);
 }
 
-Result<std::string> AST::getQuaternary(){
-    if (name == "Var"){
-        for (auto& child : children) code.emplace_back(":=","_","_",child.name);
-    }else if (name == "Const"){
-        for (size_t i=0; i<children.size(); i+=2) {
-            code.emplace_back(":=",children[i+1].name,"_",children[i].name);
-        }
-    }else if (name == "Assign"){
-        for (size_t i=0; i<children.size(); i+=2) {
-            Result<std::string> res = children[i+1].getQuaternary();
+Result<QuadOperand> AST::getQuaternary(NodeId n, CompilationContext& ctx) const{
+    std::vector<Quaternary>& code = ctx.code;
+    const QuadOperand none;
+    ChildRange ch = children(n);
+    switch (nodes[n].kind){
+        case NodeKind::Var:
+            for (NodeId child : ch) code.push_back({QuadOp::Assign, none, none, QuadOperand::slot(symbol(child))});
+            break;
+        case NodeKind::Const:
+            for (size_t i=0; i<ch.size(); i+=2) {
+                code.push_back({QuadOp::Assign, ctx.constant(number(ch[i+1])), none, QuadOperand::slot(symbol(ch[i]))});
+            }
+            break;
+        case NodeKind::Assign:{
+            Result<QuadOperand> res = getQuaternary(ch[1], ctx);
             if (!res.isOk) return res;
-            code.emplace_back(":=",*res,"_",children[i].name);
+            code.push_back({QuadOp::Assign, *res, none, QuadOperand::slot(symbol(ch[0]))});
+            break;
         }
-    }else if (name == "Program" || name == "Block" || name == "Sequence"){
-        for (AST& child: children){
-            Result<std::string> res = child.getQuaternary();
-            if (!res.isOk) return res;
+        case NodeKind::Program:
+        case NodeKind::Block:
+        case NodeKind::Sequence:
+            for (NodeId child : ch){
+                Result<QuadOperand> res = getQuaternary(child, ctx);
+                if (!res.isOk) return res;
+            }
+            break;
+        case NodeKind::Procedure:{
+            size_t current_size = code.size();
+            code.push_back({QuadOp::Jump, none, none, none});
+            ctx.procedure_line[symbol(ch[0])] = code.size();
+            for (size_t i=1; i<ch.size(); i++){
+                Result<QuadOperand> res = getQuaternary(ch[i], ctx);
+                if (!res.isOk) return res;
+            }
+            code[current_size].result = QuadOperand::label(code.size());
+            ctx.procedure_end[symbol(ch[0])] = code.size();
+            break;
         }
-    }else if (name == "Procedure"){
-        size_t current_size = code.size();
-        code.emplace_back("j","_","_",std::to_string(-1));
-        procedure_line[children[0].name] = code.size();
-        for (AST& child: children){
-            Result<std::string> res = child.getQuaternary();
-            if (!res.isOk) return res;
+        case NodeKind::Call:{
+            size_t dest = ctx.procedure_line[symbol(ch[0])];
+            code.push_back({QuadOp::Jump, none, none, QuadOperand::label(dest)});
+            break;
         }
-        code[current_size].result = std::to_string(code.size());
-    }else if (name == "Call"){
-        size_t dest = procedure_line[children[0].name];
-        code.emplace_back("j","_","_",std::to_string(dest));
-
-    }else if (name == "If" || name == "While"){
-        if (children.size() != 2 || children[0].name != "Condition") return Error<std::string>(ErrorType::InvalidSyntax);
-        size_t current_size = code.size();
-        if (children[0].children.size() == 3){
-            Result<std::string> res1 = children[0].children[0].getQuaternary();
-            Result<std::string> res2 = children[0].children[2].getQuaternary();
-            if (!res1.isOk) return res1;
-            if (!res2.isOk) return res2;
-            code.emplace_back("j"+children[0].children[1].name,*res1,*res2,std::to_string(current_size+2));
-            code.emplace_back("j","_","_",std::to_string(current_size+3));
-            auto res = children[1].getQuaternary();
-            if (!res.isOk) return res;
-        }else if (children[0].children.size() == 2){
-            Result<std::string> res = children[0].children[1].getQuaternary();
-            if (!res.isOk) return res;
-            code.emplace_back("j"+children[0].children[0].name,*res,"_",std::to_string(current_size+2));
-            code.emplace_back("j","_","_",std::to_string(current_size+3));
-            res = children[1].getQuaternary();
+        case NodeKind::If:
+        case NodeKind::While:{
+            if (ch.size() != 2 || kind(ch[0]) != NodeKind::Condition) return Error<QuadOperand>(ErrorType::InvalidSyntax);
+            size_t loop_start = code.size();
+            ChildRange cond = children(ch[0]);
+            if (cond.size() == 3){
+                Result<QuadOperand> res1 = getQuaternary(cond[0], ctx);
+                if (!res1.isOk) return res1;
+                Result<QuadOperand> res2 = getQuaternary(cond[2], ctx);
+                if (!res2.isOk) return res2;
+                code.push_back({jumpOp(op(cond[1])), *res1, *res2, QuadOperand::label(code.size()+2)});
+            }else if (cond.size() == 2){
+                Result<QuadOperand> res = getQuaternary(cond[1], ctx);
+                if (!res.isOk) return res;
+                code.push_back({jumpOp(op(cond[0])), *res, none, QuadOperand::label(code.size()+2)});
+            }else return Error<QuadOperand>(ErrorType::InvalidSyntax);
+            size_t exit_jump = code.size();
+            code.push_back({QuadOp::Jump, none, none, none});
+            Result<QuadOperand> res = getQuaternary(ch[1], ctx);
             if (!res.isOk) return res;
+            if (nodes[n].kind == NodeKind::While){
+                code.push_back({QuadOp::Jump, none, none, QuadOperand::label(loop_start)});
+            }
+            code[exit_jump].result = QuadOperand::label(code.size());
+            break;
         }
-        code[current_size+1].result = std::to_string(code.size());
-        if (name == "while"){
-            code.emplace_back("j","_","_",std::to_string(current_size));
+        case NodeKind::Calc:
+            return calcQuaternary(n, ctx);
+        case NodeKind::Ident:
+            return Ok(QuadOperand::slot(symbol(n)));
+        case NodeKind::Number:
+            return Ok(ctx.constant(number(n)));
+        case NodeKind::Operator:
+            return Error<QuadOperand>(ErrorType::InvalidSyntax);
+        case NodeKind::Condition:
+        case NodeKind::EmptyStatement:
+            break;
+    }
+    return Ok(none);
+}
+
+// Parentheses nest without limit, so a Calc is walked with a stack of its
+// open operands instead of recursion. Each one gets its temp when it is
+// opened, in the order the recursive walk would give.
+Result<QuadOperand> AST::calcQuaternary(NodeId n, CompilationContext& ctx) const{
+    std::vector<Quaternary>& code = ctx.code;
+    const QuadOperand none;
+    struct Frame{
+        NodeId node;
+        size_t next;        // the child that gives the next operand
+        QuadOperand tmp;
+    };
+    std::vector<Frame> frames;
+    auto open = [&](NodeId calc) -> Result<int>{
+        ChildRange ch = children(calc);
+        if (ch.size() < 2) return Error<int>(ErrorType::InvalidSyntax);
+        Frame frame{calc, 0, ctx.newTemp()};
+        if (kind(ch[0]) == NodeKind::Operator){
+            // leading sign: evaluate as 0 +/- term
+            code.push_back({QuadOp::Assign, ctx.constant(0), none, frame.tmp});
+            frame.next = 1;
         }
-    }else if (name == "Calc"){
-        if (children.size() <3) return Error<std::string>(ErrorType::InvalidSyntax);
-        std::string tmp = getTempName();
-        code.emplace_back(":=",children[0].name,"_",tmp);
-        for (size_t i=1; i<children.size(); i+=2){
-            Result<std::string> res = children[i+1].getQuaternary();
+        frames.push_back(frame);
+        return Ok(0);
+    };
+    Result<int> opened = open(n);
+    if (!opened.isOk) return Error<QuadOperand>(opened);
+    while (true){
+        Frame& top = frames.back();
+        ChildRange ch = children(top.node);
+        QuadOperand value;
+        if (top.next >= ch.size()){
+            value = top.tmp;
+            frames.pop_back();
+            if (frames.empty()) return Ok(value);
+        }else{
+            NodeId operand = ch[top.next];
+            if (kind(operand) == NodeKind::Calc){
+                opened = open(operand);
+                if (!opened.isOk) return Error<QuadOperand>(opened);
+                continue;
+            }
+            Result<QuadOperand> res = getQuaternary(operand, ctx);
             if (!res.isOk) return res;
-            code.emplace_back(children[i].name,tmp,*res,tmp);
+            value = *res;
         }
-        return Ok(tmp);
+        Frame& into = frames.back();
+        ChildRange into_ch = children(into.node);
+        if (into.next == 0) code.push_back({QuadOp::Assign, value, none, into.tmp});
+        else code.push_back({arithmeticOp(op(into_ch[into.next - 1])), into.tmp, value, into.tmp});
+        into.next += 2;
     }
-    return Ok(name);
 }
 
-Result<std::pair<size_t, AST>> ErrorPair(ErrorType err){
-    return Result(std::make_pair(size_t{0}, AST("Error")), err);
+Result<std::pair<size_t, NodeId>> ErrorPair(ErrorType err){
+    return Result(std::make_pair(size_t{0}, no_node), err);
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,286 @@
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include "../include/cache.hpp"
+#include "../include/source.hpp"
+
+namespace plc {
+
+namespace {
+
+enum Section : uint32_t{
+    StringOffsets, StringBytes, Nodes, Edges, Numbers, Symbols, Scopes, Code, Constants, Procedures,
+    section_count,
+};
+
+struct FileSection{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct ProcedureRecord{
+    SymbolIndex symbol;
+    uint32_t line;
+    uint32_t end;
+};
+
+constexpr char magic[8] = {'P', 'L', 'C', 'I', 'R', 0, 0, 0};
+constexpr const char* extension = ".plcir";
+
+struct FileHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t sections;
+    uint64_t key;
+    uint64_t size;          // of the whole file
+    uint64_t checksum;      // of the header with this field zeroed, then the payload
+    uint32_t root;
+    uint32_t temp_name;
+    FileSection section[section_count];
+};
+
+constexpr size_t element_size[section_count] = {
+    sizeof(uint32_t), 1, sizeof(ASTNode), sizeof(NodeId), sizeof(int64_t),
+    sizeof(SymbolInfo), sizeof(ScopeInfo), sizeof(Quaternary), sizeof(int64_t), sizeof(ProcedureRecord),
+};
+
+template <class T>
+void appendSection(std::vector<uint8_t>& out, FileHeader& header, Section s, const T* data, size_t count){
+    while (out.size() % 8) out.push_back(0);
+    header.section[s] = FileSection{out.size(), count};
+    const auto* p = reinterpret_cast<const uint8_t*>(data);
+    out.insert(out.end(), p, p + count * sizeof(T));
+}
+
+template <class T>
+void readSection(std::string_view file, const FileHeader& header, Section s, std::vector<T>& out){
+    out.resize(header.section[s].count);
+    if (!out.empty()) std::memcpy(out.data(), file.data() + header.section[s].offset, out.size() * sizeof(T));
+}
+
+uint64_t checksum(FileHeader header, std::string_view file){
+    header.checksum = 0;
+    uint64_t h = hashBytes(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+    return hashBytes(file.substr(sizeof(FileHeader)), h);
+}
+
+bool validOperand(QuadOperand op, size_t symbols, size_t constants, size_t temps, size_t code){
+    switch (op.kind()){
+        case QuadOperandKind::Temp: return op.index() < temps;
+        case QuadOperandKind::Slot: return op.index() < symbols;
+        case QuadOperandKind::Constant: return op.index() < constants;
+        case QuadOperandKind::Label: return op.index() <= code;
+        default: return true;
+    }
+}
+
+}
+
+uint64_t hashBytes(std::string_view bytes, uint64_t seed){
+    uint64_t h = seed;
+    for (char c : bytes){
+        h ^= static_cast<uint8_t>(c);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+IRCache::IRCache(std::string dir, uint64_t max_bytes):dir_(std::move(dir)),max_bytes_(max_bytes){}
+
+uint64_t IRCache::key(std::string_view source, std::string_view options){
+    uint64_t h = hashBytes(options, hashBytes(source));
+    return hashBytes(std::string_view(reinterpret_cast<const char*>(&version), sizeof(version)), h);
+}
+
+std::string IRCache::path(uint64_t key) const{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(dir_) / (std::string(name) + extension)).string();
+}
+
+Result<size_t> IRCache::load(uint64_t key, CompilationContext& ctx) const{
+    namespace fs = std::filesystem;
+    std::string file_path = path(key);
+    std::error_code ec;
+    if (!fs::is_regular_file(file_path, ec)) return Error<size_t>(ErrorType::ValueNotFoundError);
+    Result<std::shared_ptr<const SourceBuffer>> mapped = SourceBuffer::fromFile(file_path);
+    if (!mapped.isOk) return Error<size_t>(ErrorType::ValueNotFoundError);
+    std::string_view file = mapped.unwrap()->view();
+
+    auto damaged = [&](){
+        ctx.reset();
+        fs::remove(file_path, ec);
+        return Error<size_t>(ErrorType::IOError);
+    };
+    FileHeader header;
+    if (file.size() < sizeof(header)) return damaged();
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.sections != section_count
+        || header.key != key || header.size != file.size()){
+        return damaged();
+    }
+    for (uint32_t s = 0; s < section_count; s++){
+        const FileSection& section = header.section[s];
+        if (section.offset < sizeof(header) || section.offset > file.size()
+            || section.count > (file.size() - section.offset) / element_size[s]){
+            return damaged();
+        }
+    }
+    if (checksum(header, file) != header.checksum) return damaged();
+
+    std::vector<uint32_t> offsets;
+    std::vector<ProcedureRecord> procedures;
+    readSection(file, header, StringOffsets, offsets);
+    std::string_view bytes = file.substr(header.section[StringBytes].offset, header.section[StringBytes].count);
+    AST& ast = ctx.ast;
+    readSection(file, header, Nodes, ast.nodes);
+    readSection(file, header, Edges, ast.edges);
+    readSection(file, header, Numbers, ast.numbers);
+    readSection(file, header, Symbols, ast.symbols.symbols);
+    readSection(file, header, Scopes, ast.symbols.scopes);
+    readSection(file, header, Code, ctx.code);
+    readSection(file, header, Constants, ctx.constants);
+    readSection(file, header, Procedures, procedures);
+    ast.root = header.root;
+    ctx.temp_name = header.temp_name;
+
+    // the checksum only proves the bytes are the ones written; indices are
+    // still checked so that no entry can make a later phase read out of bounds
+    if (offsets.empty() || offsets.back() != bytes.size()) return damaged();
+    size_t strings = offsets.size() - 1;
+    for (size_t i = 0; i < strings; i++){
+        if (offsets[i] > offsets[i + 1]) return damaged();
+        if (ctx.interner.intern(bytes.substr(offsets[i], offsets[i + 1] - offsets[i])) != i) return damaged();
+    }
+    size_t nodes = ast.nodes.size(), symbols = ast.symbols.symbols.size(), scopes = ast.symbols.scopes.size();
+    if (ast.root != no_node && ast.root >= nodes) return damaged();
+    for (const ASTNode& node : ast.nodes){
+        if (node.first > ast.edges.size() || node.count > ast.edges.size() - node.first) return damaged();
+        if (node.kind == NodeKind::Ident && node.value >= symbols) return damaged();
+        if (node.kind == NodeKind::Number && node.value >= ast.numbers.size()) return damaged();
+        if (node.kind == NodeKind::Procedure && node.value >= symbols) return damaged();
+        if (node.kind == NodeKind::Block && node.value >= scopes) return damaged();
+    }
+    for (NodeId edge : ast.edges) if (edge >= nodes) return damaged();
+    for (const SymbolInfo& sym : ast.symbols.symbols){
+        if (sym.name >= strings || sym.scope >= scopes) return damaged();
+        if (sym.kind == IdentType::ProcedureIdent && sym.body >= scopes) return damaged();
+    }
+    for (const ScopeInfo& scope : ast.symbols.scopes){
+        if (scope.parent != no_scope && scope.parent >= scopes) return damaged();
+    }
+    size_t code = ctx.code.size(), constants = ctx.constants.size();
+    for (const Quaternary& q : ctx.code){
+        if (!validOperand(q.a, symbols, constants, ctx.temp_name, code) || !validOperand(q.b, symbols, constants, ctx.temp_name, code)
+            || !validOperand(q.result, symbols, constants, ctx.temp_name, code)){
+            return damaged();
+        }
+    }
+    for (const ProcedureRecord& p : procedures){
+        if (p.symbol >= symbols || p.line > p.end || p.end > code) return damaged();
+        ctx.procedure_line[p.symbol] = p.line;
+        ctx.procedure_end[p.symbol] = p.end;
+    }
+    for (size_t i = 0; i < constants; i++) ctx.constant_index.emplace(ctx.constants[i], static_cast<uint32_t>(i));
+
+    // a hit makes the entry the most recently used one
+    fs::last_write_time(file_path, fs::file_time_type::clock::now(), ec);
+    return Ok(file.size());
+}
+
+Result<size_t> IRCache::store(uint64_t key, const CompilationContext& ctx) const{
+    namespace fs = std::filesystem;
+    const AST& ast = ctx.ast;
+    std::vector<uint32_t> offsets;
+    std::string bytes;
+    for (SymbolId id = 0; id < ctx.interner.size(); id++){
+        offsets.push_back(static_cast<uint32_t>(bytes.size()));
+        bytes += ctx.interner.str(id);
+    }
+    offsets.push_back(static_cast<uint32_t>(bytes.size()));
+    std::vector<ProcedureRecord> procedures;
+    for (const auto& [sym, line] : ctx.procedure_line){
+        auto end = ctx.procedure_end.find(sym);
+        size_t last = end == ctx.procedure_end.end() ? line : end->second;
+        procedures.push_back(ProcedureRecord{sym, static_cast<uint32_t>(line), static_cast<uint32_t>(last)});
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.sections = section_count;
+    header.key = key;
+    header.root = ast.root;
+    header.temp_name = ctx.temp_name;
+    std::vector<uint8_t> out(sizeof(header), 0);
+    appendSection(out, header, StringOffsets, offsets.data(), offsets.size());
+    appendSection(out, header, StringBytes, bytes.data(), bytes.size());
+    appendSection(out, header, Nodes, ast.nodes.data(), ast.nodes.size());
+    appendSection(out, header, Edges, ast.edges.data(), ast.edges.size());
+    appendSection(out, header, Numbers, ast.numbers.data(), ast.numbers.size());
+    appendSection(out, header, Symbols, ast.symbols.symbols.data(), ast.symbols.symbols.size());
+    appendSection(out, header, Scopes, ast.symbols.scopes.data(), ast.symbols.scopes.size());
+    appendSection(out, header, Code, ctx.code.data(), ctx.code.size());
+    appendSection(out, header, Constants, ctx.constants.data(), ctx.constants.size());
+    appendSection(out, header, Procedures, procedures.data(), procedures.size());
+    header.size = out.size();
+    std::memcpy(out.data(), &header, sizeof(header));
+    header.checksum = checksum(header, std::string_view(reinterpret_cast<const char*>(out.data()), out.size()));
+    std::memcpy(out.data(), &header, sizeof(header));
+
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    std::string final_path = path(key);
+    std::string temp_path = final_path + ".tmp." + std::to_string(getpid()) + "."
+        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream f(temp_path, std::ios::binary | std::ios::trunc);
+        if (!f || !f.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()))){
+            fs::remove(temp_path, ec);
+            return Error<size_t>(ErrorType::IOError);
+        }
+    }
+    fs::rename(temp_path, final_path, ec);
+    if (ec){
+        fs::remove(temp_path, ec);
+        return Error<size_t>(ErrorType::IOError);
+    }
+    evict();
+    return Ok(out.size());
+}
+
+size_t IRCache::evict() const{
+    namespace fs = std::filesystem;
+    struct Entry{
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type used;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)){
+        std::error_code entry_ec;
+        if (it->path().extension() != extension || !it->is_regular_file(entry_ec)) continue;
+        Entry entry{it->path(), it->file_size(entry_ec), it->last_write_time(entry_ec)};
+        if (entry_ec) continue;
+        total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    if (total <= max_bytes_) return 0;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){return a.used < b.used;});
+    size_t removed = 0;
+    for (const Entry& entry : entries){
+        if (total <= max_bytes_) break;
+        // another compiler may have removed it first
+        if (fs::remove(entry.path, ec)) removed++;
+        total -= entry.size;
+    }
+    return removed;
+}
+
+}
@@ -0,0 +1,53 @@
+#include "../include/context.hpp"
+
+namespace plc {
+
+CompilationContext::CompilationContext():ast(interner){}
+
+void CompilationContext::reset(){
+    interner.clear();
+    ast.clear();
+    code.clear();
+    constants.clear();
+    constant_index.clear();
+    temp_name = 0;
+    procedure_line.clear();
+    procedure_end.clear();
+}
+
+Result<size_t> CompilationContext::output(std::string log_file_name) const{
+    size_t n = 0;
+    std::ofstream log_file(std::move(log_file_name));
+    if (!log_file) return Error<size_t>(ErrorType::IOError);
+    for (const Quaternary& q: code){
+        log_file<<format(q)<<std::endl;
+        n++;
+    }
+    return Ok(n);
+}
+
+QuadOperand CompilationContext::newTemp(){
+    return QuadOperand::temp(temp_name++);
+}
+
+QuadOperand CompilationContext::constant(int64_t v){
+    auto [it, inserted] = constant_index.emplace(v, static_cast<uint32_t>(constants.size()));
+    if (inserted) constants.push_back(v);
+    return QuadOperand(QuadOperandKind::Constant, it->second);
+}
+
+std::string CompilationContext::format(QuadOperand op) const{
+    switch (op.kind()){
+        case QuadOperandKind::Slot: return std::string(interner.str(ast.symbols[op.index()].name));
+        case QuadOperandKind::Constant: return std::to_string(constantValue(op));
+        case QuadOperandKind::Temp: return "T" + std::to_string(op.index());
+        case QuadOperandKind::Label: return std::to_string(op.index());
+        default: return "_";
+    }
+}
+
+std::string CompilationContext::format(const Quaternary& q) const{
+    return "(" + quadSpelling(q.op) + ", " + format(q.a) + ", " + format(q.b) + ", " + format(q.result) + ")";
+}
+
+}
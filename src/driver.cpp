@@ -0,0 +1,323 @@
+#include <chrono>
+#include <functional>
+#include "../include/driver.hpp"
+#include "../include/threadpool.hpp"
+
+namespace plc {
+
+void printUsage(std::ostream& os){
+    os << "usage: plc [options] file.pl0...\n"
+       << "  -j N            compile N files in parallel (default: hardware threads)\n"
+       << "  -o DIR          write outputs to DIR instead of next to each input\n"
+       << "  -O0             disable the optimization passes\n"
+       << "  -O              also keep variables in registers\n"
+       << "  --inline N      inline procedures of up to N AST nodes at every call (default 40, 0: none)\n"
+       << "  -S              stop after writing the .asm\n"
+       << "  -c              write a relocatable <stem>.o instead of an executable\n"
+       << "  --nasm          build through the .asm with nasm and ld instead of directly\n"
+       << "  --ssa           generate code through the SSA form with its own passes\n"
+       << "  --static-link   reach outer procedures' variables through static links, not a display\n"
+       << "  --jit           run each program in-process and print its variables\n"
+       << "  --run           like --jit, but interpret the quadruples instead\n"
+       << "  --ir            also write <stem>.ir.txt with the quadruples (and <stem>.ssa.txt)\n"
+       << "  --log           also write <stem>.log.txt with the parser log\n"
+       << "  --dump-ast      print the AST of each unit\n"
+       << "  --stats         print what the optimizer removed and allocated per unit\n"
+       << "  --time-report   print the time and allocations of every phase, =json for JSON on stdout\n"
+       << "  --cache DIR     reuse the optimized IR of unchanged sources from DIR\n"
+       << "  --cache-size MB evict least recently used cache entries beyond MB (default 64)\n"
+       << "  --regex-lexer   use the reference regex lexer\n";
+}
+
+Result<DriverOptions> parseArguments(int argc, char** argv, std::ostream& err){
+    DriverOptions options;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "-j" || arg == "-o" || arg == "--cache" || arg == "--cache-size" || arg == "--inline"){
+            if (i + 1 >= argc){
+                err << "plc: missing value after " << arg << "\n";
+                return Error<DriverOptions>(ErrorType::InvalidSyntax);
+            }
+            std::string value = argv[++i];
+            if (arg == "-o"){
+                options.output_dir = value;
+                continue;
+            }
+            if (arg == "--cache"){
+                options.cache_dir = value;
+                continue;
+            }
+            char* end;
+            long number = strtol(value.c_str(), &end, 10);
+            if (*end || number < 0 || (number == 0 && arg != "--inline")){
+                const char* what = arg == "-j" ? "job count" : arg == "--inline" ? "inline budget" : "cache size";
+                err << "plc: invalid " << what << " '" << value << "'\n";
+                return Error<DriverOptions>(ErrorType::InvalidSyntax);
+            }
+            if (arg == "-j") options.jobs = static_cast<size_t>(number);
+            else if (arg == "--inline") options.inline_budget = static_cast<size_t>(number);
+            else options.cache_max_bytes = static_cast<uint64_t>(number) << 20;
+        }else if (arg.size() > 2 && arg.compare(0, 2, "-j") == 0 && std::isdigit(static_cast<unsigned char>(arg[2]))){
+            options.jobs = std::max(1l, strtol(arg.c_str() + 2, nullptr, 10));
+        }else if (arg == "-O0") options.opt_level = 0;
+        else if (arg == "-O" || arg == "-O2") options.opt_level = 2;
+        else if (arg == "-S") options.assemble = false;
+        else if (arg == "-c") options.link = false;
+        else if (arg == "--nasm") options.use_nasm = true;
+        else if (arg == "--ssa") options.ssa = true;
+        else if (arg == "--static-link") options.frame_links = FrameLinks::StaticLink;
+        else if (arg == "--jit") options.jit = true;
+        else if (arg == "--run") options.interpret = true;
+        else if (arg == "--ir") options.emit_ir = true;
+        else if (arg == "--log") options.emit_log = true;
+        else if (arg == "--dump-ast") options.dump_ast = true;
+        else if (arg == "--stats") options.stats = true;
+        else if (arg == "--time-report") options.time_report = TimeReportFormat::Text;
+        else if (arg == "--time-report=json") options.time_report = TimeReportFormat::JSON;
+        else if (arg == "--regex-lexer") options.lexer = LexerMode::Regex;
+        else if (arg == "-h" || arg == "--help"){
+            printUsage(err);
+            return Error<DriverOptions>(ErrorType::Empty);
+        }else if (!arg.empty() && arg[0] == '-'){
+            err << "plc: unknown option " << arg << "\n";
+            return Error<DriverOptions>(ErrorType::InvalidSyntax);
+        }else options.inputs.push_back(arg);
+    }
+    if (options.inputs.empty()){
+        printUsage(err);
+        return Error<DriverOptions>(ErrorType::Empty);
+    }
+    // threads left over after one per file go to codegen within each file
+    options.codegen_jobs = std::max<size_t>(1, options.jobs / options.inputs.size());
+    return Ok(options);
+}
+
+namespace {
+
+// "input: x=1 y=2" for the main program's variables
+void writeGlobals(std::ostream& os, const std::string& input, const CompilationContext& ctx, const std::function<int64_t(SymbolIndex)>& value){
+    os << input << ":";
+    const SymbolTable& symbols = ctx.ast.symbols;
+    for (SymbolIndex n = 0; n < symbols.size(); n++){
+        const SymbolInfo& sym = symbols[n];
+        if (sym.kind != IdentType::VarIdent || sym.scope != 0 || sym.origin != no_symbol_index) continue;
+        os << " " << ctx.interner.str(sym.name) << "=" << value(n);
+    }
+}
+
+}
+
+UnitResult compileUnit(const std::string& input, const DriverOptions& options, CompilationContext& ctx){
+    UnitResult result;
+    std::ostringstream diag;
+    std::ostream null_stream(nullptr);
+    ctx.reset();
+    TimeReport* report = options.time_report != TimeReportFormat::None ? &result.report : nullptr;
+    ctx.report = report;
+    if (report) report->files++;
+    ctx.diagnostics = &diag;
+    ctx.out = options.dump_ast ? static_cast<std::ostream*>(&diag) : &null_stream;
+
+    namespace fs = std::filesystem;
+    fs::path in(input);
+    fs::path dir = options.output_dir.empty() ? in.parent_path() : fs::path(options.output_dir);
+    std::string base = (dir / in.stem()).string();
+
+    auto fail = [&](const std::string& phase, ErrorType err){
+        diag << input << ": " << phase << " failed: " << static_cast<std::string>(Result<int>(err)) << "\n";
+        result.diagnostics = diag.str();
+        return result;
+    };
+
+    Result<std::shared_ptr<const SourceBuffer>> source = SourceBuffer::fromFile(input);
+    if (!source.isOk) return fail("lexing", source.unwrapErr());
+    std::string_view text = source.unwrap()->view();
+    result.bytes = text.size();
+
+    // the parser log and the AST dump need the front end to run
+    bool cached = !options.cache_dir.empty() && !options.emit_log && !options.dump_ast;
+    IRCache cache(options.cache_dir, options.cache_max_bytes);
+    uint64_t key = cached ? IRCache::key(text, "O" + std::to_string(options.opt_level) + " inline " + std::to_string(options.inline_budget)) : 0;
+    bool hit = false;
+    InlineStats inlined;
+    if (cached){
+        ScopedTimer timer(report, Phase::Cache);
+        hit = cache.load(key, ctx).isOk;
+    }
+    if (!hit){
+        KeyWordInterpreter lexer(options.lexer, ctx.interner);
+        Result<TokenList> tokens = Error<TokenList>(ErrorType::Empty);
+        {
+            ScopedTimer timer(report, Phase::Lex);
+            tokens = lexer.interpretSource(source.unwrap());
+        }
+        if (!tokens.isOk) return fail("lexing", tokens.unwrapErr());
+        if (report) report->tokens += tokens->tokens.size();
+
+        Result<std::pair<size_t,NodeId>> program = ErrorPair(ErrorType::Empty);
+        {
+            ScopedTimer timer(report, Phase::Parse);
+            program = options.emit_log
+                ? GrammarInterpreter(tokens->tokens, ctx, base + ".log.txt").interpretProgram(0)
+                : GrammarInterpreter(tokens->tokens, ctx).interpretProgram(0);
+        }
+        if (!program.isOk) return fail("parsing", program.unwrapErr());
+        if (options.dump_ast) diag << "\n";
+
+        if (options.opt_level > 0){
+            ScopedTimer timer(report, Phase::Inline);
+            inlined = inlineProcedures(ctx.ast, options.inline_budget);
+        }
+        if (options.opt_level > 0){
+            ScopedTimer timer(report, Phase::FoldAST);
+            foldConstants(ctx.ast);
+        }
+
+        Result<QuadOperand> ir = Error<QuadOperand>(ErrorType::Empty);
+        {
+            ScopedTimer timer(report, Phase::IR);
+            ir = ctx.ast.getQuaternary(ctx);
+        }
+        if (!ir.isOk) return fail("IR generation", ir.unwrapErr());
+        if (options.opt_level > 0){
+            ScopedTimer timer(report, Phase::FoldIR);
+            foldConstants(ctx);
+        }
+        // a cache that cannot be written only costs the next build time
+        if (cached){
+            ScopedTimer timer(report, Phase::Cache);
+            (void)cache.store(key, ctx);
+        }
+    }
+    if (report){
+        report->nodes += ctx.ast.size();
+        report->quadruples += ctx.code.size();
+    }
+    if (cached && options.stats) diag << input << ": IR cache " << (hit ? "hit" : "miss") << "\n";
+    if (options.emit_ir){
+        ScopedTimer timer(report, Phase::Output);
+        Result<size_t> written = ctx.output(base + ".ir.txt");
+        if (!written.isOk) return fail("writing IR", written.unwrapErr());
+    }
+
+    if (options.interpret){
+        QuaternaryInterpreter vm;
+        Result<int> res = vm.load(ctx);
+        if (!res.isOk) return fail("loading IR", res.unwrapErr());
+        {
+            ScopedTimer timer(report, Phase::Run);
+            res = vm.run();
+        }
+        if (!res.isOk) return fail("running", res.unwrapErr());
+        writeGlobals(diag, input, ctx, [&](SymbolIndex var){return vm.value(var);});
+        diag << " (" << vm.executed() << " quadruples)\n";
+        result.ok = true;
+        result.diagnostics = diag.str();
+        return result;
+    }
+
+    CodegenOptions codegen;
+    codegen.threads = options.codegen_jobs;
+    codegen.allocate_registers = options.opt_level >= 2;
+    codegen.peephole = options.opt_level > 0;
+    codegen.strength_reduce = options.opt_level > 0;
+    codegen.ssa = options.ssa;
+    codegen.ssa_passes = options.ssa && options.opt_level > 0;
+    codegen.frame_links = options.frame_links;
+    NASMLinuxELF64 compiler(codegen);
+    JITLinuxX64 jit(codegen);
+    if (options.jit){
+        Result<int> res = jit.load(ctx);
+        if (!res.isOk) return fail("code generation", res.unwrapErr());
+        {
+            ScopedTimer timer(report, Phase::Run);
+            res = jit.run();
+        }
+        if (!res.isOk) return fail("running", res.unwrapErr());
+        writeGlobals(diag, input, ctx, [&](SymbolIndex var){return jit.globals()[ctx.ast.symbols[var].slot];});
+        diag << "\n";
+    }else if (options.assemble && options.use_nasm){
+        Result<int> res = compiler.compile(ctx, base + ".asm", base + ".o", options.link ? base : "");
+        if (!res.isOk) return fail("code generation", res.unwrapErr());
+    }else if (options.assemble){
+        Result<int> res = options.link
+            ? compiler.emitELF(ctx, base, ElfType::Executable)
+            : compiler.emitELF(ctx, base + ".o", ElfType::Relocatable);
+        if (!res.isOk) return fail("code generation", res.unwrapErr());
+    }else{
+        std::ofstream f(base + ".asm");
+        if (!f) return fail("writing asm", ErrorType::IOError);
+        Result<int> res = compiler.write(ctx, f);
+        if (!res.isOk) return fail("code generation", res.unwrapErr());
+    }
+    const NASMLinuxELF64& backend = options.jit ? jit.backend() : compiler;
+    if (options.emit_ir && options.ssa){
+        ScopedTimer timer(report, Phase::Output);
+        std::ofstream f(base + ".ssa.txt");
+        if (!f) return fail("writing SSA", ErrorType::IOError);
+        backend.ssaProgram().print(f, ctx.ast);
+    }
+    if (options.stats){
+        const PeepholeStats& peephole = backend.peepholeStats();
+        diag << input << ": ";
+        // a cache hit did not run the front end passes
+        if (!hit) diag << "inlined " << inlined.inlined << " calls, removed " << inlined.removed << " procedures; ";
+        diag << "peephole removed " << peephole.removed << ", rewrote " << peephole.rewritten;
+        if (codegen.ssa_passes){
+            const SSAStats& ssa = backend.ssaStats();
+            diag << "; SSA removed " << ssa.values << " values, " << ssa.stores << " stores, " << ssa.blocks << " blocks"
+                 << ", hoisted " << ssa.hoisted << ", " << ssa.inductions << " induction variables";
+        }
+        if (codegen.allocate_registers || codegen.ssa){
+            const RegisterAssignment& registers = backend.registers();
+            diag << "; registers allocated " << registers.allocated << ", spilled " << registers.spilled;
+        }
+        diag << "\n";
+    }
+    result.ok = true;
+    result.diagnostics = diag.str();
+    return result;
+}
+
+BatchStats compileBatch(const DriverOptions& options, std::ostream& diagnostics){
+    BatchStats stats;
+    stats.files = options.inputs.size();
+    std::vector<UnitResult> results(stats.files);
+    std::vector<char> done(stats.files, 0);
+    size_t next_to_print = 0;
+    std::mutex print_mutex;
+
+    size_t workers = std::max<size_t>(1, std::min(options.jobs, stats.files));
+    std::vector<std::unique_ptr<CompilationContext>> contexts;
+    for (size_t i = 0; i < workers; i++) contexts.push_back(std::make_unique<CompilationContext>());
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(workers);
+        for (size_t i = 0; i < stats.files; i++){
+            pool.submit([&, i](size_t worker){
+                UnitResult res = compileUnit(options.inputs[i], options, *contexts[worker]);
+                std::lock_guard<std::mutex> lock(print_mutex);
+                stats.report += res.report;
+                results[i] = std::move(res);
+                done[i] = 1;
+                // flush every unit whose predecessors are all finished
+                while (next_to_print < stats.files && done[next_to_print]){
+                    diagnostics << results[next_to_print].diagnostics;
+                    results[next_to_print].diagnostics.clear();
+                    next_to_print++;
+                }
+            });
+        }
+        pool.wait();
+    }
+    diagnostics.flush();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const UnitResult& r : results){
+        stats.bytes += r.bytes;
+        if (!r.ok) stats.failed++;
+    }
+    return stats;
+}
+
+}
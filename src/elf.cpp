@@ -0,0 +1,159 @@
+#include <elf.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "../include/elf.hpp"
+
+namespace plc {
+
+namespace {
+
+template <class T>
+void append(std::vector<uint8_t>& out, const T& value){
+    const auto* p = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+void align(std::vector<uint8_t>& out, size_t alignment){
+    while (out.size() % alignment) out.push_back(0);
+}
+
+uint32_t addString(std::string& table, const std::string& s){
+    uint32_t pos = static_cast<uint32_t>(table.size());
+    table += s;
+    table += '\0';
+    return pos;
+}
+
+}
+
+Result<size_t> writeELF(const std::string& path, const MachineCode& code, ElfType type){
+    bool executable = type == ElfType::Executable;
+    // section indices: null, .text, .symtab, .strtab, .shstrtab
+    std::string shstrtab(1, '\0');
+    uint32_t text_name = addString(shstrtab, ".text");
+    uint32_t symtab_name = addString(shstrtab, ".symtab");
+    uint32_t strtab_name = addString(shstrtab, ".strtab");
+    uint32_t shstrtab_name = addString(shstrtab, ".shstrtab");
+
+    std::vector<uint8_t> out(sizeof(Elf64_Ehdr) + (executable ? sizeof(Elf64_Phdr) : 0), 0);
+    align(out, 16);
+    uint64_t text_offset = out.size();
+    uint64_t text_address = executable ? elf_base_address + text_offset : 0;
+    out.insert(out.end(), code.bytes.begin(), code.bytes.end());
+    uint64_t text_end = out.size();
+
+    // locals first, the symtab's sh_info is the index of the first global
+    std::string strtab(1, '\0');
+    std::vector<Elf64_Sym> symbols(1, Elf64_Sym{});
+    const std::pair<std::string, uint64_t>* entry = nullptr;
+    for (const auto& symbol : code.symbols){
+        if (symbol.first == "_start"){
+            entry = &symbol;
+            continue;
+        }
+        Elf64_Sym sym{};
+        sym.st_name = addString(strtab, symbol.first);
+        sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_NOTYPE);
+        sym.st_shndx = 1;
+        sym.st_value = text_address + symbol.second;
+        symbols.push_back(sym);
+    }
+    uint32_t first_global = static_cast<uint32_t>(symbols.size());
+    if (entry){
+        Elf64_Sym sym{};
+        sym.st_name = addString(strtab, entry->first);
+        sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+        sym.st_shndx = 1;
+        sym.st_value = text_address + entry->second;
+        symbols.push_back(sym);
+    }else if (executable) return Error<size_t>(ErrorType::SymbolLookupError);
+
+    align(out, 8);
+    uint64_t symtab_offset = out.size();
+    for (const Elf64_Sym& sym : symbols) append(out, sym);
+    uint64_t strtab_offset = out.size();
+    out.insert(out.end(), strtab.begin(), strtab.end());
+    uint64_t shstrtab_offset = out.size();
+    out.insert(out.end(), shstrtab.begin(), shstrtab.end());
+
+    align(out, 8);
+    uint64_t sections_offset = out.size();
+    std::vector<Elf64_Shdr> sections(5, Elf64_Shdr{});
+    sections[1].sh_name = text_name;
+    sections[1].sh_type = SHT_PROGBITS;
+    sections[1].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    sections[1].sh_addr = text_address;
+    sections[1].sh_offset = text_offset;
+    sections[1].sh_size = code.bytes.size();
+    sections[1].sh_addralign = 16;
+    sections[2].sh_name = symtab_name;
+    sections[2].sh_type = SHT_SYMTAB;
+    sections[2].sh_offset = symtab_offset;
+    sections[2].sh_size = symbols.size() * sizeof(Elf64_Sym);
+    sections[2].sh_link = 3;
+    sections[2].sh_info = first_global;
+    sections[2].sh_addralign = 8;
+    sections[2].sh_entsize = sizeof(Elf64_Sym);
+    sections[3].sh_name = strtab_name;
+    sections[3].sh_type = SHT_STRTAB;
+    sections[3].sh_offset = strtab_offset;
+    sections[3].sh_size = strtab.size();
+    sections[3].sh_addralign = 1;
+    sections[4].sh_name = shstrtab_name;
+    sections[4].sh_type = SHT_STRTAB;
+    sections[4].sh_offset = shstrtab_offset;
+    sections[4].sh_size = shstrtab.size();
+    sections[4].sh_addralign = 1;
+    for (const Elf64_Shdr& section : sections) append(out, section);
+
+    Elf64_Ehdr header{};
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = executable ? ET_EXEC : ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_entry = executable ? text_address + entry->second : 0;
+    header.e_phoff = executable ? sizeof(Elf64_Ehdr) : 0;
+    header.e_shoff = sections_offset;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = executable ? sizeof(Elf64_Phdr) : 0;
+    header.e_phnum = executable ? 1 : 0;
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = static_cast<Elf64_Half>(sections.size());
+    header.e_shstrndx = 4;
+    std::memcpy(out.data(), &header, sizeof(header));
+
+    if (executable){
+        // one read+execute segment covering the headers and the code; the
+        // program keeps all of its data on the stack
+        Elf64_Phdr segment{};
+        segment.p_type = PT_LOAD;
+        segment.p_flags = PF_R | PF_X;
+        segment.p_offset = 0;
+        segment.p_vaddr = elf_base_address;
+        segment.p_paddr = elf_base_address;
+        segment.p_filesz = text_end;
+        segment.p_memsz = text_end;
+        segment.p_align = 0x1000;
+        std::memcpy(out.data() + sizeof(Elf64_Ehdr), &segment, sizeof(segment));
+    }
+
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f || !f.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()))){
+        return Error<size_t>(ErrorType::IOError);
+    }
+    f.close();
+    if (executable){
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::permissions(path, fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec, fs::perm_options::add, ec);
+        if (ec) return Error<size_t>(ErrorType::IOError);
+    }
+    return Ok(out.size());
+}
+
+}
@@ -1,69 +1,133 @@
+#include <charconv>
 #include "../include/grammar.hpp"
 
 namespace plc{
 
-GrammarInterpreter::GrammarInterpreter(const std::vector<Token>& tokens):token_list(tokens){
+GrammarInterpreter::GrammarInterpreter(const std::vector<Token>& tokens, CompilationContext& ctx):token_list(tokens),ctx_(ctx),ast_(ctx.ast){
     for (int i = 0; i < 5; i++){
         token_list.push_back(Token{TokenType::EndOfFile,"eof"});
     }
 }
 
-GrammarInterpreter::GrammarInterpreter(const std::vector<Token>& tokens, std::string log_file_name):token_list(tokens),log_file(std::move(log_file_name)){
+GrammarInterpreter::GrammarInterpreter(const std::vector<Token>& tokens, CompilationContext& ctx, std::string log_file_name):
+    token_list(tokens),log_file(std::move(log_file_name)),ctx_(ctx),ast_(ctx.ast){
     for (int i = 0; i < 5; i++){
         token_list.push_back(Token{TokenType::EndOfFile,"eof"});
     }
     if (!log_file.is_open()){
-        std::cerr<<"Error: unable to open log file."<<std::endl;
-        exit(1);
+        // the driver may compile many units at once, so keep going without a log
+        *ctx_.diagnostics<<"Warning: unable to open log file, continuing without it."<<std::endl;
     }
 }
 
+Result<SymbolIndex> GrammarInterpreter::declare(IdentType type, size_t n, int64_t value){
+    Result<SymbolIndex> res = ast_.symbols.declare(token_list[n].id_, type, value);
+    if (!res.isOk) error("duplicate identifier",n);
+    return res;
+}
+
+Result<SymbolIndex> GrammarInterpreter::resolve(size_t n, bool allow_var, bool allow_const, bool allow_procedure){
+    SymbolIndex index = ast_.symbols.lookup(token_list[n].id_);
+    if (index == no_symbol_index){
+        error("identifier use before defination" ,n);
+        return Error<SymbolIndex>(ErrorType::SymbolLookupError);
+    }
+    IdentType kind = ast_.symbols[index].kind;
+    if ((kind == IdentType::VarIdent && !allow_var) || (kind == IdentType::ConstIdent && !allow_const)
+     || (kind == IdentType::ProcedureIdent && !allow_procedure)){
+        error("identifier of wrong kind" ,n);
+        return Error<SymbolIndex>(ErrorType::InvalidSyntax);
+    }
+    return Ok(index);
+}
+
+NodeId GrammarInterpreter::operatorLeaf(size_t n){
+    return ast_.addOperator(token_list[n].kind_);
+}
+
+NodeId GrammarInterpreter::reduce(NodeKind kind, size_t mark, uint32_t value){
+    NodeId node = ast_.addNode(kind, stack_.data() + mark, stack_.size() - mark, value);
+    stack_.resize(mark);
+    return node;
+}
+
 void GrammarInterpreter::error(const std::string& name, size_t n){
-    std::string error_msg(name + " at token " + static_cast<std::string>(token_list[n]) + "(" + std::to_string(n) + ")\n");
+    std::string error_msg(name + " at token " + static_cast<std::string>(token_list[n]) + "(" + std::to_string(n) + ")");
+    if (token_list[n].line_) error_msg += " line " + std::to_string(token_list[n].line_) + ":" + std::to_string(token_list[n].column_);
+    error_msg += "\n";
     log_file << error_msg;
-    std::cerr << error_msg;
+    *ctx_.diagnostics << error_msg;
+}
+
+bool GrammarInterpreter::tooDeep(size_t n){
+    if (depth_ <= max_nesting) return false;
+    error("nesting deeper than " + std::to_string(max_nesting) + " levels", n);
+    return true;
+}
+
+namespace {
+
+// one more block or statement being parsed while it lives
+class NestingLevel{
+    public:
+    explicit NestingLevel(size_t& depth):depth_(depth){depth_++;}
+    ~NestingLevel(){depth_--;}
+    NestingLevel(const NestingLevel&) = delete;
+    NestingLevel& operator=(const NestingLevel&) = delete;
+    private:
+    size_t& depth_;
+};
+
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretProgram(size_t n) noexcept{
-    AST ast("Program");
-    Result<std::pair<size_t,AST>> res = interpretBlock(n);
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretProgram(size_t n) noexcept{
+    ast_.clear();
+    stack_.clear();
+    frames_.clear();
+    depth_ = 0;
+    ast_.symbols.pushScope();
+    Result<std::pair<size_t,NodeId>> res = interpretBlock(n);
+    ast_.symbols.popScope();
     if (!res.isOk){
         log_file << "Program failed to interpret." << std::endl;
         return res;
     }
     n = res->first;
-    ast.addChild(res->second);
-    if (token_list.size() >= n && token_list[n].value_ != "."){
+    ast_.root = ast_.addNode(NodeKind::Program, {res->second});
+    if (token_list.size() >= n && token_list[n].kind_ != TokenKind::Period){
         error("expecting '.'",n);
         log_file << "Program failed to interpret." << std::endl;
         return ErrorPair(ErrorType::InvalidSyntax);
     }
     log_file << "Program successfully interpreted." << std::endl;
-    std::cout<<std::endl;
-    ast.print(log_file);
+    *ctx_.out<<std::endl;
+    ast_.print(*ctx_.out);
+    ast_.print(log_file);
     log_file.close();
-    return Ok(std::make_pair(n,ast));
+    return Ok(std::make_pair(n,ast_.root));
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretBlock(size_t n){
-    AST ast("Block");
-    while (token_list[n].value_ != "."){
-        std::string& sym = token_list[n].value_;
-        Result<std::pair<size_t,AST>> res = Ok(std::make_pair(std::size_t{0},ast));
-        if (sym == "const")     res = interpretConstDecl(n+1);
-        else if (sym == "var")  res = interpretVarDecl(n+1);
-        else if (sym == "procedure")  res = interpretProcedure(n+1);
-        else if (sym == "begin"){
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretBlock(size_t n){
+    NestingLevel level(depth_);
+    if (tooDeep(n)) return ErrorPair(ErrorType::InvalidSyntax);
+    size_t mark = stack_.size();
+    while (token_list[n].kind_ != TokenKind::Period){
+        TokenKind sym = token_list[n].kind_;
+        Result<std::pair<size_t,NodeId>> res = ErrorPair(ErrorType::Empty);
+        if (sym == TokenKind::Const)     res = interpretConstDecl(n+1);
+        else if (sym == TokenKind::Var)  res = interpretVarDecl(n+1);
+        else if (sym == TokenKind::Procedure)  res = interpretProcedure(n+1);
+        else if (sym == TokenKind::Begin){
             res = interpretStatementSequence(n+1);
             if (!res.isOk) return res;
             n = res->first;
-            ast.addChild(res->second);
+            stack_.push_back(res->second);
 
-            if (token_list[n].value_ != "end"){
+            if (token_list[n].kind_ != TokenKind::End){
                 error("expecting 'end'",n);
                 return ErrorPair(ErrorType::InvalidSyntax);
             }
-            return Ok(std::make_pair(n+1,ast));
+            return Ok(std::make_pair(n+1,reduce(NodeKind::Block, mark, ast_.symbols.current())));
         }
         else{
             error("invalid symbol",n);
@@ -72,22 +136,21 @@ Result<std::pair<size_t,AST>> GrammarInterpreter::interpretBlock(size_t n){
 
         if (!res.isOk) return res;
         n = res->first;
-        ast.addChild(res->second);
+        stack_.push_back(res->second);
     }
-    return Ok(std::make_pair(n,ast));
+    return Ok(std::make_pair(n,reduce(NodeKind::Block, mark, ast_.symbols.current())));
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretConstDecl(size_t n){
-    AST ast("Const");
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretConstDecl(size_t n){
+    size_t mark = stack_.size();
     while (1){
         if (token_list[n].type_ != TokenType::Identifier){
             error("expecting identifier",n);
             return ErrorPair(ErrorType::InvalidSyntax);
         }
-        symbol_table.emplace_back(IdentType::ConstIdent,token_list[n].value_);
-        ast.addChild(token_list[n].value_);
+        size_t name = n;
         n++;
-        if (token_list[n].value_ !=  "="){
+        if (token_list[n].kind_ != TokenKind::Equal){
             error("expecting '='",n);
             return ErrorPair(ErrorType::InvalidSyntax);
         }
@@ -96,158 +159,151 @@ Result<std::pair<size_t,AST>> GrammarInterpreter::interpretConstDecl(size_t n){
             error("expecting literal",n);
             return ErrorPair(ErrorType::InvalidSyntax);
         }
-        ast.addChild(token_list[n].value_);
+        Result<NodeId> literal = number(n);
+        if (!literal.isOk) return ErrorPair(ErrorType::InvalidSyntax);
+        Result<SymbolIndex> symbol = declare(IdentType::ConstIdent, name, ast_.number(*literal));
+        if (!symbol.isOk) return ErrorPair(ErrorType::InvalidSyntax);
+        stack_.push_back(ast_.addIdent(*symbol));
+        stack_.push_back(*literal);
         n++;
-        if (token_list[n].value_ !=  "," && token_list[n].value_ !=  ";"){
+        if (token_list[n].kind_ != TokenKind::Comma && token_list[n].kind_ != TokenKind::Semicolon){
             error("expecting ',' or ';'",n);
             return ErrorPair(ErrorType::InvalidSyntax);
-        }else if (token_list[n].value_ ==  ";"){
+        }else if (token_list[n].kind_ == TokenKind::Semicolon){
             break;
         }
         n++;
     }
-    return Ok(std::make_pair(n+1,ast));
+    return Ok(std::make_pair(n+1,reduce(NodeKind::Const, mark)));
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretVarDecl(size_t n){
-    AST ast("Var");
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretVarDecl(size_t n){
+    size_t mark = stack_.size();
     while (1){
         if (token_list[n].type_ != TokenType::Identifier){
             error("expecting identifier",n);
             return ErrorPair(ErrorType::InvalidSyntax);
         }
-        symbol_table.emplace_back(IdentType::VarIdent,token_list[n].value_);
-        ast.addChild(token_list[n].value_);
+        Result<SymbolIndex> symbol = declare(IdentType::VarIdent, n);
+        if (!symbol.isOk) return ErrorPair(ErrorType::InvalidSyntax);
+        stack_.push_back(ast_.addIdent(*symbol));
         n++;
-        if (token_list[n].value_ !=  "," && token_list[n].value_ !=  ";"){
+        if (token_list[n].kind_ != TokenKind::Comma && token_list[n].kind_ != TokenKind::Semicolon){
             error("expecting ',' or ';'",n);
             return ErrorPair(ErrorType::InvalidSyntax);
-        }else if (token_list[n].value_ ==  ";"){
+        }else if (token_list[n].kind_ == TokenKind::Semicolon){
             break;
         }
         n++;
     }
-    return Ok(std::make_pair(n+1,ast));
+    return Ok(std::make_pair(n+1,reduce(NodeKind::Var, mark)));
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretProcedure(size_t n){
-    AST ast("Procedure");
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretProcedure(size_t n){
     if (token_list[n].type_ != TokenType::Identifier){
         error("expecting identifier",n);
         return ErrorPair(ErrorType::InvalidSyntax);
     }
-    symbol_table.emplace_back(IdentType::ProcedureIdent,token_list[n].value_);
-    ast.addChild(token_list[n].value_);
+    Result<SymbolIndex> symbol = declare(IdentType::ProcedureIdent, n);
+    if (!symbol.isOk) return ErrorPair(ErrorType::InvalidSyntax);
+    NodeId name = ast_.addIdent(*symbol);
     n++;
-    if (token_list[n].value_ !=  ";"){
+    if (token_list[n].kind_ != TokenKind::Semicolon){
         error("expecting ';'",n);
         return ErrorPair(ErrorType::InvalidSyntax);
     }
-    Result<std::pair<size_t,AST>> res = interpretBlock(n+1);
+    ast_.symbols.pushScope(*symbol);
+    Result<std::pair<size_t,NodeId>> res = interpretBlock(n+1);
+    ast_.symbols.popScope();
     if (!res.isOk) return res;
     n = res->first;
-    ast.addChild(res->second);
+    NodeId ast = ast_.addNode(NodeKind::Procedure, {name, res->second}, *symbol);
 
-    if (token_list[n].value_ !=  ";"){
+    if (token_list[n].kind_ != TokenKind::Semicolon){
         error("expecting ';'",n);
         return ErrorPair(ErrorType::InvalidSyntax);
     }
     return Ok(std::make_pair(n+1,ast));
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretStatementSequence(size_t n){
-    AST ast("Sequence");
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretStatementSequence(size_t n){
+    size_t mark = stack_.size();
     while (1){
-        Result<std::pair<size_t,AST>> res = interpretStatement(n);
+        Result<std::pair<size_t,NodeId>> res = interpretStatement(n);
         if (!res.isOk) return res;
         n = res->first;
-        ast.addChild(res->second);
+        stack_.push_back(res->second);
 
-        if (token_list[n].value_ !=  ";"){
-            return Ok(std::make_pair(n,ast));
+        if (token_list[n].kind_ != TokenKind::Semicolon){
+            return Ok(std::make_pair(n,reduce(NodeKind::Sequence, mark)));
         }
         n++;
         //my own addition
-        if (token_list[n].value_ == "end"){
-            return Ok(std::make_pair(n,ast));
+        if (token_list[n].kind_ == TokenKind::End){
+            return Ok(std::make_pair(n,reduce(NodeKind::Sequence, mark)));
         }
     }
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretStatement(size_t n){
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretStatement(size_t n){
+    NestingLevel level(depth_);
+    if (tooDeep(n)) return ErrorPair(ErrorType::InvalidSyntax);
     if (token_list[n].type_ == TokenType::Identifier){
-        AST ast("Assign", token_list[n].value_);
-        symbol_table.emplace_back(IdentType::VarIdent,token_list[n].value_);
+        Result<SymbolIndex> symbol = resolve(n, true, false, false);
+        if (!symbol.isOk) return ErrorPair(ErrorType::InvalidSyntax);
+        NodeId target = ast_.addIdent(*symbol);
         n++;
-        if (token_list[n].value_ != ":="){
+        if (token_list[n].kind_ != TokenKind::Becomes){
             error("expecting ':='",n);
             return ErrorPair(ErrorType::InvalidSyntax);
         }
-        Result<std::pair<size_t,AST>> res = interpretExpression(n+1);
+        Result<std::pair<size_t,NodeId>> res = interpretExpression(n+1);
         if (!res.isOk) return res;
         n = res->first;
-        ast.addChild(res->second);
 
-        return Ok(std::make_pair(n,ast));
+        return Ok(std::make_pair(n,ast_.addNode(NodeKind::Assign, {target, res->second})));
     }else{
-        if (token_list[n].value_ == "call"){
+        if (token_list[n].kind_ == TokenKind::Call){
             n++;
             if (token_list[n].type_ != TokenType::Identifier){
                 error("expecting identifier",n);
                 return ErrorPair(ErrorType::InvalidSyntax);
             }
-            if (std::find(symbol_table.begin(), symbol_table.end(), std::make_pair(IdentType::ProcedureIdent, token_list[n].value_)) == std::end(symbol_table)){
-                error("identifier use before defination" ,n);
-                return ErrorPair(ErrorType::InvalidSyntax);
-            }
-            AST ast("Call", token_list[n].value_);
+            Result<SymbolIndex> symbol = resolve(n, false, false, true);
+            if (!symbol.isOk) return ErrorPair(ErrorType::InvalidSyntax);
+            NodeId ast = ast_.addNode(NodeKind::Call, {ast_.addIdent(*symbol)});
             return Ok(std::make_pair(n+1,ast));
-        }else if (token_list[n].value_ == "begin"){
-            Result<std::pair<size_t,AST>> res = interpretStatementSequence(n+1);
+        }else if (token_list[n].kind_ == TokenKind::Begin){
+            Result<std::pair<size_t,NodeId>> res = interpretStatementSequence(n+1);
             if (!res.isOk) return res;
             n = res->first;
-            AST ast = res->second;
 
-            if (token_list[n].value_ != "end"){
+            if (token_list[n].kind_ != TokenKind::End){
                 error("expecting 'end'",n);
                 return ErrorPair(ErrorType::InvalidSyntax);
             }
-            return Ok(std::make_pair(n+1,ast));
-        }else if (token_list[n].value_ == "if"){
-            Result<std::pair<size_t,AST>> res = interpretCondition(n+1);
-            if (!res.isOk) return res;
-            n = res->first;
-            AST ast("If", res->second);
-
-            if (token_list[n].value_ != "then"){
-                error("expecting 'then'",n);
-                return ErrorPair(ErrorType::InvalidSyntax);
-            }
-            res = interpretStatement(n+1);
-            if (!res.isOk) return res;
-            n = res->first;
-            ast.addChild(res->second);
-
-            return Ok(std::make_pair(n,ast));
-        }else if (token_list[n].value_ == "while"){
-            Result<std::pair<size_t,AST>> res = interpretCondition(n+1);
+            return Ok(std::make_pair(n+1,res->second));
+        }else if (token_list[n].kind_ == TokenKind::If || token_list[n].kind_ == TokenKind::While){
+            bool is_while = token_list[n].kind_ == TokenKind::While;
+            Result<std::pair<size_t,NodeId>> res = interpretCondition(n+1);
             if (!res.isOk) return res;
             n = res->first;
-            AST ast("While", res->second);
+            NodeId condition = res->second;
 
-            if (token_list[n].value_ != "do"){
-                error("expecting 'do'",n);
+            TokenKind expected = is_while ? TokenKind::Do : TokenKind::Then;
+            if (token_list[n].kind_ != expected){
+                error(is_while ? "expecting 'do'" : "expecting 'then'",n);
                 return ErrorPair(ErrorType::InvalidSyntax);
             }
             res = interpretStatement(n+1);
             if (!res.isOk) return res;
             n = res->first;
-            ast.addChild(res->second);
 
+            NodeId ast = ast_.addNode(is_while ? NodeKind::While : NodeKind::If, {condition, res->second});
             return Ok(std::make_pair(n,ast));
-        }else if (token_list[n].value_ == ";"){
+        }else if (token_list[n].kind_ == TokenKind::Semicolon){
             //support for empty statement
-            return Ok(std::make_pair(n+1,AST("EmptyStatement")));
+            return Ok(std::make_pair(n+1,ast_.addNode(NodeKind::EmptyStatement, {})));
         }else{
             error("expecting statement",n);
             return ErrorPair(ErrorType::InvalidSyntax);
@@ -255,102 +311,120 @@ Result<std::pair<size_t,AST>> GrammarInterpreter::interpretStatement(size_t n){
     }
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretExpression(size_t n){
-    AST ast("Calc");
-    if (token_list[n].value_ == "+" || token_list[n].value_ == "-"){
-        ast.addChild(token_list[n].value_);
-        n++;
-    }
-    while (1){
-        Result<std::pair<size_t,AST>> res = interpretTerm(n);
-        if (!res.isOk) return res;
-        n = res->first;
-        ast.addChild(res->second);
-
-        if (token_list[n].value_ != "+" && token_list[n].value_ != "-"){
-            if (ast.children.size() == 1){
-                return Ok(std::make_pair(n,ast.children[0]));
-            }
-            else return Ok(std::make_pair(n,ast));
-        }
-        ast.addChild(token_list[n].value_);
-        n++;
+NodeId GrammarInterpreter::collapse(size_t mark){
+    if (stack_.size() - mark == 1){
+        NodeId only = stack_.back();
+        stack_.pop_back();
+        return only;
     }
+    return reduce(NodeKind::Calc, mark);
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretTerm(size_t n){
-    AST ast("Calc");
+// Operands and operators of every open level share stack_; frames_ keeps
+// where each level enclosing a '(' began. Nodes are created in the same
+// order as by a recursive descent over expression, term and factor.
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretExpression(size_t n){
+    size_t base = frames_.size();
+    size_t expression_mark = stack_.size();
+    size_t term_mark = 0;
+    bool starts_expression = true;
     while (1){
-        Result<std::pair<size_t,AST>> res = interpretFactor(n);
-        if (!res.isOk) return res;
-        n = res->first;
-        ast.addChild(res->second);
-
-        if (token_list[n].value_ != "*" && token_list[n].value_ != "/"){
-            if (ast.children.size() == 1){
-                return Ok(std::make_pair(n,ast.children[0]));
+        if (starts_expression){
+            if (token_list[n].kind_ == TokenKind::Plus || token_list[n].kind_ == TokenKind::Minus){
+                stack_.push_back(operatorLeaf(n));
+                n++;
             }
-            else return Ok(std::make_pair(n,ast));
+            term_mark = stack_.size();
         }
-        ast.addChild(token_list[n].value_);
-        n++;
-    }
-}
-
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretFactor(size_t n){
-    if (token_list[n].value_ == "("){
-        Result<std::pair<size_t,AST>> res = interpretExpression(n+1);
-        if (!res.isOk) return res;
-        n = res->first;
-        if (token_list[n].value_ != ")"){
-            error("expecting ')'",n);
-            return ErrorPair(ErrorType::InvalidSyntax);
+        if (token_list[n].kind_ == TokenKind::LParen){
+            frames_.push_back(ExpressionFrame{expression_mark, term_mark});
+            n++;
+            expression_mark = stack_.size();
+            starts_expression = true;
+            continue;
         }
-        return Ok(std::make_pair(n+1,res->second));
-    }else if (token_list[n].type_ == TokenType::Literal){
-        return Ok(std::make_pair(n+1,AST(token_list[n].value_)));
-    }else if (token_list[n].type_ == TokenType::Identifier){
-        if (std::find(symbol_table.begin(), symbol_table.end(), std::make_pair(IdentType::ConstIdent, token_list[n].value_)) == std::end(symbol_table)
-         && std::find(symbol_table.begin(), symbol_table.end(), std::make_pair(IdentType::VarIdent, token_list[n].value_)) == std::end(symbol_table)){
-            error("identifier use before defination" ,n);
+        if (token_list[n].type_ == TokenType::Literal){
+            Result<NodeId> literal = number(n);
+            if (!literal.isOk) return ErrorPair(ErrorType::InvalidSyntax);
+            stack_.push_back(*literal);
+        }else if (token_list[n].type_ == TokenType::Identifier){
+            Result<SymbolIndex> symbol = resolve(n, true, true, false);
+            if (!symbol.isOk) return ErrorPair(ErrorType::InvalidSyntax);
+            stack_.push_back(ast_.addIdent(*symbol));
+        }else{
+            error("expecting factor",n);
             return ErrorPair(ErrorType::InvalidSyntax);
         }
-        return Ok(std::make_pair(n+1,AST(token_list[n].value_)));
-    }else {
-        error("expecting factor",n);
-        return ErrorPair(ErrorType::InvalidSyntax);
+        n++;
+
+        // close terms, expressions and parentheses until an operator wants another factor
+        starts_expression = false;
+        while (1){
+            TokenKind kind = token_list[n].kind_;
+            if (kind == TokenKind::Times || kind == TokenKind::Slash){
+                stack_.push_back(operatorLeaf(n));
+                n++;
+                break;
+            }
+            stack_.push_back(collapse(term_mark));
+            if (kind == TokenKind::Plus || kind == TokenKind::Minus){
+                stack_.push_back(operatorLeaf(n));
+                n++;
+                term_mark = stack_.size();
+                break;
+            }
+            NodeId expression = collapse(expression_mark);
+            if (frames_.size() == base) return Ok(std::make_pair(n,expression));
+            if (kind != TokenKind::RParen){
+                error("expecting ')'",n);
+                return ErrorPair(ErrorType::InvalidSyntax);
+            }
+            n++;
+            expression_mark = frames_.back().expression_mark;
+            term_mark = frames_.back().term_mark;
+            frames_.pop_back();
+            stack_.push_back(expression);
+        }
     }
 }
 
-Result<std::pair<size_t,AST>> GrammarInterpreter::interpretCondition(size_t n){
-    AST ast("Condition");
-    if (token_list[n].value_ == "odd"){
-        ast.addChild("odd");
-        Result<std::pair<size_t,AST>> res = interpretExpression(n+1);
+Result<std::pair<size_t,NodeId>> GrammarInterpreter::interpretCondition(size_t n){
+    if (token_list[n].kind_ == TokenKind::Odd){
+        NodeId odd = operatorLeaf(n);
+        Result<std::pair<size_t,NodeId>> res = interpretExpression(n+1);
         if (!res.isOk) return res;
         n = res->first;
-        ast.addChild(res->second);
 
-        return Ok(std::make_pair(n,ast));
+        return Ok(std::make_pair(n,ast_.addNode(NodeKind::Condition, {odd, res->second})));
     }else{
-        Result<std::pair<size_t,AST>> res = interpretExpression(n);
+        Result<std::pair<size_t,NodeId>> res = interpretExpression(n);
         if (!res.isOk) return res;
         n = res->first;
-        ast.addChild(res->second);
+        NodeId lhs = res->second;
 
         if (token_list[n].type_ != TokenType::Operator){
             error("expecting operator",n);
             return ErrorPair(ErrorType::InvalidSyntax);
         }
-        ast.addChild(token_list[n].value_);
+        NodeId op = operatorLeaf(n);
 
         res = interpretExpression(n+1);
         if (!res.isOk) return res;
         n = res->first;
-        ast.addChild(res->second);
 
-        return Ok(std::make_pair(n,ast));
+        return Ok(std::make_pair(n,ast_.addNode(NodeKind::Condition, {lhs, op, res->second})));
     }
 }
 
-}
\ No newline at end of file
+Result<NodeId> GrammarInterpreter::number(size_t n){
+    std::string_view text = token_list[n].value_;
+    int64_t value = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || ptr != text.data() + text.size()){
+        error("literal out of range",n);
+        return Error<NodeId>(ErrorType::InvalidSyntax);
+    }
+    return Ok(ast_.addNumber(value));
+}
+
+}
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <unordered_map>
+#include "../include/grammar.hpp"
+#include "../include/inline.hpp"
+
+namespace plc {
+
+namespace {
+
+constexpr uint32_t no_function = UINT32_MAX;
+
+// A block or statement adds at most two levels to the AST, so no copy may
+// nest it deeper than the parser lets a program nest it: the passes after
+// inlining recurse once per level.
+constexpr size_t max_depth = 2 * GrammarInterpreter::max_nesting;
+
+// the main program or one procedure, with the calls made from its own body
+struct Function{
+    NodeId block;
+    NodeId declaration;         // Procedure node, no_node for the main program
+    uint32_t parent;            // function whose block declares it
+    std::vector<NodeId> calls;
+    std::vector<uint32_t> nested;   // procedures its block declares
+    bool recursive = false;
+    size_t size = 0;            // nodes in its statement once it is final, 0 before
+    size_t depth = 0;           // levels below its statement, with size
+};
+
+bool isStatement(NodeKind kind){
+    return kind != NodeKind::Const && kind != NodeKind::Var && kind != NodeKind::Procedure;
+}
+
+class Inliner{
+    public:
+    Inliner(AST& ast, size_t budget):ast(ast),budget_(budget),function_of_(ast.symbols.size(), no_function){}
+
+    InlineStats run(){
+        functions_.push_back(Function{ast.child(ast.root, 0), no_node, no_function, {}, {}, false, 0});
+        collect(ast.child(ast.root, 0), 0, 0);
+        for (Function& f : functions_){
+            for (NodeId call : f.calls) sites_[ast.symbol(ast.child(call, 0))]++;
+        }
+        index_.assign(functions_.size(), UINT32_MAX);
+        low_.assign(functions_.size(), 0);
+        on_stack_.assign(functions_.size(), 0);
+        components(0);
+        for (uint32_t f : order_) inlineInto(f);
+        removeUnreached();
+        return stats;
+    }
+
+    InlineStats stats;
+
+    private:
+    void collect(NodeId n, uint32_t f, size_t depth){
+        switch (ast.kind(n)){
+            case NodeKind::Procedure:{
+                auto g = static_cast<uint32_t>(functions_.size());
+                function_of_[ast[n].value] = g;
+                functions_.push_back(Function{ast.child(n, 1), n, f, {}, {}, false, 0});
+                functions_[f].nested.push_back(g);
+                collect(ast.child(n, 1), g, 0);
+                return;
+            }
+            case NodeKind::Call:
+                functions_[f].calls.push_back(n);
+                depth_of_call_[n] = depth;
+                return;
+            // expressions hold no calls
+            case NodeKind::Condition: case NodeKind::Calc:
+            case NodeKind::Ident: case NodeKind::Number: case NodeKind::Operator:
+                return;
+            default:
+                for (NodeId child : ast.children(n)) collect(child, f, depth + 1);
+        }
+    }
+
+    uint32_t callee(NodeId call) const {return function_of_[ast.symbol(ast.child(call, 0))];}
+
+    // Tarjan's strongly connected components from the main program; each
+    // is finished after everything it calls, which gives order_ callees first
+    void components(uint32_t f){
+        index_[f] = low_[f] = next_index_++;
+        stack_.push_back(f);
+        on_stack_[f] = 1;
+        for (NodeId call : functions_[f].calls){
+            uint32_t g = callee(call);
+            if (g == no_function) continue;
+            if (g == f) functions_[f].recursive = true;
+            if (index_[g] == UINT32_MAX){
+                components(g);
+                low_[f] = std::min(low_[f], low_[g]);
+            }else if (on_stack_[g]) low_[f] = std::min(low_[f], index_[g]);
+        }
+        if (low_[f] != index_[f]) return;
+        size_t begin = stack_.size();
+        while (stack_[begin - 1] != f) begin--;
+        begin--;
+        for (size_t i = begin; i < stack_.size(); i++){
+            on_stack_[stack_[i]] = 0;
+            if (stack_.size() - begin > 1) functions_[stack_[i]].recursive = true;
+            order_.push_back(stack_[i]);
+        }
+        stack_.resize(begin);
+    }
+
+    NodeId statement(const Function& f) const{
+        ChildRange ch = ast.children(f.block);
+        if (ch.empty() || !isStatement(ast.kind(ch[ch.size() - 1]))) return no_node;
+        return ch[ch.size() - 1];
+    }
+
+    // sets size and depth once the statement of f is final
+    void measure(Function& f) const{
+        NodeId body = statement(f);
+        if (body == no_node){
+            f.size = 1;
+            return;
+        }
+        std::vector<std::pair<NodeId, size_t>> stack{{body, 0}};
+        while (!stack.empty()){
+            auto [n, depth] = stack.back();
+            stack.pop_back();
+            f.size++;
+            f.depth = std::max(f.depth, depth);
+            for (NodeId child : ast.children(n)) stack.push_back({child, depth + 1});
+        }
+    }
+
+    bool inlinable(uint32_t g, NodeId call){
+        Function& f = functions_[g];
+        if (f.declaration == no_node || f.recursive) return false;
+        // a nested procedure may use the variables that the copy renames
+        for (uint32_t nested : f.nested){
+            if (sites_[ast[functions_[nested].declaration].value]) return false;
+        }
+        if (!f.size) measure(f);
+        // the copy sits one level below the call, in the Sequence that zeroes its variables
+        if (depth_of_call_[call] + 1 + f.depth > max_depth) return false;
+        return sites_[ast[f.declaration].value] == 1 || f.size <= budget_;
+    }
+
+    void inlineInto(uint32_t f){
+        scope_ = ast[functions_[f].block].value;
+        copy_of_.clear();
+        declared_.clear();
+        // calls the copies bring along are appended and handled in turn
+        for (size_t i = 0; i < functions_[f].calls.size(); i++){
+            NodeId call = functions_[f].calls[i];
+            uint32_t g = callee(call);
+            if (g == no_function || !inlinable(g, call)) continue;
+            callee_scope_ = ast[functions_[g].block].value;
+            sites_[ast[functions_[g].declaration].value]--;
+            stats.inlined++;
+            NodeId body = statement(functions_[g]);
+            if (body == no_node){
+                ast.nodes[call] = ASTNode{NodeKind::EmptyStatement, 0, 0, 0};
+                continue;
+            }
+            size_t first_copied = functions_[f].calls.size();
+            used_.clear();
+            site_depth_ = depth_of_call_[call];
+            NodeId copy = clone(body, functions_[f].calls);
+            if (!used_.empty()){
+                // the copied variables are shared by every site in this
+                // caller, but a call starts the callee's variables at zero
+                std::vector<NodeId> statements;
+                for (SymbolIndex var : used_) statements.push_back(ast.addNode(NodeKind::Assign, {ast.addIdent(var), ast.addNumber(0)}));
+                statements.push_back(copy);
+                copy = ast.addNode(NodeKind::Sequence, statements.data(), statements.size());
+            }
+            // nodes are never shared, the call node takes over the copy
+            ast.nodes[call] = ast.nodes[copy];
+            for (size_t j = first_copied; j < functions_[f].calls.size(); j++){
+                if (functions_[f].calls[j] == copy) functions_[f].calls[j] = call;
+            }
+        }
+        declare(functions_[f].block);
+    }
+
+    // copies n bottom-up in the order a recursive walk would, keeping the
+    // nodes being copied on a stack since parentheses nest without limit
+    NodeId clone(NodeId n, std::vector<NodeId>& calls){
+        NodeId copy = cloneLeaf(n);
+        if (copy != no_node) return copy;
+        struct Frame{
+            NodeId node;
+            size_t done;        // children copied so far
+            size_t mark;        // where they start in copies
+        };
+        std::vector<Frame> frames{{n, 0, 0}};
+        std::vector<NodeId> copies;
+        while (true){
+            Frame& top = frames.back();
+            // cloning appends to ast.edges, so children are looked up afresh
+            if (top.done < ast[top.node].count){
+                NodeId child = ast.child(top.node, top.done++);
+                copy = cloneLeaf(child);
+                if (copy != no_node) copies.push_back(copy);
+                else frames.push_back({child, 0, copies.size()});
+                continue;
+            }
+            NodeId node = top.node;
+            size_t mark = top.mark;
+            frames.pop_back();
+            copy = ast.addNode(ast.kind(node), copies.data() + mark, copies.size() - mark, ast[node].value);
+            if (ast.kind(node) == NodeKind::Call){
+                calls.push_back(copy);
+                depth_of_call_[copy] = site_depth_ + 1 + frames.size();
+                sites_[ast.symbol(copies[mark])]++;
+            }
+            copies.resize(mark);
+            if (frames.empty()) return copy;
+            copies.push_back(copy);
+        }
+    }
+
+    // the copy of a leaf, no_node for any other node
+    NodeId cloneLeaf(NodeId n){
+        switch (ast.kind(n)){
+            case NodeKind::Ident:{
+                SymbolIndex s = ast.symbol(n);
+                const SymbolInfo& sym = ast.symbols[s];
+                if (sym.kind == IdentType::ConstIdent) return ast.addNumber(sym.value);
+                if (sym.kind == IdentType::VarIdent && sym.scope == callee_scope_){
+                    SymbolIndex copy = copyOf(s);
+                    if (std::find(used_.begin(), used_.end(), copy) == used_.end()) used_.push_back(copy);
+                    return ast.addIdent(copy);
+                }
+                return ast.addIdent(s);
+            }
+            case NodeKind::Number:
+                return ast.addNumber(ast.number(n));
+            case NodeKind::Operator:
+                return ast.addOperator(ast.op(n));
+            default:
+                return no_node;
+        }
+    }
+
+    SymbolIndex copyOf(SymbolIndex var){
+        auto [it, inserted] = copy_of_.emplace(var, 0);
+        if (!inserted) return it->second;
+        SymbolTable& table = ast.symbols;
+        ScopeInfo& scope = table.scopes[scope_];
+        table.symbols.push_back(SymbolInfo{table[var].name, IdentType::VarIdent, scope_, scope.depth, scope.vars++, 0, no_scope, no_symbol_index, var});
+        it->second = static_cast<SymbolIndex>(table.size() - 1);
+        declared_.push_back(it->second);
+        return it->second;
+    }
+
+    // the copies join the last var declaration of the block, or a new one
+    // after its consts
+    void declare(NodeId block){
+        if (declared_.empty()) return;
+        std::vector<NodeId> idents;
+        for (SymbolIndex var : declared_) idents.push_back(ast.addIdent(var));
+        ChildRange range = ast.children(block);
+        std::vector<NodeId> children(range.begin(), range.end());
+        auto last_var = std::find_if(children.rbegin(), children.rend(), [&](NodeId n){return ast.kind(n) == NodeKind::Var;});
+        if (last_var != children.rend()){
+            ChildRange vars = ast.children(*last_var);
+            idents.insert(idents.begin(), vars.begin(), vars.end());
+            setChildren(*last_var, idents);
+            return;
+        }
+        auto at = std::find_if(children.begin(), children.end(), [&](NodeId n){return ast.kind(n) != NodeKind::Const;});
+        children.insert(at, ast.addNode(NodeKind::Var, idents.data(), idents.size()));
+        setChildren(block, children);
+    }
+
+    void setChildren(NodeId n, const std::vector<NodeId>& children){
+        ast.nodes[n].first = static_cast<uint32_t>(ast.edges.size());
+        ast.nodes[n].count = static_cast<uint32_t>(children.size());
+        ast.edges.insert(ast.edges.end(), children.begin(), children.end());
+    }
+
+    void removeUnreached(){
+        std::vector<char> reached(functions_.size(), 0);
+        std::vector<uint32_t> work{0};
+        reached[0] = 1;
+        while (!work.empty()){
+            uint32_t f = work.back();
+            work.pop_back();
+            for (NodeId call : functions_[f].calls){
+                if (ast.kind(call) != NodeKind::Call) continue;
+                uint32_t g = callee(call);
+                if (g == no_function || reached[g]) continue;
+                reached[g] = 1;
+                work.push_back(g);
+            }
+        }
+        std::vector<char> pruned(functions_.size(), 0);
+        for (uint32_t g = 1; g < functions_.size(); g++){
+            if (reached[g]) continue;
+            stats.removed++;
+            uint32_t parent = functions_[g].parent;
+            if (!reached[parent] || pruned[parent]) continue;
+            pruned[parent] = 1;
+            ChildRange range = ast.children(functions_[parent].block);
+            std::vector<NodeId> children;
+            for (NodeId child : range){
+                if (ast.kind(child) != NodeKind::Procedure || reached[function_of_[ast[child].value]]) children.push_back(child);
+            }
+            setChildren(functions_[parent].block, children);
+        }
+    }
+
+    AST& ast;
+    size_t budget_;
+    std::vector<Function> functions_;
+    std::vector<uint32_t> function_of_;     // by SymbolIndex of a procedure
+    std::unordered_map<SymbolIndex, size_t> sites_;     // calls naming each procedure
+    std::unordered_map<NodeId, size_t> depth_of_call_;  // levels below the statement of its function
+    size_t site_depth_ = 0;                             // of the call being inlined
+    std::vector<uint32_t> order_;
+    std::vector<uint32_t> index_, low_, stack_;
+    std::vector<char> on_stack_;
+    uint32_t next_index_ = 0;
+    ScopeId scope_ = 0, callee_scope_ = 0;
+    std::unordered_map<SymbolIndex, SymbolIndex> copy_of_;
+    std::vector<SymbolIndex> declared_;
+    std::vector<SymbolIndex> used_;         // copies the body being cloned refers to
+};
+
+}
+
+InlineStats inlineProcedures(AST& ast, size_t budget){
+    if (!budget || ast.root == no_node || ast.kind(ast.root) != NodeKind::Program || ast.children(ast.root).empty()) return {};
+    return Inliner(ast, budget).run();
+}
+
+}
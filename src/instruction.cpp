@@ -0,0 +1,136 @@
+#include <sstream>
+#include "../include/instruction.hpp"
+
+namespace plc {
+
+std::string_view regName(Reg reg){
+    switch (reg){
+        case Reg::rax: return "rax";
+        case Reg::rcx: return "rcx";
+        case Reg::rdx: return "rdx";
+        case Reg::rbx: return "rbx";
+        case Reg::rsp: return "rsp";
+        case Reg::rbp: return "rbp";
+        case Reg::rsi: return "rsi";
+        case Reg::rdi: return "rdi";
+        case Reg::r8: return "r8";
+        case Reg::r9: return "r9";
+        case Reg::r10: return "r10";
+        case Reg::r11: return "r11";
+        case Reg::r12: return "r12";
+        case Reg::r13: return "r13";
+        case Reg::r14: return "r14";
+        case Reg::r15: return "r15";
+        case Reg::none: break;
+    }
+    return "?";
+}
+
+void Operand::print(std::ostream& os) const{
+    switch (kind){
+        case OperandKind::Register: os << regName(reg); break;
+        case OperandKind::Immediate: os << value; break;
+        case OperandKind::Memory:
+            os << '[' << regName(reg);
+            if (value > 0) os << '+';
+            if (value != 0) os << value;
+            os << ']';
+            break;
+        case OperandKind::None: break;
+    }
+}
+
+std::string_view opcodeName(Opcode op){
+    switch (op){
+        case Opcode::Label: return "";
+        case Opcode::Mov: return "mov";
+        case Opcode::Add: return "add";
+        case Opcode::Sub: return "sub";
+        case Opcode::Imul: return "imul";
+        case Opcode::Idiv: return "idiv";
+        case Opcode::Cqo: return "cqo";
+        case Opcode::Cmp: return "cmp";
+        case Opcode::Test: return "test";
+        case Opcode::Xor: return "xor";
+        case Opcode::Shl: return "shl";
+        case Opcode::Shr: return "shr";
+        case Opcode::Sar: return "sar";
+        case Opcode::Neg: return "neg";
+        case Opcode::Push: return "push";
+        case Opcode::Pop: return "pop";
+        case Opcode::Jmp: return "jmp";
+        case Opcode::Je: return "je";
+        case Opcode::Jne: return "jne";
+        case Opcode::Jl: return "jl";
+        case Opcode::Jle: return "jle";
+        case Opcode::Jg: return "jg";
+        case Opcode::Jge: return "jge";
+        case Opcode::Jz: return "jz";
+        case Opcode::Jnz: return "jnz";
+        case Opcode::Call: return "call";
+        case Opcode::Ret: return "ret";
+        case Opcode::Syscall: return "syscall";
+    }
+    return "";
+}
+
+bool isConditionalJump(Opcode op){
+    return op >= Opcode::Je && op <= Opcode::Jnz;
+}
+
+Opcode invertJump(Opcode op){
+    switch (op){
+        case Opcode::Je: return Opcode::Jne;
+        case Opcode::Jne: return Opcode::Je;
+        case Opcode::Jl: return Opcode::Jge;
+        case Opcode::Jge: return Opcode::Jl;
+        case Opcode::Jg: return Opcode::Jle;
+        case Opcode::Jle: return Opcode::Jg;
+        case Opcode::Jz: return Opcode::Jnz;
+        case Opcode::Jnz: return Opcode::Jz;
+        default: return op;
+    }
+}
+
+Instruction::Instruction(Opcode op, Operand dst, Operand src):op(op),dst(dst),src(src){}
+
+Instruction::Instruction(Opcode op, std::string target):op(op),target(std::move(target)){}
+
+bool Instruction::isControl() const{
+    switch (op){
+        case Opcode::Label:
+        case Opcode::Call:
+        case Opcode::Ret:
+        case Opcode::Syscall:
+            return true;
+        default:
+            return isJump();
+    }
+}
+
+void Instruction::print(std::ostream& os) const{
+    if (op == Opcode::Label){
+        os << target << ':';
+        return;
+    }
+    os << opcodeName(op);
+    if (!target.empty()){
+        os << ' ' << target;
+        return;
+    }
+    if (dst.isNone()) return;
+    // the size goes on a memory destination, the other operand implies it otherwise
+    os << (dst.isMem() ? " qword" : " ");
+    dst.print(os);
+    if (src.isNone()) return;
+    os << ',';
+    src.print(os);
+}
+
+Instruction::operator std::string() const{
+    std::ostringstream os;
+    print(os);
+    return os.str();
+}
+
+}
@@ -0,0 +1,45 @@
+#include <cstring>
+#include "../include/intern.hpp"
+
+namespace plc {
+
+const char* Interner::store(std::string_view name){
+    if (name.size() > chunk_size){
+        // oversized spellings get a block of their own in front of the bump chunk
+        auto pos = chunks_.empty() ? chunks_.end() : chunks_.end() - 1;
+        char* res = chunks_.emplace(pos, new char[name.size()])->get();
+        std::memcpy(res, name.data(), name.size());
+        return res;
+    }
+    if (chunk_used_ + name.size() > chunk_size){
+        chunks_.emplace_back(new char[chunk_size]);
+        chunk_used_ = 0;
+    }
+    char* res = chunks_.back().get() + chunk_used_;
+    std::memcpy(res, name.data(), name.size());
+    chunk_used_ += name.size();
+    return res;
+}
+
+SymbolId Interner::intern(std::string_view name){
+    if (auto it = ids_.find(name); it != ids_.end()) return it->second;
+    std::string_view stored(store(name), name.size());
+    auto id = static_cast<SymbolId>(strings_.size());
+    strings_.push_back(stored);
+    ids_.emplace(stored, id);
+    return id;
+}
+
+SymbolId Interner::find(std::string_view name) const{
+    if (auto it = ids_.find(name); it != ids_.end()) return it->second;
+    return no_symbol;
+}
+
+void Interner::clear(){
+    if (chunks_.size() > 1) chunks_.erase(chunks_.begin(), chunks_.end() - 1);
+    chunk_used_ = chunks_.empty() ? chunk_size : 0;
+    strings_.clear();
+    ids_.clear();
+}
+
+}
@@ -0,0 +1,180 @@
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <algorithm>
+#include <csetjmp>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <fstream>
+#include "../include/jit.hpp"
+
+namespace plc {
+
+namespace {
+
+CodegenOptions hostCall(CodegenOptions options){
+    options.host_call = true;
+    return options;
+}
+
+// set while this thread runs jitted code: a division by zero or of INT64_MIN
+// by -1, or running into the guard page of its stack, jumps back into run()
+// instead of killing the process
+thread_local sigjmp_buf* fault_jump = nullptr;
+
+// the handlers installed before ours
+struct sigaction previous_fpe{}, previous_segv{};
+
+void onFault(int signal, siginfo_t* info, void* context){
+    if (fault_jump) siglongjmp(*fault_jump, 1);
+    // not ours: pass it on, or fault again with the previous action restored
+    const struct sigaction& previous = signal == SIGFPE ? previous_fpe : previous_segv;
+    if (previous.sa_flags & SA_SIGINFO) previous.sa_sigaction(signal, info, context);
+    else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) previous.sa_handler(signal);
+    else sigaction(signal, &previous, nullptr);
+}
+
+// on the signal stack, since a fault on the program's stack may have used it up
+void installFaultHandler(){
+    static std::once_flag once;
+    std::call_once(once, []{
+        struct sigaction action{};
+        action.sa_sigaction = onFault;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGFPE, &action, &previous_fpe);
+        sigaction(SIGSEGV, &action, &previous_segv);
+    });
+}
+
+// what the program's stack starts with, and where it ends
+struct Launch{
+    void (*program)(int64_t*);
+    int64_t* globals;
+    bool faulted = false;
+    ucontext_t caller{};
+};
+
+thread_local Launch* launch = nullptr;
+
+// runs on the program's stack; a fault unwinds it to here
+void enterProgram(){
+    Launch& l = *launch;
+    sigjmp_buf jump;
+    sigjmp_buf* outer = fault_jump;
+    if (sigsetjmp(jump, 1)) l.faulted = true;
+    else{
+        fault_jump = &jump;
+        l.program(l.globals);
+    }
+    fault_jump = outer;
+}
+
+}
+
+JITLinuxX64::JITLinuxX64(CodegenOptions options):backend_(hostCall(options)){}
+
+JITLinuxX64::~JITLinuxX64(){
+    unload();
+}
+
+void JITLinuxX64::unload(){
+    if (stack_) munmap(stack_, stack_size);
+    stack_ = nullptr;
+    if (code_) munmap(code_, mapped_);
+    code_ = nullptr;
+    mapped_ = 0;
+    code_size_ = 0;
+}
+
+Result<std::string> JITLinuxX64::generate(CompilationContext& ctx){
+    return backend_.generate(ctx);
+}
+
+Result<int> JITLinuxX64::compile(CompilationContext& ctx, const std::string &asmfile, const std::string &, const std::string &){
+    Result<int> res = load(ctx);
+    if (!res.isOk || asmfile.empty()) return res;
+    std::ofstream f(asmfile);
+    backend_.textSection().print(f);
+    if (!f) return Error<int>(ErrorType::IOError);
+    return Ok(0);
+}
+
+Result<int> JITLinuxX64::load(CompilationContext& ctx){
+    unload();
+    Result<int> res = backend_.lower(ctx);
+    if (!res.isOk) return res;
+    ScopedTimer timer(ctx.report, Phase::Encode);
+    Result<MachineCode> code = encodeX86(backend_.textSection().labels);
+    if (!code.isOk) return Error<int>(code);
+    auto start = std::find_if(code->symbols.begin(), code->symbols.end(), [](const auto& symbol){
+        return symbol.first == "_start";
+    });
+    if (start == code->symbols.end()) return Error<int>(ErrorType::SymbolLookupError);
+    entry_ = start->second;
+
+    // written while writable, then flipped to executable: never both at once
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (code->bytes.size() + page - 1) / page * page;
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return Error<int>(ErrorType::IOError);
+    std::memcpy(p, code->bytes.data(), code->bytes.size());
+    if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0){
+        munmap(p, size);
+        return Error<int>(ErrorType::IOError);
+    }
+    code_ = p;
+    mapped_ = size;
+    code_size_ = code->bytes.size();
+    globals_.assign(std::max<size_t>(1, ctx.ast.symbols.scope(0).vars), 0);
+    return Ok(0);
+}
+
+Result<int> JITLinuxX64::run(){
+    if (!code_) return Error<int>(ErrorType::Empty);
+    std::fill(globals_.begin(), globals_.end(), 0);
+    if (!stack_){
+        // only the pages a run touches are backed; the lowest one stays a guard
+        void* p = mmap(nullptr, stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (p == MAP_FAILED) return Error<int>(ErrorType::IOError);
+        if (mprotect(p, static_cast<size_t>(sysconf(_SC_PAGESIZE)), PROT_NONE) != 0){
+            munmap(p, stack_size);
+            return Error<int>(ErrorType::IOError);
+        }
+        stack_ = p;
+        signal_stack_.resize(std::max<size_t>(SIGSTKSZ, 64 << 10));
+    }
+    installFaultHandler();
+    stack_t alternate{}, outer_alternate{};
+    alternate.ss_sp = signal_stack_.data();
+    alternate.ss_size = signal_stack_.size();
+    if (sigaltstack(&alternate, &outer_alternate) != 0) return Error<int>(ErrorType::IOError);
+
+    Launch l{reinterpret_cast<void (*)(int64_t*)>(static_cast<uint8_t*>(code_) + entry_), globals_.data()};
+    ucontext_t program;
+    getcontext(&program);
+    program.uc_stack.ss_sp = stack_;
+    program.uc_stack.ss_size = stack_size;
+    program.uc_link = &l.caller;
+    makecontext(&program, enterProgram, 0);
+    Launch* outer = launch;
+    launch = &l;
+    swapcontext(&l.caller, &program);
+    launch = outer;
+    sigaltstack(&outer_alternate, nullptr);
+    if (l.faulted) return Error<int>(ErrorType::RuntimeError);
+    return Ok(0);
+}
+
+Result<int64_t> JITLinuxX64::global(const CompilationContext& ctx, std::string_view name) const{
+    SymbolId id = ctx.interner.find(name);
+    const SymbolTable& symbols = ctx.ast.symbols;
+    for (SymbolIndex n = 0; id != no_symbol && n < symbols.size(); n++){
+        const SymbolInfo& sym = symbols[n];
+        if (sym.name == id && sym.kind == IdentType::VarIdent && sym.scope == 0 && sym.origin == no_symbol_index) return Ok(globals_[sym.slot]);
+    }
+    return Error<int64_t>(ErrorType::SymbolLookupError);
+}
+
+}
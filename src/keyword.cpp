@@ -4,11 +4,81 @@
 
 namespace plc {
 
-Token::Token(TokenType type, std::string value): type_(type), value_(std::move(value)){}
+namespace {
 
-KeyWordInterpreter::KeyWordInterpreter(const std::vector<std::pair<TokenType, std::string>> &keyword_regex_pair): keyword_regex_pair_(keyword_regex_pair){}
+struct Spelling{
+    std::string_view text;
+    TokenKind kind;
+};
 
-KeyWordInterpreter::KeyWordInterpreter(){
+constexpr Spelling keyword_spellings[] = {
+    {"begin", TokenKind::Begin}, {"end", TokenKind::End}, {"if", TokenKind::If}, {"then", TokenKind::Then},
+    {"while", TokenKind::While}, {"do", TokenKind::Do}, {"procedure", TokenKind::Procedure}, {"call", TokenKind::Call},
+    {"const", TokenKind::Const}, {"var", TokenKind::Var}, {"odd", TokenKind::Odd},
+};
+
+constexpr Spelling symbol_spellings[] = {
+    {":=", TokenKind::Becomes}, {".", TokenKind::Period}, {";", TokenKind::Semicolon}, {",", TokenKind::Comma},
+    {"(", TokenKind::LParen}, {")", TokenKind::RParen}, {"=", TokenKind::Equal}, {"#", TokenKind::Hash},
+    {"<", TokenKind::Less}, {"<=", TokenKind::LessEqual}, {">", TokenKind::Greater}, {">=", TokenKind::GreaterEqual},
+    {"<>", TokenKind::NotEqual}, {"+", TokenKind::Plus}, {"-", TokenKind::Minus}, {"*", TokenKind::Times},
+    {"/", TokenKind::Slash},
+};
+
+}
+
+TokenKind keywordKind(std::string_view word){
+    for (const Spelling& s : keyword_spellings){
+        if (s.text == word) return s.kind;
+    }
+    return TokenKind::Identifier;
+}
+
+TokenKind symbolKind(std::string_view word){
+    for (const Spelling& s : symbol_spellings){
+        if (s.text == word) return s.kind;
+    }
+    return TokenKind::EndOfFile;
+}
+
+std::string_view kindSpelling(TokenKind kind){
+    for (const Spelling& s : keyword_spellings){
+        if (s.kind == kind) return s.text;
+    }
+    for (const Spelling& s : symbol_spellings){
+        if (s.kind == kind) return s.text;
+    }
+    switch (kind){
+        case TokenKind::Identifier: return "identifier";
+        case TokenKind::Literal: return "literal";
+        default: return "eof";
+    }
+}
+
+Token::Token(TokenType type, std::string_view value): type_(type), value_(value){
+    switch (type){
+        case TokenType::Keyword: kind_ = keywordKind(value); break;
+        case TokenType::Identifier: kind_ = TokenKind::Identifier; break;
+        case TokenType::Literal: kind_ = TokenKind::Literal; break;
+        case TokenType::Delimiter:
+        case TokenType::Operator: kind_ = symbolKind(value); break;
+        case TokenType::EndOfFile: kind_ = TokenKind::EndOfFile; break;
+    }
+}
+
+Token::Token(TokenType type, TokenKind kind, SymbolId id, std::string_view value, uint32_t line, uint32_t column):
+    type_(type), kind_(kind), id_(id), value_(value), line_(line), column_(column){}
+
+TokenList::TokenList(std::shared_ptr<const SourceBuffer> source, std::vector<Token> tokens): source(std::move(source)), tokens(std::move(tokens)){}
+
+KeyWordInterpreter::KeyWordInterpreter(const std::vector<std::pair<TokenType, std::string>> &keyword_regex_pair, Interner &interner):
+    keyword_regex_pair_(keyword_regex_pair), mode_(LexerMode::Regex), interner_(&interner){}
+
+KeyWordInterpreter::KeyWordInterpreter(LexerMode mode, Interner &interner): KeyWordInterpreter(interner){
+    mode_ = mode;
+}
+
+KeyWordInterpreter::KeyWordInterpreter(Interner &interner): interner_(&interner){
     keyword_regex_pair_ = std::vector<std::pair<TokenType, std::string>>();
     keyword_regex_pair_.emplace_back(TokenType::Keyword, "(begin)|(end)|(if)|(then)|(while)|(do)|(procedure)|(call)|(const)|(var)|(odd)");
     keyword_regex_pair_.emplace_back(TokenType::Delimiter, ":=|\\.|;|,|\\(|\\)");
@@ -73,7 +143,6 @@ Result<std::string> KeyWordInterpreter::splitString(const std::string &input) no
         res = std::regex_replace(res,patten,"$1=");
         patten = std::regex("< >");
         res = std::regex_replace(res,patten,"<>");
-        std::cout<<res<<std::endl;
 
         return Ok(res);
     }catch (std::regex_error& e){
@@ -81,26 +150,180 @@ Result<std::string> KeyWordInterpreter::splitString(const std::string &input) no
     }
 }
 
-Result<std::vector<Token>> KeyWordInterpreter::interpretString(const std::string &input) const noexcept{
-    Result<std::string> spl = splitString(input);
-    if (!spl.isOk) {return Error<std::vector<Token>>(spl);}
-    std::stringstream stream(spl.unwrap());
-    std::string w;
+namespace {
+
+enum class CharClass : unsigned char{
+    Invalid,
+    Space,
+    Letter,
+    Digit,
+    Underscore,
+    Single,     // . ; , ( ) = + - * / #
+    Colon,
+    Less,
+    Greater,
+};
+
+struct CharTable{
+    CharClass cls[256]{};
+    constexpr CharTable(){
+        for (int c = 'a'; c <= 'z'; c++) cls[c] = CharClass::Letter;
+        for (int c = 'A'; c <= 'Z'; c++) cls[c] = CharClass::Letter;
+        for (int c = '0'; c <= '9'; c++) cls[c] = CharClass::Digit;
+        cls[static_cast<unsigned char>('_')] = CharClass::Underscore;
+        for (char c : {' ', '\t', '\n', '\r', '\v', '\f'}) cls[static_cast<unsigned char>(c)] = CharClass::Space;
+        for (char c : {'.', ';', ',', '(', ')', '=', '+', '-', '*', '/', '#'}) cls[static_cast<unsigned char>(c)] = CharClass::Single;
+        cls[static_cast<unsigned char>(':')] = CharClass::Colon;
+        cls[static_cast<unsigned char>('<')] = CharClass::Less;
+        cls[static_cast<unsigned char>('>')] = CharClass::Greater;
+    }
+};
+
+constexpr CharTable char_table;
+
+inline CharClass classOf(char c){
+    return char_table.cls[static_cast<unsigned char>(c)];
+}
+
+inline bool isWordChar(CharClass c){
+    return c == CharClass::Letter || c == CharClass::Digit || c == CharClass::Underscore;
+}
+
+TokenKind keywordKindOf(const char* p, size_t len){
+    // cheap reject before the table scan: every keyword is 2..9 lowercase letters
+    if (len < 2 || len > 9 || *p < 'b' || *p > 'w') return TokenKind::Identifier;
+    return keywordKind(std::string_view(p, len));
+}
+
+TokenType classifySingle(char c){
+    switch (c){
+        case '.': case ';': case ',': case '(': case ')':
+            return TokenType::Delimiter;
+        default:
+            return TokenType::Operator;
+    }
+}
+
+}
+
+Result<TokenList> KeyWordInterpreter::scanSource(const std::shared_ptr<const SourceBuffer> &source, Interner &interner) noexcept{
+    std::string_view input = source->view();
     std::vector<Token> res;
-    while (stream >> w){
-        Result<Token> token_res = interpret(w);
-        if (!token_res.isOk) return Error<std::vector<Token>>(token_res);
-        res.emplace_back(*token_res);
+    const char* p = input.data();
+    const char* end = p + input.size();
+    const char* line_start = p;
+    uint32_t line = 1;
+    while (p != end){
+        const char* start = p;
+        auto column = static_cast<uint32_t>(start - line_start + 1);
+        switch (classOf(*p)){
+            case CharClass::Space:
+                if (*p == '\n'){
+                    line++;
+                    line_start = p + 1;
+                }
+                p++;
+                continue;
+            case CharClass::Letter:{
+                while (p != end && isWordChar(classOf(*p))) p++;
+                std::string_view word(start, p - start);
+                TokenKind kind = keywordKindOf(start, word.size());
+                if (kind == TokenKind::Identifier){
+                    res.emplace_back(TokenType::Identifier, kind, interner.intern(word), word, line, column);
+                }else{
+                    res.emplace_back(TokenType::Keyword, kind, no_symbol, word, line, column);
+                }
+                continue;
+            }
+            case CharClass::Digit:{
+                bool leading_zero = (*p == '0');
+                p++;
+                while (p != end && classOf(*p) == CharClass::Digit) p++;
+                if (p != end && isWordChar(classOf(*p))) return Error<TokenList>(ErrorType::InvalidSyntax);
+                if (leading_zero && p - start > 1) return Error<TokenList>(ErrorType::InvalidSyntax);
+                res.emplace_back(TokenType::Literal, TokenKind::Literal, no_symbol, std::string_view(start, p - start), line, column);
+                continue;
+            }
+            case CharClass::Single:
+                p++;
+                res.emplace_back(classifySingle(*start), symbolKind(std::string_view(start, 1)), no_symbol, std::string_view(start, 1), line, column);
+                continue;
+            case CharClass::Colon:
+                p++;
+                if (p == end || *p != '=') return Error<TokenList>(ErrorType::InvalidSyntax);
+                p++;
+                res.emplace_back(TokenType::Delimiter, TokenKind::Becomes, no_symbol, std::string_view(start, 2), line, column);
+                continue;
+            case CharClass::Less:{
+                p++;
+                TokenKind kind = TokenKind::Less;
+                if (p != end && *p == '=') kind = TokenKind::LessEqual;
+                else if (p != end && *p == '>') kind = TokenKind::NotEqual;
+                if (kind != TokenKind::Less) p++;
+                res.emplace_back(TokenType::Operator, kind, no_symbol, std::string_view(start, p - start), line, column);
+                continue;
+            }
+            case CharClass::Greater:{
+                p++;
+                TokenKind kind = TokenKind::Greater;
+                if (p != end && *p == '='){
+                    kind = TokenKind::GreaterEqual;
+                    p++;
+                }
+                res.emplace_back(TokenType::Operator, kind, no_symbol, std::string_view(start, p - start), line, column);
+                continue;
+            }
+            case CharClass::Underscore:
+            case CharClass::Invalid:
+                return Error<TokenList>(ErrorType::InvalidSyntax);
+        }
     }
-    return Ok(res);
+    return Ok(TokenList(source, std::move(res)));
+}
+
+Result<TokenList> KeyWordInterpreter::interpretSource(const std::shared_ptr<const SourceBuffer> &source) const noexcept{
+    if (mode_ == LexerMode::DFA) return scanSource(source, *interner_);
+    return interpretSourceRegex(source);
+}
+
+Result<TokenList> KeyWordInterpreter::interpretSourceRegex(const std::shared_ptr<const SourceBuffer> &source) const noexcept{
+    Result<std::string> spl = splitString(std::string(source->view()));
+    if (!spl.isOk) {return Error<TokenList>(spl);}
+    std::shared_ptr<const SourceBuffer> split = SourceBuffer::fromString(spl.unwrap());
+    std::string_view text = split->view();
+    std::vector<Token> res;
+    uint32_t line = 1;
+    size_t line_start = 0;
+    size_t i = 0;
+    while (i < text.size()){
+        if (std::isspace(static_cast<unsigned char>(text[i]))){
+            if (text[i] == '\n'){
+                line++;
+                line_start = i + 1;
+            }
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < text.size() && !std::isspace(static_cast<unsigned char>(text[i]))) i++;
+        std::string_view w = text.substr(start, i - start);
+        Result<Token> token_res = interpret(std::string(w));
+        if (!token_res.isOk) return Error<TokenList>(token_res);
+        const Token& t = token_res.unwrap();
+        SymbolId id = t.type_ == TokenType::Identifier ? interner_->intern(w) : no_symbol;
+        res.emplace_back(t.type_, t.kind_, id, w, line, static_cast<uint32_t>(start - line_start + 1));
+    }
+    return Ok(TokenList(split, std::move(res)));
+}
+
+Result<TokenList> KeyWordInterpreter::interpretString(const std::string &input) const noexcept{
+    return interpretSource(SourceBuffer::fromString(input));
 }
 
-Result<std::vector<Token>> KeyWordInterpreter::interpretFile(const std::string &filename) const noexcept{
-    std::ifstream f(filename);
-    if (!f) return Result<std::vector<Token>>(ErrorType::IOError);
-    std::stringstream stream;
-    stream << f.rdbuf();
-    return interpretString(stream.str());
+Result<TokenList> KeyWordInterpreter::interpretFile(const std::string &filename) const noexcept{
+    Result<std::shared_ptr<const SourceBuffer>> source = SourceBuffer::fromFile(filename);
+    if (!source.isOk) return Error<TokenList>(source);
+    return interpretSource(source.unwrap());
 }
 
 bool Token::operator==(const Token &other) const{
@@ -132,6 +355,6 @@ Token::operator std::string() const {
                 type_str = "Unknown";
                 break;
         }
-        return type_str+"(" + value_ + ")";
+        return type_str+"(" + std::string(value_) + ")";
     }
 }
\ No newline at end of file
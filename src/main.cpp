@@ -1,34 +1,21 @@
+#include <iomanip>
 #include <iostream>
-#include <grammar.hpp>
-#include <asm.hpp>
+#include <driver.hpp>
 
-int main() {
+int main(int argc, char** argv) {
     using namespace plc;
-    KeyWordInterpreter k;
-    Result<std::vector<Token>> res = k.interpretFile("../resource/example.pl0");
-
-    std::cout<<(std::string)res<<std::endl;
-    for (const Token & word : *res){
-        std::cout<<((std::string)(word));
-        std::cout<<' ';
-    }
-    std::cout<<std::endl;
-
-    GrammarInterpreter g(*res, "../output/example-log.txt");
-    Result<std::pair<size_t,AST>> res2 = g.interpretProgram(0);
-    std::cout<<std::endl<<(std::string)res2<<std::endl;
-
-    std::pair<size_t,AST> pair = res2.unwrap();
-    AST ast = pair.second;
-    auto res3 = ast.getQuaternary();
-    std::cout<<(std::string)ast.output("../output/example-code.txt")<<std::endl;
-
-    std::cout<<std::endl;
-
-    NASMLinuxELF64 compiler;
-    Result<int> res5 = compiler.compile(ast,"../output/example-code.asm");
-    std::cout<<(std::string)res5<<std::endl;
-
-
-    return 0;
-}
\ No newline at end of file
+    Result<DriverOptions> options = parseArguments(argc, argv, std::cerr);
+    if (!options.isOk) return 2;
+
+    BatchStats stats = compileBatch(*options, std::cerr);
+
+    double seconds = std::max(stats.seconds, 1e-9);
+    std::cerr << "plc: " << stats.files << " file(s), " << stats.failed << " failed, "
+              << std::fixed << std::setprecision(3) << stats.seconds << " s, "
+              << std::setprecision(1) << stats.files / seconds << " files/s, "
+              << std::setprecision(2) << stats.bytes / seconds / (1024.0 * 1024.0) << " MB/s"
+              << " (" << options->jobs << " jobs)" << std::endl;
+    if (options->time_report == TimeReportFormat::Text) stats.report.print(std::cerr);
+    else if (options->time_report == TimeReportFormat::JSON) stats.report.printJSON(std::cout);
+    return stats.failed ? 1 : 0;
+}
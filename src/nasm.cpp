@@ -1,11 +1,22 @@
 #include "../include/asm.hpp"
+#include "../include/elf.hpp"
+#include "../include/strength.hpp"
+#include "../include/threadpool.hpp"
 namespace plc{
 
-NASMLinuxELF64::NASMLinuxELF64():text(".text"),bss(".bss"),data(".data"),temp_label_ptr(0){
+NASMLinuxELF64::NASMLinuxELF64(CodegenOptions options):text(".text"),bss(".bss"),data(".data"),temp_label_ptr(0),options_(options){
     text.labels.emplace_back("_start");
     text.lines.emplace_back("global _start");
 }
 
+// mov between two stack slots, or of a 64-bit immediate to one, has to go through rax
+void NASMLinuxELF64::store(size_t label_ptr, const Operand& dst, const Operand& src){
+    if (dst.isMem() && (src.isMem() || (src.isImm() && !src.isImm32()))){
+        text.addLine(label_ptr, Instruction(Opcode::Mov, reg(Reg::rax), src));
+        text.addLine(label_ptr, Instruction(Opcode::Mov, dst, reg(Reg::rax)));
+    }else text.addLine(label_ptr, Instruction(Opcode::Mov, dst, src));
+}
+
 std::string NASMLinuxELF64::addTempLabelName(){
     return "_temp_label"+std::to_string(temp_label_ptr++);
 }
@@ -14,220 +25,478 @@ std::string NASMLinuxELF64::getCurrentTempLabelName(){
     return "_temp_label"+std::to_string(temp_label_ptr-1);
 }
 
-Result<int> NASMLinuxELF64::generate(const AST& input, Scope& s){
-    const std::string& name = input.name;
-    if (name == "Var"){
-        text.addLine(s.label_ptr, "sub rsp,"+std::to_string(8*input.children.size()));
-        for (const auto & i : input.children){
-            s.addVar(i.name);
-        }
-    }else if (name == "Const"){
-        for (size_t i=0;i<input.children.size();i+=2){
-            s.addConst(input.children[i].name,std::stoi(input.children[i+1].name));
-        }
-    }else if (name == "Assign"){
-        Result<std::string> lvalue_str = s.findVar(input.children[0].name);
-        if (!lvalue_str.isOk) return Error<int>(lvalue_str);
-        std::string rvalue = input.children[1].name;
-        if (rvalue == "Calc"){
-            Result<int> res = generate(input.children[1], s);
+void NASMLinuxELF64::assignProcedureLabels(const AST& ast){
+    const SymbolTable& symbols = ast.symbols;
+    std::vector<std::string>& procedure_labels = own_plan_.procedure_labels;
+    procedure_labels.assign(symbols.size(), std::string());
+    std::unordered_map<std::string_view, size_t> seen;
+    for (SymbolIndex i = 0; i < symbols.size(); i++){
+        if (symbols[i].kind != IdentType::ProcedureIdent) continue;
+        std::string_view name = ast.interner->str(symbols[i].name);
+        size_t count = seen[name]++;
+        procedure_labels[i] = std::string(name);
+        // procedures in different scopes may share a name, labels may not
+        if (count) procedure_labels[i] += "_" + std::to_string(i);
+    }
+}
+
+// Mirrors the allocation order of generate(): While and Condition take a
+// temp label when they are entered, procedures open their label when visited.
+void NASMLinuxELF64::planJobs(const AST& ast, NodeId n, int& temp_labels){
+    NodeKind kind = ast.kind(n);
+    size_t job = own_plan_.jobs.size();
+    if (kind == NodeKind::Procedure){
+        own_plan_.job_of_node.emplace(n, job);
+        own_plan_.jobs.push_back(CodegenJob{n, temp_labels, 0});
+    }
+    if (kind == NodeKind::While || kind == NodeKind::Condition) temp_labels++;
+    // expressions hold neither
+    if (kind == NodeKind::Condition || kind == NodeKind::Calc) return;
+    for (NodeId child : ast.children(n)) planJobs(ast, child, temp_labels);
+    if (kind == NodeKind::Procedure){
+        own_plan_.jobs[job].temp_label_count = temp_labels - own_plan_.jobs[job].temp_label_base;
+    }
+}
+
+// Variables of enclosing procedures are reached through a scratch register:
+// rcx for the one an Assign writes or a Condition's left side, rdx for
+// everything else, so the Calc in between leaves the first one alone.
+Result<int> NASMLinuxELF64::generate(const AST& ast, NodeId input, Scope& s){
+    ChildRange ch = ast.children(input);
+    std::vector<Instruction>& lines = text.labels[s.label_ptr].lines;
+    switch (ast.kind(input)){
+    case NodeKind::Var:
+    case NodeKind::Const:
+        break;
+    case NodeKind::Assign:{
+        Result<Operand> lvalue = s.findVar(ast.symbol(ch[0]), lines, Reg::rcx);
+        if (!lvalue.isOk) return Error<int>(lvalue);
+        NodeId rvalue = ch[1];
+        if (ast.kind(rvalue) == NodeKind::Calc){
+            Result<int> res = generate(ast, rvalue, s);
             if (!res.isOk) return res;
-            text.addLine(s.label_ptr, "mov qword"+*lvalue_str+",rax");
+            store(s.label_ptr, *lvalue, reg(Reg::rax));
             return Ok(0);
         }
-        Result<std::string> rvalue_str = s.findRValue(rvalue);
-        if (!rvalue_str.isOk) return Error<int>(rvalue_str);
-
-        if ((*rvalue_str)[0]=='['){
-            text.addLine(s.label_ptr, "mov rax,"+*rvalue_str);
-            text.addLine(s.label_ptr, "mov qword"+*lvalue_str+",rax");
-        }else{
-            text.addLine(s.label_ptr, "mov qword"+*lvalue_str+","+*rvalue_str);
-        }
-    }else if (name == "Program"){
-        for (const AST& child : input.children){
-            Result<int> res = generate(child, s);
+        Result<Operand> value = s.findRValue(ast, rvalue, lines, Reg::rdx);
+        if (!value.isOk) return Error<int>(value);
+        store(s.label_ptr, *lvalue, *value);
+        break;
+    }
+    case NodeKind::Program:
+        for (NodeId child : ch){
+            Result<int> res = generate(ast, child, s);
             if (!res.isOk) return res;
         }
-        text.addFreeScopeLine(s);
-        text.addLine(s.label_ptr, "mov rax,60");
-        text.addLine(s.label_ptr, "xor rdi,rdi");
-        text.addLine(s.label_ptr, "syscall");
-    }else if (name == "Block"){
-        Scope scope(&s);
-        for (const AST& child : input.children){
-            Result<int> res = generate(child, scope);
-            if (!res.isOk) return res;
+        if (options_.host_call){
+            for (auto r = host_saved_registers.rbegin(); r != host_saved_registers.rend(); ++r){
+                text.addLine(s.label_ptr, Instruction(Opcode::Pop, reg(*r)));
+            }
+            text.addLine(s.label_ptr, Instruction(Opcode::Ret));
+            break;
         }
-        text.addFreeScopeLine(scope);
-    }else if (name == "Sequence"){
-        for (const AST& child : input.children){
-            Result<int> res = generate(child, s);
+        text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rax), imm(60)));
+        text.addLine(s.label_ptr, Instruction(Opcode::Xor, reg(Reg::rdi), reg(Reg::rdi)));
+        text.addLine(s.label_ptr, Instruction(Opcode::Syscall));
+        break;
+    case NodeKind::Block:{
+        Scope scope(ast.symbols, ast[input].value, s.label_ptr, s.links, s.registers, s.globals_base);
+        for (NodeId child : ch){
+            Result<int> res = generate(ast, child, scope);
             if (!res.isOk) return res;
         }
-    }else if (name == "Procedure"){
-        Scope scope(&s, text.labels.size());
-        scope.addVar("ret");
-        text.labels.emplace_back(input.children[0].name);
-        for (size_t i = 1; i < input.children.size(); i++){
-            const AST& child = input.children[i];
-            Result<int> res = generate(child, scope);
+        break;
+    }
+    case NodeKind::Sequence:
+        for (NodeId child : ch){
+            Result<int> res = generate(ast, child, s);
             if (!res.isOk) return res;
         }
-        text.addFreeScopeLine(scope);
-        text.addLine(scope.label_ptr, "ret");
-    }else if (name == "Call"){
-        if (std::find(text.labels.begin(), text.labels.end(), input.children[0].name) == text.labels.end()){
+        break;
+    case NodeKind::EmptyStatement:
+        break;
+    case NodeKind::Procedure:{
+        // the body is a job of its own, only skip past its temp labels here
+        auto job = plan_->job_of_node.find(input);
+        if (job == plan_->job_of_node.end()) return Error<int>(ErrorType::CompileError);
+        temp_label_ptr += plan_->jobs[job->second].temp_label_count;
+        break;
+    }
+    case NodeKind::Call:{
+        SymbolIndex proc = ast.symbol(ch[0]);
+        const std::vector<std::string>& procedure_labels = plan_->procedure_labels;
+        if (proc >= procedure_labels.size() || procedure_labels[proc].empty()){
             return Error<int>(ErrorType::SymbolLookupError);
         }
-        text.addLine(s.label_ptr, "call "+input.children[0].name);
-    }else if (name == "Condition"){
+        passFrame(lines, s.links, s.depth, ast.symbols[proc].depth);
+        text.addLine(s.label_ptr, Instruction(Opcode::Call, procedure_labels[proc]));
+        break;
+    }
+    case NodeKind::Condition:{
         std::string label_name = addTempLabelName();
-        if (input.children[0].name == "odd"){
-            if (input.children[1].name=="Calc"){
-                Result<int> res = generate(input.children[1], s);
+        if (ast.isOperator(ch[0], TokenKind::Odd)){
+            if (ast.kind(ch[1]) == NodeKind::Calc){
+                Result<int> res = generate(ast, ch[1], s);
                 if (!res.isOk) return res;
-                text.addLine(s.label_ptr, "test rax,1");
-                text.addLine(s.label_ptr, "jz "+label_name);
             }else{
-                Result<std::string> value = s.findRValue(input.children[1].name);
+                Result<Operand> value = s.findRValue(ast, ch[1], lines, Reg::rdx);
                 if (!value.isOk) return Error<int>(value);
-                text.addLine(s.label_ptr, "mov rax,"+*value);
-                text.addLine(s.label_ptr, "test rax,1");
-                text.addLine(s.label_ptr, "jz "+label_name);
+                // a literal's parity is known: fall into the body or skip it
+                if (value->isImm()){
+                    if (!(value->value & 1)) text.addLine(s.label_ptr, Instruction(Opcode::Jmp, label_name));
+                    break;
+                }
+                text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rax), *value));
             }
+            text.addLine(s.label_ptr, Instruction(Opcode::Test, reg(Reg::rax), imm(1)));
+            text.addLine(s.label_ptr, Instruction(Opcode::Jz, label_name));
         }else{
-            std::string jump;
-            const std::string& cmp = input.children[1].name;
-            if (cmp == "<>") jump = "je";
-            else if (cmp == ">=") jump = "jl";
-            else if (cmp == "<=") jump = "jg";
-            else if (cmp == ">") jump = "jle";
-            else if (cmp == "<") jump = "jge";
-            else if (cmp == "=") jump = "jne";
-
-            std::string lvalue,rvalue;
-            if (input.children[0].name=="Calc"){
-                Result<int> res = generate(input.children[0], s);
+            // jump to the exit label when the condition does not hold
+            Opcode jump;
+            switch (ast.op(ch[1])){
+                case TokenKind::NotEqual: jump = Opcode::Je; break;
+                case TokenKind::GreaterEqual: jump = Opcode::Jl; break;
+                case TokenKind::LessEqual: jump = Opcode::Jg; break;
+                case TokenKind::Greater: jump = Opcode::Jle; break;
+                case TokenKind::Less: jump = Opcode::Jge; break;
+                case TokenKind::Equal: jump = Opcode::Jne; break;
+                case TokenKind::Hash: jump = Opcode::Je; break;
+                default: return Error<int>(ErrorType::CompileError);
+            }
+
+            Operand lvalue, rvalue;
+            if (ast.kind(ch[0]) == NodeKind::Calc){
+                Result<int> res = generate(ast, ch[0], s);
                 if (!res.isOk) return res;
-                lvalue = "rax";
+                lvalue = reg(Reg::rax);
             }else{
-                Result<std::string> lvalue_res = s.findRValue(input.children[0].name);
+                Result<Operand> lvalue_res = s.findRValue(ast, ch[0], lines, Reg::rcx);
                 if (!lvalue_res.isOk) return Error<int>(lvalue_res);
                 lvalue = *lvalue_res;
             }
-            if (input.children[2].name=="Calc"){
-                if (lvalue == "rax"){
-                    text.addLine(s.label_ptr, "mov rbx,"+lvalue);
-                    lvalue = "rbx";
+            if (ast.kind(ch[2]) == NodeKind::Calc){
+                if (lvalue.isReg(Reg::rax)){
+                    // rbx and rdx are clobbered by the Calc below
+                    text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rcx), lvalue));
+                    lvalue = reg(Reg::rcx);
                 }
-                Result<int> res = generate(input.children[0], s);
+                Result<int> res = generate(ast, ch[2], s);
                 if (!res.isOk) return res;
-                rvalue = "rax";
+                rvalue = reg(Reg::rax);
             }else{
-                Result<std::string> rvalue_res= s.findRValue(input.children[2].name);
+                Result<Operand> rvalue_res = s.findRValue(ast, ch[2], lines, Reg::rdx);
                 if (!rvalue_res.isOk) return Error<int>(rvalue_res);
                 rvalue = *rvalue_res;
+                if (rvalue.isImm() && !rvalue.isImm32()){
+                    text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rdx), rvalue));
+                    rvalue = reg(Reg::rdx);
+                }
             }
 
-            if (lvalue[0]=='[' && rvalue[0]=='['){
-                text.addLine(s.label_ptr, "mov rax,"+lvalue);
-                text.addLine(s.label_ptr, "cmp rax,"+rvalue);
-            }else if (lvalue[0]=='['){
-                text.addLine(s.label_ptr, "cmp qword"+lvalue+","+rvalue);
-            }else text.addLine(s.label_ptr, "cmp "+lvalue+","+rvalue);
-            text.addLine(s.label_ptr, jump+" "+label_name);
+            if (lvalue.isMem() && rvalue.isMem()){
+                text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rax), lvalue));
+                text.addLine(s.label_ptr, Instruction(Opcode::Cmp, reg(Reg::rax), rvalue));
+            }else if (lvalue.isImm()){
+                // immediate on the left: cmp needs a register or memory first operand
+                text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rbx), lvalue));
+                text.addLine(s.label_ptr, Instruction(Opcode::Cmp, reg(Reg::rbx), rvalue));
+            }else text.addLine(s.label_ptr, Instruction(Opcode::Cmp, lvalue, rvalue));
+            text.addLine(s.label_ptr, Instruction(jump, label_name));
         }
-    }else if (name == "If"){
-        if (input.children[0].name != "Condition") return Error<int>(ErrorType::CompileError);
-        Result<int> res = generate(input.children[0], s);
+        break;
+    }
+    case NodeKind::If:{
+        if (ast.kind(ch[0]) != NodeKind::Condition) return Error<int>(ErrorType::CompileError);
+        Result<int> res = generate(ast, ch[0], s);
         if (!res.isOk) return res;
         std::string exit_label_name = getCurrentTempLabelName();
 
-        Scope scope(&s);
-        for (size_t i=1; i<input.children.size(); i++){
-            const AST& child = input.children[i];
-            Result<int> res = generate(child, scope);
-            if (!res.isOk) return res;
-        }
-        text.addFreeScopeLine(scope);
-        text.addLine(s.label_ptr, exit_label_name + ":");
-    }else if (name == "While"){
+        res = generate(ast, ch[1], s);
+        if (!res.isOk) return res;
+        text.addLine(s.label_ptr, Instruction(Opcode::Label, exit_label_name));
+        break;
+    }
+    case NodeKind::While:{
         std::string loop_label_name = addTempLabelName();
-        text.addLine(s.label_ptr, loop_label_name + ":");
-        
-        if (input.children[0].name != "Condition") return Error<int>(ErrorType::CompileError);
-        Result<int> res = generate(input.children[0], s);
+        text.addLine(s.label_ptr, Instruction(Opcode::Label, loop_label_name));
+
+        if (ast.kind(ch[0]) != NodeKind::Condition) return Error<int>(ErrorType::CompileError);
+        Result<int> res = generate(ast, ch[0], s);
         if (!res.isOk) return res;
         std::string exit_label_name = getCurrentTempLabelName();
 
-        Scope scope(&s);
-        for (size_t i=1; i<input.children.size(); i++){
-            const AST& child = input.children[i];
-            Result<int> res = generate(child, scope);
-            if (!res.isOk) return res;
+        res = generate(ast, ch[1], s);
+        if (!res.isOk) return res;
+
+        text.addLine(s.label_ptr, Instruction(Opcode::Jmp, loop_label_name));
+        text.addLine(s.label_ptr, Instruction(Opcode::Label, exit_label_name));
+        break;
+    }
+    case NodeKind::Calc:
+        return generateCalc(ast, input, s);
+    default:
+        return Error<int>(ErrorType::InvalidSyntax);
+    }
+    return Ok(0);
+}
+
+// Into rax; a leading sign starts from 0, a nested Calc is evaluated with
+// the running value saved on the stack and then taken from rbx. Parentheses
+// nest without limit, so the open Calcs are kept in frames, not recursion.
+Result<int> NASMLinuxELF64::generateCalc(const AST& ast, NodeId calc, Scope& s){
+    std::vector<Instruction>& lines = text.labels[s.label_ptr].lines;
+    auto apply = [&](TokenKind op, Operand value) -> Result<int>{
+        if ((op == TokenKind::Plus || op == TokenKind::Minus) && value.isImm() && !value.isImm32()){
+            text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rbx), value));
+            value = reg(Reg::rbx);
         }
-        text.addFreeScopeLine(scope);
-        
-        text.addLine(s.label_ptr, "jmp "+loop_label_name);
-        text.addLine(s.label_ptr, exit_label_name + ":");
-    }else if (name == "Calc"){
-        if (input.children.size() <3) return Error<int>(ErrorType::CompileError);
-        Result<std::string> first_value = s.findRValue(input.children[0].name);
-        if (!first_value.isOk) return Error<int>(first_value);
-        text.addLine(s.label_ptr, "mov rax,"+*first_value);
-
-        for (size_t i=1; i<input.children.size(); i+=2){
-            const std::string& operand = input.children[i].name;
-            Result<std::string> value = s.findRValue(input.children[i+1].name);
-            if (!value.isOk) return Error<int>(value);
-
-            if (operand=="+"){
-                text.addLine(s.label_ptr, "add rax,"+*value);
-            }else if (operand=="-"){
-                text.addLine(s.label_ptr, "sub rax,"+*value);
-            }else if (operand=="*"){
-                text.addLine(s.label_ptr, "mov rbx,"+*value);
-                text.addLine(s.label_ptr, "imul rbx");
-            }else if (operand=="/"){
-                text.addLine(s.label_ptr, "mov rbx,"+*value);
-                text.addLine(s.label_ptr, "idiv rbx");
+        if (op==TokenKind::Plus){
+            text.addLine(s.label_ptr, Instruction(Opcode::Add, reg(Reg::rax), value));
+        }else if (op==TokenKind::Minus){
+            text.addLine(s.label_ptr, Instruction(Opcode::Sub, reg(Reg::rax), value));
+        }else if (op==TokenKind::Times){
+            if (options_.strength_reduce && value.isImm()){
+                multiplyByConstant(lines, Reg::rax, value.value, Reg::rbx);
+                return Ok(0);
             }
+            if (!value.isReg(Reg::rbx)) text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rbx), value));
+            text.addLine(s.label_ptr, Instruction(Opcode::Imul, reg(Reg::rbx)));
+        }else if (op==TokenKind::Slash){
+            if (options_.strength_reduce && value.isImm() && divideByConstant(lines, value.value)) return Ok(0);
+            if (!value.isReg(Reg::rbx)) text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rbx), value));
+            text.addLine(s.label_ptr, Instruction(Opcode::Cqo));
+            text.addLine(s.label_ptr, Instruction(Opcode::Idiv, reg(Reg::rbx)));
+        }else return Error<int>(ErrorType::CompileError);
+        return Ok(0);
+    };
+    struct Frame{
+        NodeId node;
+        size_t next;        // the operator before the next operand, once opened
+        bool opened;
+        bool operand;       // an operand of the frame below, not its first value
+    };
+    std::vector<Frame> frames{{calc, 0, false, false}};
+    while (!frames.empty()){
+        Frame& top = frames.back();
+        ChildRange ch = ast.children(top.node);
+        if (!top.opened){
+            top.opened = true;
+            top.next = 1;
+            if (ch.size() < 2) return Error<int>(ErrorType::CompileError);
+            if (ast.kind(ch[0]) == NodeKind::Operator){
+                text.addLine(s.label_ptr, Instruction(Opcode::Xor, reg(Reg::rax), reg(Reg::rax)));
+                top.next = 0;
+            }else if (ast.kind(ch[0]) == NodeKind::Calc){
+                frames.push_back({ch[0], 0, false, false});
+                continue;
+            }else{
+                Result<Operand> first_value = s.findRValue(ast, ch[0], lines, Reg::rdx);
+                if (!first_value.isOk) return Error<int>(first_value);
+                if (options_.strength_reduce && first_value->isImm() && ch.size() > 2
+                    && ast.op(ch[1]) == TokenKind::Times && ast.kind(ch[2]) != NodeKind::Calc){
+                    // 2*a as a*2, so the constant can become a shift
+                    Result<Operand> second_value = s.findRValue(ast, ch[2], lines, Reg::rdx);
+                    if (!second_value.isOk) return Error<int>(second_value);
+                    text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rax), *second_value));
+                    multiplyByConstant(lines, Reg::rax, first_value->value, Reg::rbx);
+                    top.next = 3;
+                }else text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rax), *first_value));
+            }
+        }
+        if (top.next + 1 >= ch.size()){
+            bool operand = top.operand;
+            frames.pop_back();
+            if (!operand) continue;
+            text.addLine(s.label_ptr, Instruction(Opcode::Mov, reg(Reg::rbx), reg(Reg::rax)));
+            text.addLine(s.label_ptr, Instruction(Opcode::Pop, reg(Reg::rax)));
+            Frame& below = frames.back();
+            Result<int> res = apply(ast.op(ast.child(below.node, below.next)), reg(Reg::rbx));
+            if (!res.isOk) return res;
+            below.next += 2;
+            continue;
+        }
+        NodeId next = ch[top.next + 1];
+        if (ast.kind(next) == NodeKind::Calc){
+            text.addLine(s.label_ptr, Instruction(Opcode::Push, reg(Reg::rax)));
+            frames.push_back({next, 0, false, true});
+            continue;
         }
-    }else return Error<int>(ErrorType::InvalidSyntax);
+        Result<Operand> value = s.findRValue(ast, next, lines, Reg::rdx);
+        if (!value.isOk) return Error<int>(value);
+        Result<int> res = apply(ast.op(ch[top.next]), *value);
+        if (!res.isOk) return res;
+        top.next += 2;
+    }
     return Ok(0);
 }
 
-Result<std::string> NASMLinuxELF64::generate(const AST& input){
-    Scope global_scope;
+// Runs on a private generator whose text holds just this job's label.
+// Variables start at zero, as on the interpreter: the stack slots left in
+// memory are cleared after the frame is set up, allocated registers that may
+// be read before they are written after they are saved.
+Result<int> NASMLinuxELF64::generateJob(const AST& ast, size_t job){
+    const CodegenJob& j = plan_->jobs[job];
+    temp_label_ptr = j.temp_label_base;
+    text = Section(".text");
+    const RegisterAssignment* registers = options_.allocate_registers ? &plan_->registers : nullptr;
+    Reg globals_base = options_.host_call ? Reg::rbp : Reg::none;
+    FrameLinks links = options_.frame_links;
+    if (job == 0){
+        text.labels.emplace_back("_start");
+        if (options_.host_call){
+            for (Reg r : host_saved_registers) text.addLine(0, Instruction(Opcode::Push, reg(r)));
+            text.addLine(0, Instruction(Opcode::Mov, reg(Reg::rbp), reg(Reg::rdi)));
+        }else{
+            text.addLine(0, Instruction(Opcode::Mov, reg(Reg::rbp), reg(Reg::rsp)));
+            uint32_t vars = ast.symbols.scope(0).vars;
+            if (vars) text.addLine(0, Instruction(Opcode::Sub, reg(Reg::rsp), imm(8*vars)));
+            zeroVariables(text.labels[0].lines, links, 0, vars, registers ? &registers->frame_slots[0] : nullptr);
+            if (registers) for (Reg r : registers->zeroed(0)) text.addLine(0, Instruction(Opcode::Xor, reg(r), reg(r)));
+        }
+        Scope global_scope(ast.symbols, 0, 0, links, registers, globals_base);
+        return generate(ast, j.node, global_scope);
+    }
+    SymbolIndex proc = ast[j.node].value;
+    text.labels.emplace_back(plan_->procedure_labels[proc]);
+    Scope scope(ast.symbols, ast.symbols[proc].body, 0, links, registers, globals_base);
+    std::vector<Instruction>& lines = text.labels[scope.label_ptr].lines;
+    enterFrame(lines, links, scope.depth);
+    uint32_t vars = ast.symbols.scope(scope.id).vars;
+    if (vars) text.addLine(scope.label_ptr, Instruction(Opcode::Sub, reg(Reg::rsp), imm(8*vars)));
+    std::vector<Reg> saved;
+    if (registers) saved = registers->saved(ast.symbols, scope.id);
+    for (Reg r : saved) text.addLine(scope.label_ptr, Instruction(Opcode::Push, reg(r)));
+    zeroVariables(lines, links, scope.depth, vars, registers ? &registers->frame_slots[scope.id] : nullptr);
+    if (registers) for (Reg r : registers->zeroed(scope.id)) text.addLine(scope.label_ptr, Instruction(Opcode::Xor, reg(r), reg(r)));
+    ChildRange ch = ast.children(j.node);
+    for (size_t i = 1; i < ch.size(); i++){
+        Result<int> res = generate(ast, ch[i], scope);
+        if (!res.isOk) return res;
+    }
+    for (auto r = saved.rbegin(); r != saved.rend(); ++r) text.addLine(scope.label_ptr, Instruction(Opcode::Pop, reg(*r)));
+    text.addLine(scope.label_ptr, Instruction(Opcode::Mov, reg(Reg::rsp), reg(Reg::rbp)));
+    text.addLine(scope.label_ptr, Instruction(Opcode::Pop, reg(Reg::rbp)));
+    text.addLine(scope.label_ptr, Instruction(Opcode::Ret));
+    return Ok(0);
+}
+
+Result<int> NASMLinuxELF64::runJobs(CompilationContext& ctx, size_t jobs, const std::function<Result<int>(NASMLinuxELF64&, size_t)>& generate){
+    std::vector<Label> labels(jobs, Label(""));
+    std::vector<Result<int>> results(jobs, Result<int>(0));
+    std::vector<PeepholeStats> stats(jobs);
+    // jobs may run on other threads, each measures into its own report
+    std::vector<TimeReport> job_reports(ctx.report ? jobs : 0);
+    auto run = [&](size_t job){
+        NASMLinuxELF64 worker(options_);
+        worker.plan_ = plan_;
+        results[job] = generate(worker, job);
+        if (!results[job].isOk) return;
+        labels[job] = std::move(worker.text.labels[0]);
+        if (options_.peephole){
+            ScopedTimer pass(ctx.report ? &job_reports[job] : nullptr, Phase::Peephole);
+            stats[job] = peephole(labels[job].lines);
+        }
+    };
+    if (options_.threads > 1 && jobs > 1){
+        ThreadPool pool(std::min(options_.threads, jobs));
+        for (size_t job = 0; job < jobs; job++) pool.submit([&run, job](size_t){run(job);});
+        pool.wait();
+    }else{
+        for (size_t job = 0; job < jobs; job++) run(job);
+    }
+    // merge in label order; the first failing job in that order wins
+    for (size_t job = 0; job < jobs; job++){
+        if (!results[job].isOk) return Error<int>(results[job]);
+        text.labels.push_back(std::move(labels[job]));
+        peephole_stats_ += stats[job];
+        if (ctx.report) *ctx.report += job_reports[job];
+    }
+    if (ctx.report){
+        for (const Label& label : text.labels){
+            ctx.report->labels++;
+            for (const Instruction& line : label.lines) (line.op == Opcode::Label ? ctx.report->labels : ctx.report->instructions)++;
+        }
+    }
+    return Ok(0);
+}
+
+Result<int> NASMLinuxELF64::lower(CompilationContext& ctx){
+    ScopedTimer timer(ctx.report, Phase::Codegen);
+    const AST& input = ctx.ast;
     temp_label_ptr = 0;
+    own_plan_.clear();
+    plan_ = &own_plan_;
+    peephole_stats_ = PeepholeStats();
+    ssa_stats_ = SSAStats();
     text=Section(".text");
     bss=Section(".bss");
     data=Section(".data");
-
-    text.labels.emplace_back("_start");
     text.lines.emplace_back("global _start");
 
-    Result<int> res = generate(input,global_scope);
+    if (input.root == no_node) return Error<int>(ErrorType::Empty);
+    assignProcedureLabels(input);
+    if (options_.ssa) return lowerSSA(ctx);
+    own_plan_.jobs.push_back(CodegenJob{input.root, 0, 0});
+    int temp_labels = 0;
+    planJobs(input, input.root, temp_labels);
+    own_plan_.jobs[0].temp_label_count = temp_labels;
+    if (options_.allocate_registers){
+        ScopedTimer allocation(ctx.report, Phase::RegisterAllocation);
+        own_plan_.registers = LinearScanAllocator(input).run();
+    }
+
+    Result<int> res = runJobs(ctx, own_plan_.jobs.size(), [&input](NASMLinuxELF64& worker, size_t job){
+        return worker.generateJob(input, job);
+    });
+    if (!res.isOk) return res;
+    temp_label_ptr = temp_labels;
+    return Ok(0);
+}
+
+Result<std::string> NASMLinuxELF64::generate(CompilationContext& ctx){
+    std::ostringstream os;
+    Result<int> res = write(ctx, os);
     if (!res.isOk) return Error<std::string>(res);
-    std::string res_str;
-    res_str += static_cast<std::string>(text);
-    res_str += static_cast<std::string>(bss);
-    res_str += static_cast<std::string>(data);
-    return Ok(res_str);
+    return Ok(os.str());
+}
+
+Result<int> NASMLinuxELF64::write(CompilationContext& ctx, std::ostream& os){
+    Result<int> res = lower(ctx);
+    if (!res.isOk) return res;
+    ScopedTimer timer(ctx.report, Phase::Output);
+    text.print(os);
+    bss.print(os);
+    data.print(os);
+    if (!os) return Error<int>(ErrorType::IOError);
+    return Ok(0);
 }
 
-Result<int> NASMLinuxELF64::compile(const AST& input, const std::string &asmfile, const std::string &objfile, const std::string &exefile){
+Result<int> NASMLinuxELF64::compile(CompilationContext& ctx, const std::string &asmfile, const std::string &objfile, const std::string &exefile){
     std::ofstream f(asmfile);
     if (!f) return Result<int>(ErrorType::IOError);
-    Result<std::string> result = generate(input);
-    if (!result.isOk){
-        return Error<int>(result);
-    }
-    f << *result;
+    Result<int> result = write(ctx, f);
+    if (!result.isOk) return result;
     f.close();
-    std::string cmd = std::string("nasm -f elf64 ")+asmfile+" -o "+objfile+" && ld "+objfile+" -o "+exefile;
-    system(cmd.c_str());
+    std::string cmd = std::string("nasm -f elf64 ")+asmfile+" -o "+objfile;
+    if (!exefile.empty()) cmd += " && ld "+objfile+" -o "+exefile;
+    ScopedTimer timer(ctx.report, Phase::Encode);
+    int status = system(cmd.c_str());
+    if (status != 0) return Error<int>(ErrorType::CompileError);
+    return Ok(status);
+}
+
+Result<int> NASMLinuxELF64::emitELF(CompilationContext& ctx, const std::string& file, ElfType type){
+    Result<int> res = lower(ctx);
+    if (!res.isOk) return res;
+    Result<MachineCode> code = Error<MachineCode>(ErrorType::Empty);
+    {
+        ScopedTimer timer(ctx.report, Phase::Encode);
+        code = encodeX86(text.labels);
+    }
+    if (!code.isOk) return Error<int>(code);
+    ScopedTimer timer(ctx.report, Phase::Output);
+    Result<size_t> written = writeELF(file, *code, type);
+    if (!written.isOk) return Error<int>(written);
     return Ok(0);
 }
 }
\ No newline at end of file
@@ -0,0 +1,460 @@
+#include <unordered_set>
+#include "../include/optimize.hpp"
+
+namespace plc {
+
+bool foldArithmetic(TokenKind op, int64_t lhs, int64_t rhs, int64_t& result){
+    // wrap like the generated code does instead of overflowing in the compiler
+    auto a = static_cast<uint64_t>(lhs), b = static_cast<uint64_t>(rhs);
+    switch (op){
+        case TokenKind::Plus: result = static_cast<int64_t>(a + b); return true;
+        case TokenKind::Minus: result = static_cast<int64_t>(a - b); return true;
+        case TokenKind::Times: result = static_cast<int64_t>(a * b); return true;
+        case TokenKind::Slash:
+            if (rhs == 0 || (lhs == INT64_MIN && rhs == -1)) return false;
+            result = lhs / rhs;
+            return true;
+        default: return false;
+    }
+}
+
+bool foldCondition(TokenKind op, int64_t lhs, int64_t rhs, bool& result){
+    switch (op){
+        case TokenKind::Odd: result = (lhs & 1) != 0; return true;
+        case TokenKind::Equal: result = lhs == rhs; return true;
+        case TokenKind::Hash:
+        case TokenKind::NotEqual: result = lhs != rhs; return true;
+        case TokenKind::Less: result = lhs < rhs; return true;
+        case TokenKind::LessEqual: result = lhs <= rhs; return true;
+        case TokenKind::Greater: result = lhs > rhs; return true;
+        case TokenKind::GreaterEqual: result = lhs >= rhs; return true;
+        default: return false;
+    }
+}
+
+namespace {
+
+class ASTFolder{
+    public:
+    explicit ASTFolder(AST& ast):ast(ast){}
+
+    void statement(NodeId n){
+        ChildRange ch = ast.children(n);
+        switch (ast.kind(n)){
+            case NodeKind::Program:
+            case NodeKind::Block:
+            case NodeKind::Sequence:
+                for (NodeId child : ch) statement(child);
+                break;
+            case NodeKind::Procedure:
+                for (size_t i = 1; i < ch.size(); i++) statement(ch[i]);
+                break;
+            case NodeKind::Assign:
+                expression(ch[1]);
+                break;
+            case NodeKind::If:
+            case NodeKind::While:{
+                bool known, value;
+                known = condition(ch[0], value);
+                statement(ch[1]);
+                if (!known) break;
+                if (!value){
+                    ast.nodes[n] = ASTNode{NodeKind::EmptyStatement, 0, 0, 0};
+                    changed++;
+                }else if (ast.kind(n) == NodeKind::If) replace(n, ch[1]);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // folds n in place; true with its value when it became a literal
+    bool expression(NodeId n, int64_t* value = nullptr){
+        if (ast.kind(n) != NodeKind::Calc) return operand(n, value);
+        // a Calc comes before the ones inside it, so folding the list
+        // backwards folds every operand before the Calc that uses it
+        std::vector<NodeId> calcs, stack{n};
+        while (!stack.empty()){
+            NodeId node = stack.back();
+            stack.pop_back();
+            calcs.push_back(node);
+            for (NodeId child : ast.children(node)){
+                if (ast.kind(child) == NodeKind::Calc) stack.push_back(child);
+            }
+        }
+        for (size_t i = calcs.size(); i-- > 1;) calc(calcs[i], nullptr);
+        return calc(n, value);
+    }
+
+    // a leaf operand, or a Calc that has been folded already
+    bool operand(NodeId n, int64_t* value = nullptr){
+        switch (ast.kind(n)){
+            case NodeKind::Number:
+                if (value) *value = ast.number(n);
+                return true;
+            case NodeKind::Ident:{
+                const SymbolInfo& sym = ast.symbols[ast.symbol(n)];
+                if (sym.kind != IdentType::ConstIdent) return false;
+                setNumber(n, sym.value);
+                if (value) *value = sym.value;
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool condition(NodeId n, bool& result){
+        ChildRange ch = ast.children(n);
+        int64_t lhs = 0, rhs = 0;
+        if (ch.size() == 2){
+            if (!expression(ch[1], &lhs)) return false;
+            return foldCondition(ast.op(ch[0]), lhs, 0, result);
+        }
+        bool known = expression(ch[0], &lhs);
+        known = expression(ch[2], &rhs) && known;
+        return known && foldCondition(ast.op(ch[1]), lhs, rhs, result);
+    }
+
+    bool calc(NodeId n, int64_t* value){
+        ASTNode& node = ast.nodes[n];
+        NodeId* ch = ast.edges.data() + node.first;
+        size_t count = node.count;
+        bool all_known = true;
+        for (size_t i = 0; i < count; i++){
+            if (ast.kind(ch[i]) != NodeKind::Operator && !operand(ch[i])) all_known = false;
+        }
+        if (all_known){
+            int64_t acc = 0;
+            size_t i = 1;
+            if (ast.kind(ch[0]) == NodeKind::Operator) i = 0;
+            else acc = ast.number(ch[0]);
+            for (; i + 1 < count; i += 2){
+                if (!foldArithmetic(ast.op(ch[i]), acc, ast.number(ch[i+1]), acc)){
+                    all_known = false;
+                    break;
+                }
+            }
+            if (all_known){
+                setNumber(n, acc);
+                if (value) *value = acc;
+                return true;
+            }
+        }
+        if (ast.kind(ch[0]) == NodeKind::Operator) return false;
+        // x+0, x-0, x*1, x/1 do nothing when evaluated left to right
+        size_t kept = 1;
+        for (size_t i = 1; i + 1 < count; i += 2){
+            NodeId operand = ch[i+1];
+            TokenKind op = ast.op(ch[i]);
+            if (ast.kind(operand) == NodeKind::Number){
+                int64_t v = ast.number(operand);
+                bool additive = op == TokenKind::Plus || op == TokenKind::Minus;
+                if ((additive && v == 0) || (!additive && v == 1)){
+                    changed++;
+                    continue;
+                }
+            }
+            ch[kept++] = ch[i];
+            ch[kept++] = operand;
+        }
+        node.count = static_cast<uint32_t>(kept);
+        if (kept == 1) replace(n, ch[0]);
+        return false;
+    }
+
+    void setNumber(NodeId n, int64_t v){
+        ast.numbers.push_back(v);
+        ast.nodes[n] = ASTNode{NodeKind::Number, static_cast<uint32_t>(ast.numbers.size() - 1), 0, 0};
+        changed++;
+    }
+
+    // nodes are never shared, so a node can take over another's contents
+    void replace(NodeId n, NodeId with){
+        ast.nodes[n] = ast.nodes[with];
+        changed++;
+    }
+
+    AST& ast;
+    size_t changed = 0;
+};
+
+class QuaternaryFolder{
+    public:
+    explicit QuaternaryFolder(CompilationContext& ctx):ctx(ctx),code(ctx.code),removed(code.size(), 0){}
+
+    size_t run(){
+        size_t before = code.size();
+        propagateConstantSymbols();
+        for (int round = 0; round < 4; round++){
+            findLeaders();
+            bool changed = propagate();
+            findLeaders();
+            changed = removeDeadTemps() || changed;
+            changed = removeUnreachable() || changed;
+            compact();
+            if (!changed) break;
+        }
+        return before - code.size();
+    }
+
+    private:
+    // operands name their symbol, so every read of a const is its value and
+    // the declaration itself is dead
+    void propagateConstantSymbols(){
+        const SymbolTable& symbols = ctx.ast.symbols;
+        auto value = [&](QuadOperand& op){
+            if (op.isSlot() && symbols[op.index()].kind == IdentType::ConstIdent) op = ctx.constant(symbols[op.index()].value);
+        };
+        for (size_t i = 0; i < code.size(); i++){
+            Quaternary& q = code[i];
+            if (q.op == QuadOp::Assign && q.result.isSlot() && symbols[q.result.index()].kind == IdentType::ConstIdent){
+                removed[i] = 1;
+                continue;
+            }
+            if (q.op == QuadOp::Jump) continue;
+            value(q.a);
+            value(q.b);
+        }
+    }
+
+    bool literal(QuadOperand op, int64_t& v) const{
+        if (!op.isConstant()) return false;
+        v = ctx.constantValue(op);
+        return true;
+    }
+
+    static bool writes(const Quaternary& q){
+        return !isJump(q.op) && !q.result.isNone();
+    }
+
+    void findLeaders(){
+        leader.assign(code.size() + 1, 0);
+        leader[0] = 1;
+        for (const auto& entry : ctx.procedure_line) mark(entry.second);
+        for (size_t i = 0; i < code.size(); i++){
+            if (removed[i] || !isJump(code[i].op)) continue;
+            mark(target(i));
+            mark(i + 1);
+        }
+    }
+
+    void mark(size_t i){
+        if (i < leader.size()) leader[i] = 1;
+    }
+
+    size_t target(size_t i) const{
+        return code[i].result.index();
+    }
+
+    // forward pass over each basic block
+    bool propagate(){
+        bool changed = false;
+        const QuadOperand none;
+        std::unordered_map<QuadOperand, QuadOperand> known;
+        // the names known to be a copy of each operand, so a write finds
+        // them without a scan; entries that were overwritten since are stale
+        std::unordered_map<QuadOperand, std::vector<QuadOperand>> copies;
+        auto forget = [&]{
+            known.clear();
+            copies.clear();
+        };
+        auto substitute = [&](QuadOperand& operand){
+            auto it = known.find(operand);
+            if (it == known.end()) return;
+            operand = it->second;
+            changed = true;
+        };
+        auto kill = [&](QuadOperand name){
+            known.erase(name);
+            auto users = copies.find(name);
+            if (users == copies.end()) return;
+            for (const QuadOperand& copy : users->second){
+                auto it = known.find(copy);
+                if (it != known.end() && it->second == name) known.erase(it);
+            }
+            copies.erase(users);
+        };
+        for (size_t i = 0; i < code.size(); i++){
+            if (leader[i]) forget();
+            if (removed[i]) continue;
+            Quaternary& q = code[i];
+            if (isJump(q.op)){
+                if (isConditionalJump(q.op)){
+                    substitute(q.a);
+                    if (!q.b.isNone()) substitute(q.b);
+                    int64_t a = 0, b = 0;
+                    bool result;
+                    if (literal(q.a, a) && (q.b.isNone() || literal(q.b, b))
+                        && foldCondition(quadKind(q.op), a, b, result)){
+                        if (result) q = Quaternary{QuadOp::Jump, none, none, q.result};
+                        else removed[i] = 1;
+                        changed = true;
+                    }
+                }
+                forget();
+                continue;
+            }
+            if (q.op == QuadOp::Assign && q.a.isNone()){
+                kill(q.result);
+                continue;
+            }
+            substitute(q.a);
+            if (q.op != QuadOp::Assign) substitute(q.b);
+            int64_t a = 0, b = 0, v = 0;
+            if (q.op != QuadOp::Assign && literal(q.a, a) && literal(q.b, b)
+                && foldArithmetic(quadKind(q.op), a, b, v)){
+                q = Quaternary{QuadOp::Assign, ctx.constant(v), none, q.result};
+                changed = true;
+            }
+            kill(q.result);
+            // keep temps out of user variables so the temp can still die
+            if (q.op == QuadOp::Assign && q.a != q.result && (q.result.isTemp() || !q.a.isTemp())){
+                known[q.result] = q.a;
+                copies[q.a].push_back(q.result);
+            }
+        }
+        return changed;
+    }
+
+    // Temps never live across a block boundary, so a backward scan per block
+    // finds every temp write nobody reads.
+    bool removeDeadTemps(){
+        bool changed = false;
+        std::unordered_set<QuadOperand> live;
+        for (size_t i = code.size(); i-- > 0;){
+            if (leader[i + 1]) live.clear();
+            if (removed[i]) continue;
+            Quaternary& q = code[i];
+            if (writes(q) && q.result.isTemp()){
+                if (!live.count(q.result)){
+                    removed[i] = 1;
+                    changed = true;
+                    continue;
+                }
+                live.erase(q.result);
+            }
+            // (op, a, b, T) (:=, T, _, x) with T dead afterwards: compute into x
+            if (q.op == QuadOp::Assign && q.a.isTemp() && !live.count(q.a) && q.a != q.result && !leader[i]){
+                size_t prev = i;
+                while (prev > 0 && removed[prev - 1]) prev--;
+                if (prev > 0 && !leaderBetween(--prev, i) && writes(code[prev])
+                    && code[prev].op != QuadOp::Assign && code[prev].result == q.a){
+                    code[prev].result = q.result;
+                    removed[i] = 1;
+                    changed = true;
+                    // code[prev] is visited next with its new result
+                    continue;
+                }
+            }
+            if (q.a.isTemp()) live.insert(q.a);
+            if (q.b.isTemp()) live.insert(q.b);
+        }
+        return changed;
+    }
+
+    bool leaderBetween(size_t from, size_t to) const{
+        for (size_t i = from + 1; i <= to; i++) if (leader[i]) return true;
+        return false;
+    }
+
+    bool removeUnreachable(){
+        bool changed = false;
+        bool reachable = true;
+        for (size_t i = 0; i < code.size(); i++){
+            if (leader[i]) reachable = reachable || isTarget(i);
+            if (removed[i]) continue;
+            if (!reachable){
+                removed[i] = 1;
+                changed = true;
+                continue;
+            }
+            if (code[i].op == QuadOp::Jump && !isCall(i)){
+                // a jump to the next live quadruple does nothing, but one that skips
+                // an empty procedure body keeps that entry apart from its parent's
+                if (target(i) > i && allRemoved(i + 1, target(i)) && !isEntry(i + 1)){
+                    removed[i] = 1;
+                    changed = true;
+                    continue;
+                }
+                reachable = false;
+            }
+        }
+        return changed;
+    }
+
+    bool isEntry(size_t i){
+        if (entries.empty()){
+            entries.assign(code.size() + 1, 0);
+            for (const auto& entry : ctx.procedure_line) if (entry.second < entries.size()) entries[entry.second] = 1;
+        }
+        return i < entries.size() && entries[i];
+    }
+
+    // calls are plain jumps to a procedure entry but come back afterwards
+    bool isCall(size_t i){
+        return isEntry(target(i));
+    }
+
+    bool allRemoved(size_t from, size_t to) const{
+        for (size_t i = from; i < to && i < code.size(); i++) if (!removed[i]) return false;
+        return true;
+    }
+
+    bool isTarget(size_t i){
+        if (targets.empty()){
+            targets.assign(code.size() + 1, 0);
+            for (const auto& entry : ctx.procedure_line) if (entry.second < targets.size()) targets[entry.second] = 1;
+            for (size_t j = 0; j < code.size(); j++){
+                if (!removed[j] && isJump(code[j].op) && target(j) < targets.size()) targets[target(j)] = 1;
+            }
+        }
+        return targets[i];
+    }
+
+    void compact(){
+        std::vector<size_t> position(code.size() + 1);
+        size_t kept = 0;
+        for (size_t i = 0; i < code.size(); i++){
+            position[i] = kept;
+            if (!removed[i]) kept++;
+        }
+        position[code.size()] = kept;
+        std::vector<Quaternary> out;
+        out.reserve(kept);
+        for (size_t i = 0; i < code.size(); i++){
+            if (removed[i]) continue;
+            if (isJump(code[i].op)) code[i].result = QuadOperand::label(position[target(i)]);
+            out.push_back(code[i]);
+        }
+        for (auto& entry : ctx.procedure_line) entry.second = position[entry.second];
+        for (auto& entry : ctx.procedure_end) entry.second = position[entry.second];
+        code = std::move(out);
+        removed.assign(code.size(), 0);
+        targets.clear();
+        entries.clear();
+    }
+
+    CompilationContext& ctx;
+    std::vector<Quaternary>& code;
+    std::vector<char> removed;
+    std::vector<char> leader;
+    std::vector<char> targets;
+    std::vector<char> entries;
+};
+
+}
+
+size_t foldConstants(AST& ast){
+    if (ast.root == no_node) return 0;
+    ASTFolder folder(ast);
+    folder.statement(ast.root);
+    return folder.changed;
+}
+
+size_t foldConstants(CompilationContext& ctx){
+    return QuaternaryFolder(ctx).run();
+}
+
+}
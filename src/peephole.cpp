@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <unordered_map>
+#include "../include/peephole.hpp"
+
+namespace plc {
+
+PeepholeStats& PeepholeStats::operator+=(const PeepholeStats& other){
+    removed += other.removed;
+    rewritten += other.rewritten;
+    return *this;
+}
+
+namespace {
+
+bool usesReg(const Operand& o, Reg r){
+    return (o.isReg() || o.isMem()) && o.reg == r;
+}
+
+bool reads(const Instruction& ins, Reg r){
+    switch (ins.op){
+        case Opcode::Label:
+        case Opcode::Jmp: case Opcode::Je: case Opcode::Jne: case Opcode::Jl:
+        case Opcode::Jle: case Opcode::Jg: case Opcode::Jge: case Opcode::Jz: case Opcode::Jnz:
+        case Opcode::Ret:
+            return false;
+        case Opcode::Call:
+            // the callee's parent frame
+            return r == Reg::rax;
+        case Opcode::Syscall:
+            return r == Reg::rax || r == Reg::rdi || r == Reg::rsi || r == Reg::rdx;
+        case Opcode::Cqo:
+            return r == Reg::rax;
+        case Opcode::Idiv:
+            if (r == Reg::rdx) return true;
+            [[fallthrough]];
+        case Opcode::Imul:
+            if (ins.src.isNone() && r == Reg::rax) return true;
+            break;
+        case Opcode::Mov:
+        case Opcode::Pop:
+            // the destination is only written, unless it is a memory operand
+            return usesReg(ins.src, r) || (ins.dst.isMem() && ins.dst.reg == r);
+        case Opcode::Xor:
+            // xor r,r does not depend on r
+            if (ins.dst.isReg() && ins.dst == ins.src) return false;
+            break;
+        default:
+            break;
+    }
+    return usesReg(ins.dst, r) || usesReg(ins.src, r);
+}
+
+bool writes(const Instruction& ins, Reg r){
+    switch (ins.op){
+        case Opcode::Cqo:
+            return r == Reg::rdx;
+        case Opcode::Imul:
+            if (!ins.src.isNone()) return ins.dst.isReg(r);
+            [[fallthrough]];
+        case Opcode::Idiv:
+            return r == Reg::rax || r == Reg::rdx;
+        case Opcode::Cmp:
+        case Opcode::Test:
+        case Opcode::Push:
+            return false;
+        default:
+            return ins.dst.isReg(r);
+    }
+}
+
+bool setsFlags(Opcode op){
+    switch (op){
+        case Opcode::Add: case Opcode::Sub: case Opcode::Imul: case Opcode::Idiv:
+        case Opcode::Cmp: case Opcode::Test: case Opcode::Xor:
+        case Opcode::Shl: case Opcode::Shr: case Opcode::Sar: case Opcode::Neg:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// whether scratch register r is overwritten or dies before code[from..] reads it
+bool deadAfter(const std::vector<Instruction>& code, size_t from, Reg r){
+    for (size_t i = from; i < code.size(); i++){
+        if (reads(code[i], r)) return false;
+        if (writes(code[i], r) || code[i].isControl()) return true;
+    }
+    return true;
+}
+
+// whether any register r is written again before code[from..] reads it or
+// leaves the straight-line code that follows
+bool overwrittenAfter(const std::vector<Instruction>& code, size_t from, Reg r){
+    for (size_t i = from; i < code.size(); i++){
+        if (reads(code[i], r)) return false;
+        if (writes(code[i], r)) return true;
+        if (code[i].isControl()) return false;
+    }
+    return false;
+}
+
+bool flagsDeadAfter(const std::vector<Instruction>& code, size_t from){
+    for (size_t i = from; i < code.size(); i++){
+        if (isConditionalJump(code[i].op)) return false;
+        if (setsFlags(code[i].op) || code[i].isControl()) return true;
+    }
+    return true;
+}
+
+int log2Exact(int64_t v){
+    if (v <= 0 || (v & (v - 1))) return -1;
+    int k = 0;
+    while (v > 1){
+        v >>= 1;
+        k++;
+    }
+    return k;
+}
+
+// x86 has no memory-to-memory forms and only 32-bit immediates outside mov r,imm64
+bool encodable(const Operand& dst, const Operand& src){
+    if (dst.isMem() && src.isMem()) return false;
+    if (src.isImm() && !src.isImm32()) return false;
+    return !dst.isImm();
+}
+
+class Peephole{
+    public:
+    explicit Peephole(std::vector<Instruction>& code):code_(code){}
+
+    bool window(){
+        std::vector<Instruction> out;
+        out.reserve(code_.size());
+        bool changed = false;
+        for (size_t i = 0; i < code_.size(); i++){
+            out.push_back(std::move(code_[i]));
+            // the instructions still to come start at i+1 of code_
+            while (match(out, i + 1)) changed = true;
+        }
+        code_ = std::move(out);
+        return changed;
+    }
+
+    bool jumps(){
+        bool changed = false;
+        std::unordered_map<std::string, size_t> labels;
+        for (size_t i = 0; i < code_.size(); i++){
+            if (code_[i].op == Opcode::Label) labels[code_[i].target] = i;
+        }
+        // first instruction executed after jumping to name
+        auto landing = [&](const std::string& name) -> size_t{
+            auto it = labels.find(name);
+            if (it == labels.end()) return code_.size();
+            size_t i = it->second;
+            while (i < code_.size() && code_[i].op == Opcode::Label) i++;
+            return i;
+        };
+        for (Instruction& ins : code_){
+            if (!ins.isJump()) continue;
+            // follow chains of unconditional jumps, leaving cycles alone
+            std::vector<std::string> chain{ins.target};
+            for (size_t to = landing(chain.back()); to < code_.size() && code_[to].op == Opcode::Jmp; to = landing(chain.back())){
+                if (std::find(chain.begin(), chain.end(), code_[to].target) != chain.end()){
+                    chain.resize(1);
+                    break;
+                }
+                chain.push_back(code_[to].target);
+            }
+            if (chain.size() > 1){
+                ins.target = chain.back();
+                stats.rewritten++;
+                changed = true;
+            }
+        }
+
+        std::vector<bool> drop(code_.size(), false);
+        auto fallsInto = [&](size_t from, const std::string& name){
+            for (size_t i = from; i < code_.size() && code_[i].op == Opcode::Label; i++){
+                if (code_[i].target == name) return true;
+            }
+            return false;
+        };
+        for (size_t i = 0; i < code_.size(); i++){
+            Instruction& ins = code_[i];
+            if (drop[i] || !ins.isJump()) continue;
+            if (fallsInto(i + 1, ins.target)){
+                drop[i] = true;
+                continue;
+            }
+            // jcc L1; jmp L2; L1:  ->  jncc L2; L1:
+            if (isConditionalJump(ins.op) && i + 1 < code_.size() && code_[i + 1].op == Opcode::Jmp
+                && fallsInto(i + 2, ins.target)){
+                ins.op = invertJump(ins.op);
+                ins.target = code_[i + 1].target;
+                drop[i + 1] = true;
+                stats.rewritten++;
+            }
+        }
+        // nothing after jmp or ret runs until the next label
+        for (size_t i = 0; i < code_.size(); i++){
+            if (drop[i] || (code_[i].op != Opcode::Jmp && code_[i].op != Opcode::Ret)) continue;
+            for (size_t j = i + 1; j < code_.size() && code_[j].op != Opcode::Label; j++) drop[j] = true;
+        }
+        std::unordered_map<std::string, size_t> referenced;
+        for (size_t i = 0; i < code_.size(); i++){
+            if (!drop[i] && code_[i].isJump()) referenced[code_[i].target]++;
+        }
+        for (size_t i = 0; i < code_.size(); i++){
+            if (code_[i].op == Opcode::Label && !referenced.count(code_[i].target)) drop[i] = true;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < code_.size(); i++){
+            if (drop[i]) continue;
+            if (kept != i) code_[kept] = std::move(code_[i]);
+            kept++;
+        }
+        if (kept != code_.size()) changed = true;
+        code_.erase(code_.begin() + kept, code_.end());
+        return changed;
+    }
+
+    PeepholeStats stats;
+
+    private:
+    // tries one rewrite on the end of out, next is where the rest of the code starts
+    bool match(std::vector<Instruction>& out, size_t next){
+        size_t n = out.size();
+        Instruction& a = out[n-1];
+        if (a.op == Opcode::Mov && a.dst == a.src){
+            out.pop_back();
+            return true;
+        }
+        // xor r,r whose zero is overwritten before it is read
+        if (a.op == Opcode::Xor && a.dst.isReg() && a.dst == a.src && overwrittenAfter(code_, next, a.dst.reg) && flagsDeadAfter(code_, next)){
+            out.pop_back();
+            return true;
+        }
+        // mov r,0  ->  xor r,r
+        if (a.op == Opcode::Mov && a.dst.isReg() && a.src.isImm() && a.src.value == 0 && flagsDeadAfter(code_, next)){
+            a = Instruction(Opcode::Xor, a.dst, a.dst);
+            stats.rewritten++;
+            return true;
+        }
+        if (n < 2) return false;
+        Instruction& b = out[n-2];
+
+        // mov X,Y; mov Y,X  ->  mov X,Y
+        if (b.op == Opcode::Mov && a.op == Opcode::Mov && a.dst == b.src && a.src == b.dst){
+            out.pop_back();
+            return true;
+        }
+        // add/sub rsp,x; add/sub rsp,y  ->  one adjustment
+        if ((b.op == Opcode::Add || b.op == Opcode::Sub) && (a.op == Opcode::Add || a.op == Opcode::Sub)
+            && b.dst.isReg(Reg::rsp) && a.dst.isReg(Reg::rsp) && b.src.isImm() && a.src.isImm()
+            && flagsDeadAfter(code_, next)){
+            int64_t delta = (b.op == Opcode::Add ? b.src.value : -b.src.value)
+                          + (a.op == Opcode::Add ? a.src.value : -a.src.value);
+            out.pop_back();
+            if (delta == 0){
+                out.pop_back();
+                return true;
+            }
+            out.back() = Instruction(delta > 0 ? Opcode::Add : Opcode::Sub, reg(Reg::rsp), imm(delta > 0 ? delta : -delta));
+            stats.rewritten++;
+            return true;
+        }
+        // mov rax,Y; mov R,rax  ->  mov R,Y
+        if (b.op == Opcode::Mov && a.op == Opcode::Mov && b.dst.isReg(Reg::rax) && a.src.isReg(Reg::rax)
+            && !a.dst.isReg(Reg::rax) && !usesReg(b.src, Reg::rax)
+            && (!a.dst.isMem() || b.src.isReg() || b.src.isImm32()) && !(a.dst.isMem() && b.src.isMem())
+            && deadAfter(code_, next, Reg::rax)){
+            Instruction merged(Opcode::Mov, a.dst, b.src);
+            out.pop_back();
+            out.back() = merged;
+            stats.rewritten++;
+            return true;
+        }
+        // mov rax,Y; test rax,imm  ->  test Y,imm
+        if (b.op == Opcode::Mov && a.op == Opcode::Test && b.dst.isReg(Reg::rax) && a.dst.isReg(Reg::rax)
+            && a.src.isImm32() && (b.src.isReg() || b.src.isMem()) && deadAfter(code_, next, Reg::rax)){
+            Instruction merged(Opcode::Test, b.src, a.src);
+            out.pop_back();
+            out.back() = merged;
+            stats.rewritten++;
+            return true;
+        }
+        // mov rbx,Y; imul rbx  ->  shl rax,k / imul rax,Y
+        if (b.op == Opcode::Mov && a.op == Opcode::Imul && a.src.isNone() && b.dst.isReg(Reg::rbx) && a.dst.isReg(Reg::rbx)
+            && deadAfter(code_, next, Reg::rbx) && deadAfter(code_, next, Reg::rdx) && flagsDeadAfter(code_, next)){
+            Operand factor = b.src;
+            if (factor.isImm()){
+                int k = log2Exact(factor.value);
+                if (k == 0){
+                    out.pop_back();
+                    out.pop_back();
+                    return true;
+                }
+                if (k > 0){
+                    out.pop_back();
+                    out.back() = Instruction(Opcode::Shl, reg(Reg::rax), imm(k));
+                    stats.rewritten++;
+                    return true;
+                }
+                if (!factor.isImm32()) return false;
+            }
+            out.pop_back();
+            out.back() = Instruction(Opcode::Imul, reg(Reg::rax), factor);
+            stats.rewritten++;
+            return true;
+        }
+        if (n < 3) return false;
+        Instruction& c = out[n-3];
+
+        // mov rax,Y; op rax,Z; mov Y,rax  ->  op Y,Z
+        if (c.op == Opcode::Mov && (b.op == Opcode::Add || b.op == Opcode::Sub || b.op == Opcode::Shl)
+            && a.op == Opcode::Mov && c.dst.isReg(Reg::rax) && b.dst.isReg(Reg::rax) && a.src.isReg(Reg::rax)
+            && a.dst == c.src && !usesReg(c.src, Reg::rax) && !usesReg(b.src, Reg::rax)
+            && encodable(a.dst, b.src) && deadAfter(code_, next, Reg::rax)){
+            Instruction merged(b.op, a.dst, b.src);
+            out.pop_back();
+            out.pop_back();
+            out.back() = merged;
+            stats.rewritten++;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<Instruction>& code_;
+};
+
+}
+
+PeepholeStats peephole(std::vector<Instruction>& code){
+    Peephole pass(code);
+    size_t before = code.size();
+    bool changed = true;
+    while (changed){
+        changed = pass.window();
+        changed = pass.jumps() || changed;
+    }
+    pass.stats.removed = before - code.size();
+    return pass.stats;
+}
+
+}
@@ -0,0 +1,31 @@
+#include "../include/quaternary.hpp"
+
+namespace plc {
+
+QuadOp arithmeticOp(TokenKind op){
+    return static_cast<QuadOp>(static_cast<uint8_t>(QuadOp::Add) + static_cast<uint8_t>(op) - static_cast<uint8_t>(TokenKind::Plus));
+}
+
+QuadOp jumpOp(TokenKind op){
+    if (op == TokenKind::Odd) return QuadOp::JumpOdd;
+    return static_cast<QuadOp>(static_cast<uint8_t>(QuadOp::JumpEqual) + static_cast<uint8_t>(op) - static_cast<uint8_t>(TokenKind::Equal));
+}
+
+TokenKind quadKind(QuadOp op){
+    if (op >= QuadOp::Add && op <= QuadOp::Div){
+        return static_cast<TokenKind>(static_cast<uint8_t>(TokenKind::Plus) + static_cast<uint8_t>(op) - static_cast<uint8_t>(QuadOp::Add));
+    }
+    if (op >= QuadOp::JumpEqual && op <= QuadOp::JumpNotEqual){
+        return static_cast<TokenKind>(static_cast<uint8_t>(TokenKind::Equal) + static_cast<uint8_t>(op) - static_cast<uint8_t>(QuadOp::JumpEqual));
+    }
+    if (op == QuadOp::JumpOdd) return TokenKind::Odd;
+    return TokenKind::Becomes;
+}
+
+std::string quadSpelling(QuadOp op){
+    if (op == QuadOp::Jump) return "j";
+    if (isConditionalJump(op)) return "j" + std::string(kindSpelling(quadKind(op)));
+    return std::string(kindSpelling(quadKind(op)));
+}
+
+}
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include "../include/regalloc.hpp"
+
+namespace plc {
+
+std::vector<Reg> RegisterAssignment::saved(const SymbolTable& table, ScopeId scope) const{
+    // the main program has no caller to preserve registers for
+    if (scope >= used.size() || table.scope(scope).procedure == no_symbol_index) return {};
+    return registers(scope);
+}
+
+namespace {
+
+std::vector<Reg> registersIn(const std::vector<uint16_t>& masks, ScopeId scope){
+    std::vector<Reg> regs;
+    if (scope >= masks.size()) return regs;
+    for (size_t i = 0; i < allocatable_registers.size(); i++){
+        if (masks[scope] & (1u << i)) regs.push_back(allocatable_registers[i]);
+    }
+    return regs;
+}
+
+}
+
+std::vector<Reg> RegisterAssignment::registers(ScopeId scope) const{
+    return registersIn(used, scope);
+}
+
+std::vector<Reg> RegisterAssignment::zeroed(ScopeId scope) const{
+    return registersIn(cleared, scope);
+}
+
+void RegisterAssignment::clear(){
+    reg.clear();
+    used.clear();
+    cleared.clear();
+    frame_slots.clear();
+    allocated = 0;
+    spilled = 0;
+}
+
+LinearScanAllocator::LinearScanAllocator(const AST& ast):ast_(ast){}
+
+void LinearScanAllocator::use(NodeId ident, ScopeId scope, bool write){
+    SymbolIndex var = ast_.symbol(ident);
+    const SymbolInfo& sym = ast_.symbols[var];
+    if (sym.kind != IdentType::VarIdent) return;
+    if (sym.scope != scope) escapes_[var] = 1;
+    LiveInterval& interval = intervals_[var];
+    if (interval.start == UINT32_MAX){
+        interval.start = position_;
+        written_first_[var] = write && !conditional_;
+    }
+    interval.end = position_;
+}
+
+void LinearScanAllocator::walk(NodeId n, ScopeId scope){
+    ChildRange ch = ast_.children(n);
+    switch (ast_.kind(n)){
+        case NodeKind::Block:
+            scope = ast_[n].value;
+            entry_[scope] = position_;
+            break;
+        case NodeKind::Procedure:
+            for (size_t i = 1; i < ch.size(); i++) walk(ch[i], scope);
+            return;
+        case NodeKind::Const:
+        case NodeKind::Var:
+            return;
+        case NodeKind::Ident:
+            use(n, scope);
+            return;
+        case NodeKind::Calc:
+            expression(n, scope);
+            return;
+        case NodeKind::Assign:
+            // the right side is read before the left side is written
+            position_++;
+            walk(ch[1], scope);
+            position_++;
+            use(ch[0], scope, true);
+            return;
+        case NodeKind::If:
+            conditional_++;
+            for (NodeId child : ch) walk(child, scope);
+            position_++;
+            conditional_--;
+            return;
+        case NodeKind::While:{
+            uint32_t start = position_++;
+            conditional_++;
+            for (NodeId child : ch) walk(child, scope);
+            conditional_--;
+            loops_[scope].emplace_back(start, position_++);
+            return;
+        }
+        default:
+            break;
+    }
+    for (NodeId child : ch) walk(child, scope);
+    position_++;
+}
+
+// the walk above for a Calc, with a stack instead of recursion since
+// parentheses nest without limit: each node and how many children are done
+void LinearScanAllocator::expression(NodeId n, ScopeId scope){
+    std::vector<std::pair<NodeId, size_t>> stack{{n, 0}};
+    while (!stack.empty()){
+        auto& [node, done] = stack.back();
+        if (ast_.kind(node) == NodeKind::Ident){
+            use(node, scope);
+            stack.pop_back();
+            continue;
+        }
+        ChildRange ch = ast_.children(node);
+        if (done < ch.size()){
+            NodeId child = ch[done++];
+            stack.push_back({child, 0});
+            continue;
+        }
+        position_++;
+        stack.pop_back();
+    }
+}
+
+void LinearScanAllocator::allocate(std::vector<LiveInterval>& intervals, ScopeId scope, RegisterAssignment& out) const{
+    std::sort(intervals.begin(), intervals.end(), [](const LiveInterval& a, const LiveInterval& b){
+        return a.start != b.start ? a.start < b.start : a.var < b.var;
+    });
+    std::vector<const LiveInterval*> active;    // sorted by increasing end
+    uint16_t free_mask = static_cast<uint16_t>((1u << allocatable_registers.size()) - 1);
+    for (const LiveInterval& current : intervals){
+        // expire intervals that ended before this one starts
+        size_t expired = 0;
+        while (expired < active.size() && active[expired]->end < current.start){
+            free_mask |= static_cast<uint16_t>(1u << out.reg[active[expired]->var]);
+            expired++;
+        }
+        active.erase(active.begin(), active.begin() + expired);
+
+        uint8_t reg = no_register;
+        if (free_mask){
+            for (uint8_t i = 0; i < allocatable_registers.size(); i++){
+                if (free_mask & (1u << i)){
+                    reg = i;
+                    break;
+                }
+            }
+            free_mask &= static_cast<uint16_t>(~(1u << reg));
+        }else{
+            // spill whichever of the active intervals and this one ends last
+            const LiveInterval* victim = active.back();
+            if (victim->end <= current.end){
+                out.spilled++;
+                continue;
+            }
+            reg = out.reg[victim->var];
+            out.reg[victim->var] = no_register;
+            active.pop_back();
+            out.spilled++;
+            out.allocated--;
+        }
+        out.reg[current.var] = reg;
+        out.used[scope] |= static_cast<uint16_t>(1u << reg);
+        out.allocated++;
+        auto pos = std::upper_bound(active.begin(), active.end(), &current, [](const LiveInterval* a, const LiveInterval* b){
+            return a->end < b->end;
+        });
+        active.insert(pos, &current);
+    }
+}
+
+RegisterAssignment LinearScanAllocator::run(){
+    RegisterAssignment out;
+    const SymbolTable& symbols = ast_.symbols;
+    out.reg.assign(symbols.size(), no_register);
+    out.used.assign(symbols.scopes.size(), 0);
+    out.cleared.assign(symbols.scopes.size(), 0);
+    out.frame_slots.assign(symbols.scopes.size(), {});
+    if (ast_.root == no_node) return out;
+
+    position_ = 0;
+    intervals_.assign(symbols.size(), LiveInterval{0, UINT32_MAX, 0});
+    escapes_.assign(symbols.size(), 0);
+    written_first_.assign(symbols.size(), 0);
+    entry_.assign(symbols.scopes.size(), 0);
+    conditional_ = 0;
+    loops_.assign(symbols.scopes.size(), {});
+    walk(ast_.root, 0);
+
+    std::vector<std::vector<LiveInterval>> by_scope(symbols.scopes.size());
+    for (SymbolIndex var = 0; var < symbols.size(); var++){
+        LiveInterval interval = intervals_[var];
+        if (interval.start == UINT32_MAX || escapes_[var]) continue;
+        interval.var = var;
+        if (!written_first_[var]) interval.start = entry_[symbols[var].scope];
+        // a value read anywhere in a loop may be needed on the next iteration
+        for (const auto& [start, end] : loops_[symbols[var].scope]){
+            if (interval.start <= end && interval.end >= start){
+                interval.start = std::min(interval.start, start);
+                interval.end = std::max(interval.end, end);
+            }
+        }
+        by_scope[symbols[var].scope].push_back(interval);
+    }
+    for (ScopeId scope = 0; scope < by_scope.size(); scope++){
+        if (!by_scope[scope].empty()) allocate(by_scope[scope], scope, out);
+    }
+    // only what may be read before it is written has to start out zero
+    for (SymbolIndex var = 0; var < symbols.size(); var++){
+        const SymbolInfo& sym = symbols[var];
+        if (sym.kind != IdentType::VarIdent) continue;
+        if (!out.inRegister(var)) out.frame_slots[sym.scope].push_back(sym.slot);
+        else if (!written_first_[var]) out.cleared[sym.scope] |= static_cast<uint16_t>(1u << out.reg[var]);
+    }
+    return out;
+}
+
+}
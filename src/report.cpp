@@ -0,0 +1,118 @@
+#include <cstdio>
+#include "../include/report.hpp"
+
+namespace plc {
+
+namespace {
+
+thread_local AllocationCounters allocated;
+
+bool isSubPass(Phase phase){
+    return phase == Phase::SSA || phase == Phase::SSAOptimize || phase == Phase::RegisterAllocation || phase == Phase::Peephole;
+}
+
+}
+
+const char* phaseName(Phase phase){
+    switch (phase){
+        case Phase::Lex: return "lexing";
+        case Phase::Parse: return "parsing";
+        case Phase::Inline: return "inlining";
+        case Phase::FoldAST: return "AST folding";
+        case Phase::IR: return "IR generation";
+        case Phase::FoldIR: return "IR folding";
+        case Phase::Cache: return "IR cache";
+        case Phase::Codegen: return "code generation";
+        case Phase::SSA: return "SSA construction";
+        case Phase::SSAOptimize: return "SSA passes";
+        case Phase::RegisterAllocation: return "register allocation";
+        case Phase::Peephole: return "peephole";
+        case Phase::Encode: return "encoding";
+        case Phase::Output: return "output";
+        case Phase::Run: return "running";
+    }
+    return "?";
+}
+
+AllocationCounters threadAllocations(){
+    return allocated;
+}
+
+void countAllocation(size_t bytes){
+    allocated.count++;
+    allocated.bytes += bytes;
+}
+
+void TimeReport::add(Phase phase, double seconds, AllocationCounters allocations){
+    PhaseStats& stats = phases_[static_cast<size_t>(phase)];
+    stats.seconds += seconds;
+    stats.calls++;
+    stats.allocations += allocations.count;
+    stats.allocated_bytes += allocations.bytes;
+}
+
+TimeReport& TimeReport::operator+=(const TimeReport& other){
+    for (size_t i = 0; i < phase_count; i++){
+        phases_[i].seconds += other.phases_[i].seconds;
+        phases_[i].calls += other.phases_[i].calls;
+        phases_[i].allocations += other.phases_[i].allocations;
+        phases_[i].allocated_bytes += other.phases_[i].allocated_bytes;
+    }
+    files += other.files;
+    tokens += other.tokens;
+    nodes += other.nodes;
+    quadruples += other.quadruples;
+    labels += other.labels;
+    instructions += other.instructions;
+    return *this;
+}
+
+void TimeReport::print(std::ostream& os) const{
+    double total = 0;
+    for (size_t i = 0; i < phase_count; i++) if (!isSubPass(static_cast<Phase>(i))) total += phases_[i].seconds;
+    char line[128];
+    os << "Time report (" << files << " file(s)):\n";
+    std::snprintf(line, sizeof(line), " %-24s %10s %6s %12s %14s\n", "phase", "wall (s)", "%", "allocations", "bytes");
+    os << line;
+    for (size_t i = 0; i < phase_count; i++){
+        const PhaseStats& p = phases_[i];
+        if (!p.calls) continue;
+        Phase phase = static_cast<Phase>(i);
+        std::snprintf(line, sizeof(line), " %s%-*s %10.6f %6.1f %12llu %14llu\n", isSubPass(phase) ? "  " : "",
+            isSubPass(phase) ? 22 : 24, phaseName(phase), p.seconds, total > 0 ? 100 * p.seconds / total : 0.0,
+            static_cast<unsigned long long>(p.allocations), static_cast<unsigned long long>(p.allocated_bytes));
+        os << line;
+    }
+    std::snprintf(line, sizeof(line), " %-24s %10.6f\n", "total", total);
+    os << line;
+    os << " tokens " << tokens << ", AST nodes " << nodes << ", quadruples " << quadruples
+       << ", labels " << labels << ", instructions " << instructions << "\n";
+}
+
+void TimeReport::printJSON(std::ostream& os) const{
+    os << "{\"files\":" << files << ",\"tokens\":" << tokens << ",\"nodes\":" << nodes
+       << ",\"quadruples\":" << quadruples << ",\"labels\":" << labels << ",\"instructions\":" << instructions
+       << ",\"phases\":[";
+    bool first = true;
+    for (size_t i = 0; i < phase_count; i++){
+        const PhaseStats& p = phases_[i];
+        if (!p.calls) continue;
+        os << (first ? "" : ",") << "{\"name\":\"" << phaseName(static_cast<Phase>(i)) << "\",\"seconds\":" << p.seconds
+           << ",\"calls\":" << p.calls << ",\"allocations\":" << p.allocations << ",\"allocated_bytes\":" << p.allocated_bytes << "}";
+        first = false;
+    }
+    os << "]}\n";
+}
+
+void ScopedTimer::start(){
+    allocated_ = threadAllocations();
+    start_ = std::chrono::steady_clock::now();
+}
+
+void ScopedTimer::stop(){
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    AllocationCounters now = threadAllocations();
+    report_->add(phase_, seconds, AllocationCounters{now.count - allocated_.count, now.bytes - allocated_.bytes});
+}
+
+}
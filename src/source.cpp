@@ -0,0 +1,79 @@
+#include <fstream>
+#include <sstream>
+#include "../include/source.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PLC_HAVE_MMAP 1
+#endif
+
+namespace plc {
+
+SourceBuffer::~SourceBuffer(){
+#ifdef PLC_HAVE_MMAP
+    if (mapped_) munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+std::shared_ptr<SourceBuffer> SourceBuffer::makeOwned(std::string text){
+    std::shared_ptr<SourceBuffer> buffer(new SourceBuffer());
+    buffer->owned_ = std::move(text);
+    buffer->data_ = buffer->owned_.data();
+    buffer->size_ = buffer->owned_.size();
+    return buffer;
+}
+
+std::shared_ptr<const SourceBuffer> SourceBuffer::fromString(std::string text){
+    return makeOwned(std::move(text));
+}
+
+Result<std::shared_ptr<const SourceBuffer>> SourceBuffer::fromFile(const std::string &filename) noexcept{
+    using Ptr = std::shared_ptr<const SourceBuffer>;
+    try{
+#ifdef PLC_HAVE_MMAP
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return Error<Ptr>(ErrorType::IOError);
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+            void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED){
+                close(fd);
+                std::shared_ptr<SourceBuffer> buffer(new SourceBuffer());
+                buffer->data_ = static_cast<const char*>(addr);
+                buffer->size_ = static_cast<size_t>(st.st_size);
+                buffer->mapped_ = true;
+                buffer->name_ = filename;
+                madvise(addr, buffer->size_, MADV_SEQUENTIAL);
+                return Ok<Ptr>(buffer);
+            }
+        }
+        close(fd);
+#endif
+        std::ifstream f(filename, std::ios::binary);
+        if (!f) return Error<Ptr>(ErrorType::IOError);
+        std::string text;
+        f.seekg(0, std::ios::end);
+        std::streamoff size = f.tellg();
+        if (size > 0){
+            text.resize(static_cast<size_t>(size));
+            f.seekg(0, std::ios::beg);
+            f.read(text.data(), size);
+        }else{
+            f.clear();
+            f.seekg(0, std::ios::beg);
+            std::stringstream stream;
+            stream << f.rdbuf();
+            text = stream.str();
+        }
+        std::shared_ptr<SourceBuffer> buffer = makeOwned(std::move(text));
+        buffer->name_ = filename;
+        return Ok<Ptr>(buffer);
+    }catch (std::exception& e){
+        return Error<Ptr>(ErrorType::IOError);
+    }
+}
+
+}
@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <unordered_map>
+#include "../include/ssa.hpp"
+
+namespace plc {
+
+std::string_view ssaOpName(SSAOp op){
+    switch (op){
+        case SSAOp::Const: return "const";
+        case SSAOp::Phi: return "phi";
+        case SSAOp::Add: return "add";
+        case SSAOp::Sub: return "sub";
+        case SSAOp::Mul: return "mul";
+        case SSAOp::Div: return "div";
+        case SSAOp::Load: return "load";
+        case SSAOp::Store: return "store";
+        case SSAOp::Call: return "call";
+    }
+    return "?";
+}
+
+size_t SSAFunction::instructionCount() const{
+    size_t n = 0;
+    for (const SSABlock& block : blocks) n += block.code.size();
+    return n;
+}
+
+SSAStats& SSAStats::operator+=(const SSAStats& other){
+    values += other.values;
+    stores += other.stores;
+    blocks += other.blocks;
+    hoisted += other.hoisted;
+    inductions += other.inductions;
+    return *this;
+}
+
+namespace {
+
+// Builds one function at a time. Control flow in PL/0 is structured, so
+// each promoted variable's current value is tracked in env_ while the AST
+// is walked: an if merges the two environments with phis, a while puts a
+// phi at its header for every variable its body assigns.
+class SSABuilder{
+    public:
+    SSABuilder(const AST& ast, SSAProgram& program):ast_(ast),program_(program),
+        vars_of_scope_(ast.symbols.scopes.size()),memory_of_scope_(ast.symbols.scopes.size()),local_of_(ast.symbols.size(), 0){
+        for (SymbolIndex n = 0; n < ast.symbols.size(); n++){
+            if (program.promoted[n]) vars_of_scope_[ast.symbols[n].scope].push_back(n);
+            else if (ast.symbols[n].kind == IdentType::VarIdent) memory_of_scope_[ast.symbols[n].scope].push_back(n);
+        }
+    }
+
+    Result<int> function(NodeId block, SymbolIndex procedure){
+        size_t index = program_.functions.size();
+        program_.functions.emplace_back();
+        SSAFunction& f = program_.functions[index];
+        f.procedure = procedure;
+        f.scope = ast_[block].value;
+
+        // procedures declared here are built first, in source order, so the
+        // function list is in preorder
+        for (NodeId child : ast_.children(block)){
+            if (ast_.kind(child) != NodeKind::Procedure) continue;
+            Result<int> res = function(ast_.child(child, 1), ast_[child].value);
+            if (!res.isOk) return res;
+        }
+
+        // vector growth may have moved it
+        f_ = &program_.functions[index];
+        constants_.clear();
+        locals_ = vars_of_scope_[f_->scope];
+        for (size_t i = 0; i < locals_.size(); i++) local_of_[locals_[i]] = static_cast<uint32_t>(i);
+        current_ = newBlock();
+        env_.assign(locals_.size(), constant(0));
+        // a call starts with its variables zeroed, also those kept in memory
+        for (SymbolIndex var : memory_of_scope_[f_->scope]) emit(SSAOp::Store, {constant(0)}, var);
+        for (NodeId child : ast_.children(block)){
+            if (ast_.kind(child) == NodeKind::Procedure) continue;
+            Result<int> res = statement(child);
+            if (!res.isOk) return res;
+        }
+        if (procedure == no_symbol_index){
+            // the inliner's copies are not the program's variables
+            for (size_t i = 0; i < locals_.size(); i++){
+                if (ast_.symbols[locals_[i]].origin == no_symbol_index) emit(SSAOp::Store, {env_[i]}, locals_[i]);
+            }
+        }
+        f_->blocks[current_].terminator = SSATerminator::Return;
+        removeTrivialPhis();
+        return Ok(0);
+    }
+
+    private:
+    BlockId newBlock(){
+        f_->blocks.emplace_back();
+        return static_cast<BlockId>(f_->blocks.size() - 1);
+    }
+
+    ValueId add(SSAOp op, BlockId block, std::vector<ValueId> args, SymbolIndex symbol = no_symbol_index, int64_t constant = 0){
+        f_->values.push_back(SSAValue{op, block, symbol, constant, std::move(args)});
+        return static_cast<ValueId>(f_->values.size() - 1);
+    }
+
+    ValueId emit(SSAOp op, std::vector<ValueId> args, SymbolIndex symbol = no_symbol_index){
+        ValueId v = add(op, current_, std::move(args), symbol);
+        f_->blocks[current_].code.push_back(v);
+        return v;
+    }
+
+    ValueId constant(int64_t value){
+        auto it = constants_.find(value);
+        if (it != constants_.end()) return it->second;
+        ValueId v = add(SSAOp::Const, no_block, {}, no_symbol_index, value);
+        constants_.emplace(value, v);
+        return v;
+    }
+
+    void link(BlockId from, BlockId to){
+        f_->blocks[from].succs.push_back(to);
+        f_->blocks[to].preds.push_back(from);
+    }
+
+    void jump(BlockId to){
+        f_->blocks[current_].terminator = SSATerminator::Jump;
+        link(current_, to);
+    }
+
+    bool isLocal(SymbolIndex var) const {return program_.promoted[var] && ast_.symbols[var].scope == f_->scope;}
+
+    Result<int> statement(NodeId n){
+        ChildRange ch = ast_.children(n);
+        switch (ast_.kind(n)){
+            case NodeKind::Const:
+            case NodeKind::Var:
+            case NodeKind::EmptyStatement:
+                return Ok(0);
+            case NodeKind::Sequence:
+                for (NodeId child : ch){
+                    Result<int> res = statement(child);
+                    if (!res.isOk) return res;
+                }
+                return Ok(0);
+            case NodeKind::Assign:{
+                Result<ValueId> value = expression(ch[1]);
+                if (!value.isOk) return Error<int>(value);
+                SymbolIndex var = ast_.symbol(ch[0]);
+                if (isLocal(var)) env_[local_of_[var]] = *value;
+                else emit(SSAOp::Store, {*value}, var);
+                return Ok(0);
+            }
+            case NodeKind::Call:
+                emit(SSAOp::Call, {}, ast_.symbol(ch[0]));
+                return Ok(0);
+            case NodeKind::If:{
+                Result<int> res = condition(ch[0]);
+                if (!res.isOk) return res;
+                BlockId test = current_;
+                std::vector<ValueId> before = env_;
+                current_ = newBlock();
+                link(test, current_);
+                res = statement(ch[1]);
+                if (!res.isOk) return res;
+                BlockId then_end = current_;
+                BlockId join = newBlock();
+                link(test, join);
+                current_ = then_end;
+                jump(join);
+                current_ = join;
+                for (size_t i = 0; i < env_.size(); i++){
+                    if (env_[i] == before[i]) continue;
+                    ValueId phi = add(SSAOp::Phi, join, {before[i], env_[i]}, locals_[i]);
+                    f_->blocks[join].code.push_back(phi);
+                    env_[i] = phi;
+                }
+                return Ok(0);
+            }
+            case NodeKind::While:{
+                BlockId header = newBlock();
+                jump(header);
+                current_ = header;
+                std::vector<size_t> assigned;
+                assignedLocals(ch[1], assigned);
+                std::vector<ValueId> phis;
+                for (size_t i : assigned){
+                    ValueId phi = add(SSAOp::Phi, header, {env_[i]}, locals_[i]);
+                    f_->blocks[header].code.push_back(phi);
+                    phis.push_back(phi);
+                    env_[i] = phi;
+                }
+                Result<int> res = condition(ch[0]);
+                if (!res.isOk) return res;
+                std::vector<ValueId> at_header = env_;
+                current_ = newBlock();
+                link(header, current_);
+                res = statement(ch[1]);
+                if (!res.isOk) return res;
+                jump(header);
+                for (size_t k = 0; k < assigned.size(); k++) f_->values[phis[k]].args.push_back(env_[assigned[k]]);
+                BlockId exit = newBlock();
+                link(header, exit);
+                current_ = exit;
+                env_ = std::move(at_header);
+                return Ok(0);
+            }
+            default:
+                return Error<int>(ErrorType::InvalidSyntax);
+        }
+    }
+
+    // ends the current block with a branch on the condition n
+    Result<int> condition(NodeId n){
+        if (ast_.kind(n) != NodeKind::Condition) return Error<int>(ErrorType::InvalidSyntax);
+        ChildRange ch = ast_.children(n);
+        SSABlock* block;
+        if (ch.size() == 2){
+            Result<ValueId> value = expression(ch[1]);
+            if (!value.isOk) return Error<int>(value);
+            block = &f_->blocks[current_];
+            block->relation = TokenKind::Odd;
+            block->lhs = *value;
+        }else if (ch.size() == 3){
+            Result<ValueId> lhs = expression(ch[0]);
+            if (!lhs.isOk) return Error<int>(lhs);
+            Result<ValueId> rhs = expression(ch[2]);
+            if (!rhs.isOk) return Error<int>(rhs);
+            block = &f_->blocks[current_];
+            block->relation = ast_.op(ch[1]);
+            block->lhs = *lhs;
+            block->rhs = *rhs;
+        }else return Error<int>(ErrorType::InvalidSyntax);
+        block->terminator = SSATerminator::Branch;
+        return Ok(0);
+    }
+
+    Result<ValueId> expression(NodeId n){
+        if (ast_.kind(n) == NodeKind::Calc) return calc(n);
+        switch (ast_.kind(n)){
+            case NodeKind::Number:
+                return Ok(constant(ast_.number(n)));
+            case NodeKind::Ident:{
+                SymbolIndex symbol = ast_.symbol(n);
+                const SymbolInfo& sym = ast_.symbols[symbol];
+                if (sym.kind == IdentType::ConstIdent) return Ok(constant(sym.value));
+                if (sym.kind != IdentType::VarIdent) return Error<ValueId>(ErrorType::InvalidSyntax);
+                if (isLocal(symbol)) return Ok(env_[local_of_[symbol]]);
+                return Ok(emit(SSAOp::Load, {}, symbol));
+            }
+            default:
+                return Error<ValueId>(ErrorType::InvalidSyntax);
+        }
+    }
+
+    // parentheses nest without limit: the open Calcs are kept on a stack,
+    // each with its running value, instead of recursing
+    Result<ValueId> calc(NodeId n){
+        struct Frame{
+            NodeId node;
+            size_t next;        // the child that gives the next operand
+            ValueId value;
+        };
+        std::vector<Frame> frames;
+        auto open = [&](NodeId node) -> Result<int>{
+            if (ast_.children(node).size() < 2) return Error<int>(ErrorType::InvalidSyntax);
+            // leading sign: 0 +/- term
+            if (ast_.kind(ast_.child(node, 0)) == NodeKind::Operator) frames.push_back({node, 1, constant(0)});
+            else frames.push_back({node, 0, no_value});
+            return Ok(0);
+        };
+        Result<int> opened = open(n);
+        if (!opened.isOk) return Error<ValueId>(opened);
+        while (true){
+            Frame& top = frames.back();
+            ChildRange ch = ast_.children(top.node);
+            ValueId value;
+            if (top.next >= ch.size()){
+                value = top.value;
+                frames.pop_back();
+                if (frames.empty()) return Ok(value);
+            }else{
+                NodeId operand = ch[top.next];
+                if (ast_.kind(operand) == NodeKind::Calc){
+                    opened = open(operand);
+                    if (!opened.isOk) return Error<ValueId>(opened);
+                    continue;
+                }
+                Result<ValueId> res = expression(operand);
+                if (!res.isOk) return res;
+                value = *res;
+            }
+            Frame& into = frames.back();
+            if (into.next){
+                SSAOp op;
+                switch (ast_.op(ast_.child(into.node, into.next - 1))){
+                    case TokenKind::Plus: op = SSAOp::Add; break;
+                    case TokenKind::Minus: op = SSAOp::Sub; break;
+                    case TokenKind::Times: op = SSAOp::Mul; break;
+                    case TokenKind::Slash: op = SSAOp::Div; break;
+                    default: return Error<ValueId>(ErrorType::InvalidSyntax);
+                }
+                value = emit(op, {into.value, value});
+            }
+            into.value = value;
+            into.next += 2;
+        }
+    }
+
+    // promoted locals the statement n may assign, each once
+    void assignedLocals(NodeId n, std::vector<size_t>& out){
+        std::vector<char> seen(locals_.size(), 0);
+        std::vector<NodeId> stack{n};
+        while (!stack.empty()){
+            NodeId node = stack.back();
+            stack.pop_back();
+            NodeKind kind = ast_.kind(node);
+            if (kind == NodeKind::Assign){
+                SymbolIndex var = ast_.symbol(ast_.child(node, 0));
+                if (isLocal(var) && !seen[local_of_[var]]){
+                    seen[local_of_[var]] = 1;
+                    out.push_back(local_of_[var]);
+                }
+            }else if (kind == NodeKind::Sequence || kind == NodeKind::If || kind == NodeKind::While){
+                for (NodeId child : ast_.children(node)) stack.push_back(child);
+            }
+        }
+        std::sort(out.begin(), out.end());
+    }
+
+    // A phi whose arguments are all one value or itself stands for that
+    // value. Replacing it can make other phis trivial, so this runs until
+    // nothing changes.
+    void removeTrivialPhis(){
+        SSAFunction& f = *f_;
+        std::vector<ValueId> forward(f.values.size(), no_value);
+        auto resolve = [&](ValueId v){
+            while (v != no_value && forward[v] != no_value) v = forward[v];
+            return v;
+        };
+        bool changed = true;
+        while (changed){
+            changed = false;
+            for (SSABlock& block : f.blocks){
+                for (ValueId v : block.code){
+                    SSAValue& value = f.values[v];
+                    if (value.op != SSAOp::Phi || forward[v] != no_value) continue;
+                    ValueId same = no_value;
+                    bool trivial = true;
+                    for (ValueId arg : value.args){
+                        arg = resolve(arg);
+                        if (arg == v || arg == same) continue;
+                        if (same != no_value){
+                            trivial = false;
+                            break;
+                        }
+                        same = arg;
+                    }
+                    if (!trivial || same == no_value) continue;
+                    forward[v] = same;
+                    changed = true;
+                }
+            }
+        }
+        for (SSABlock& block : f.blocks){
+            size_t kept = 0;
+            for (ValueId v : block.code){
+                if (forward[v] == no_value) block.code[kept++] = v;
+            }
+            block.code.resize(kept);
+            block.lhs = resolve(block.lhs);
+            block.rhs = resolve(block.rhs);
+        }
+        for (SSAValue& value : f.values){
+            for (ValueId& arg : value.args) arg = resolve(arg);
+        }
+    }
+
+    const AST& ast_;
+    SSAProgram& program_;
+    SSAFunction* f_ = nullptr;
+    BlockId current_ = 0;
+    std::vector<ValueId> env_;                      // by local index
+    std::vector<std::vector<SymbolIndex>> vars_of_scope_;  // promoted variables by ScopeId
+    std::vector<std::vector<SymbolIndex>> memory_of_scope_; // the others, by ScopeId
+    std::vector<SymbolIndex> locals_;               // promoted variables of this function
+    std::vector<uint32_t> local_of_;                // by SymbolIndex, index into locals_
+    std::unordered_map<int64_t, ValueId> constants_;
+};
+
+// variables some nested procedure reads or writes stay in memory
+std::vector<char> promotable(const AST& ast){
+    std::vector<char> promoted(ast.symbols.size(), 0);
+    for (SymbolIndex n = 0; n < ast.symbols.size(); n++) promoted[n] = ast.symbols[n].kind == IdentType::VarIdent;
+    std::vector<std::pair<NodeId, ScopeId>> stack{{ast.root, 0}};
+    while (!stack.empty()){
+        auto [node, scope] = stack.back();
+        stack.pop_back();
+        NodeKind kind = ast.kind(node);
+        if (kind == NodeKind::Block) scope = ast[node].value;
+        if (kind == NodeKind::Ident){
+            SymbolIndex var = ast.symbol(node);
+            if (ast.symbols[var].kind == IdentType::VarIdent && ast.symbols[var].scope != scope) promoted[var] = 0;
+            continue;
+        }
+        for (NodeId child : ast.children(node)) stack.push_back({child, scope});
+    }
+    return promoted;
+}
+
+void printValue(std::ostream& os, const SSAFunction& f, ValueId v){
+    if (v == no_value) os << "?";
+    else if (f.isConst(v)) os << f.values[v].constant;
+    else os << "v" << v;
+}
+
+}
+
+Result<SSAProgram> buildSSA(const AST& ast){
+    if (ast.root == no_node || ast.kind(ast.root) != NodeKind::Program || ast.children(ast.root).empty()){
+        return Error<SSAProgram>(ErrorType::Empty);
+    }
+    SSAProgram program;
+    program.promoted = promotable(ast);
+    SSABuilder builder(ast, program);
+    Result<int> res = builder.function(ast.child(ast.root, 0), no_symbol_index);
+    if (!res.isOk) return Error<SSAProgram>(res);
+    return Ok(std::move(program));
+}
+
+void SSAProgram::print(std::ostream& os, const AST& ast) const{
+    auto name = [&](SymbolIndex symbol){return ast.interner->str(ast.symbols[symbol].name);};
+    for (const SSAFunction& f : functions){
+        os << "function " << (f.procedure == no_symbol_index ? "main" : name(f.procedure)) << "\n";
+        for (BlockId b = 0; b < f.blocks.size(); b++){
+            const SSABlock& block = f.blocks[b];
+            os << "b" << b << ":";
+            if (!block.preds.empty()){
+                os << "\t\t; preds";
+                for (BlockId p : block.preds) os << " b" << p;
+            }
+            os << "\n";
+            for (ValueId v : block.code){
+                const SSAValue& value = f.values[v];
+                os << "\t";
+                if (value.op != SSAOp::Store && value.op != SSAOp::Call) os << "v" << v << " = ";
+                os << ssaOpName(value.op);
+                if (value.op == SSAOp::Const) os << " " << value.constant;
+                if (value.symbol != no_symbol_index) os << " " << name(value.symbol);
+                for (size_t i = 0; i < value.args.size(); i++){
+                    os << (i || value.symbol != no_symbol_index ? ", " : " ");
+                    printValue(os, f, value.args[i]);
+                    if (value.op == SSAOp::Phi && i < block.preds.size()) os << " b" << block.preds[i];
+                }
+                os << "\n";
+            }
+            switch (block.terminator){
+                case SSATerminator::Jump:
+                    os << "\tjmp b" << block.succs[0] << "\n";
+                    break;
+                case SSATerminator::Branch:
+                    os << "\tbr ";
+                    if (block.relation == TokenKind::Odd){
+                        os << "odd ";
+                        printValue(os, f, block.lhs);
+                    }else{
+                        printValue(os, f, block.lhs);
+                        os << " " << kindSpelling(block.relation) << " ";
+                        printValue(os, f, block.rhs);
+                    }
+                    os << ", b" << block.succs[0] << ", b" << block.succs[1] << "\n";
+                    break;
+                case SSATerminator::Return:
+                    os << "\tret\n";
+                    break;
+            }
+        }
+        os << "\n";
+    }
+}
+
+}
@@ -0,0 +1,458 @@
+#include <algorithm>
+#include "../include/asm.hpp"
+#include "../include/strength.hpp"
+
+namespace plc {
+
+namespace {
+
+struct Interval{
+    uint32_t start;
+    uint32_t end;
+    ValueId value;
+};
+
+std::string blockLabel(size_t function, BlockId block){
+    return "_block" + std::to_string(function) + "_" + std::to_string(block);
+}
+
+Opcode branchOpcode(TokenKind relation){
+    switch (relation){
+        case TokenKind::Equal: return Opcode::Je;
+        case TokenKind::Hash:
+        case TokenKind::NotEqual: return Opcode::Jne;
+        case TokenKind::Less: return Opcode::Jl;
+        case TokenKind::LessEqual: return Opcode::Jle;
+        case TokenKind::Greater: return Opcode::Jg;
+        case TokenKind::GreaterEqual: return Opcode::Jge;
+        default: return Opcode::Jnz;
+    }
+}
+
+// Lowers one function of plan.ssa into the lines of its label. rax, rbx,
+// rcx and rdx are scratch, values live where plan.allocations put them.
+// Frames follow the AST backend's model: below rbp the links and the
+// variables, then the registers the procedure saves and its spill slots,
+// which are addressed from rsp.
+class SSAEmitter{
+    public:
+    SSAEmitter(const AST& ast, const CodegenPlan& plan, const CodegenOptions& options, size_t function, std::vector<Instruction>& out):
+        ast_(ast),plan_(plan),options_(options),index_(function),f_(plan.ssa.functions[function]),
+        allocation_(plan.allocations[function]),out_(out),depth_(ast.symbols.scope(f_.scope).depth){}
+
+    Result<int> run(){
+        bool main = f_.procedure == no_symbol_index;
+        uint32_t vars = ast_.symbols.scope(f_.scope).vars;
+        uint32_t spills = allocation_.spill_slots;
+        if (main && options_.host_call){
+            for (Reg r : host_saved_registers) emit(Opcode::Push, reg(r));
+            emit(Opcode::Mov, reg(Reg::rbp), reg(Reg::rdi));
+            vars = 0;
+        }else if (main) emit(Opcode::Mov, reg(Reg::rbp), reg(Reg::rsp));
+        else enterFrame(out_, options_.frame_links, depth_);
+        if (vars) emit(Opcode::Sub, reg(Reg::rsp), imm(8*vars));
+        std::vector<Reg> saved = savedRegisters();
+        for (Reg r : saved) emit(Opcode::Push, reg(r));
+        if (spills) emit(Opcode::Sub, reg(Reg::rsp), imm(8*spills));
+
+        for (BlockId b = 0; b < f_.blocks.size(); b++){
+            const SSABlock& block = f_.blocks[b];
+            if (b) out_.emplace_back(Opcode::Label, blockLabel(index_, b));
+            for (ValueId v : block.code){
+                Result<int> res = value(v);
+                if (!res.isOk) return res;
+            }
+            switch (block.terminator){
+                case SSATerminator::Jump:
+                    phiMoves(b, block.succs[0]);
+                    if (block.succs[0] != b + 1) out_.emplace_back(Opcode::Jmp, blockLabel(index_, block.succs[0]));
+                    break;
+                case SSATerminator::Branch:
+                    branch(b);
+                    break;
+                case SSATerminator::Return:
+                    if (main && !options_.host_call){
+                        emit(Opcode::Mov, reg(Reg::rax), imm(60));
+                        emit(Opcode::Xor, reg(Reg::rdi), reg(Reg::rdi));
+                        emit(Opcode::Syscall);
+                        break;
+                    }
+                    if (spills) emit(Opcode::Add, reg(Reg::rsp), imm(8*spills));
+                    for (auto r = saved.rbegin(); r != saved.rend(); ++r) emit(Opcode::Pop, reg(*r));
+                    if (!main){
+                        emit(Opcode::Mov, reg(Reg::rsp), reg(Reg::rbp));
+                        emit(Opcode::Pop, reg(Reg::rbp));
+                    }else{
+                        for (auto r = host_saved_registers.rbegin(); r != host_saved_registers.rend(); ++r) emit(Opcode::Pop, reg(*r));
+                    }
+                    emit(Opcode::Ret);
+                    break;
+            }
+        }
+        return Ok(0);
+    }
+
+    private:
+    void emit(Opcode op, Operand dst = {}, Operand src = {}){
+        out_.emplace_back(op, dst, src);
+    }
+
+    // the main program has no caller whose registers it must keep
+    std::vector<Reg> savedRegisters() const{
+        if (f_.procedure == no_symbol_index) return {};
+        return allocation_.saved;
+    }
+
+    // a variable of an enclosing procedure goes through rcx
+    Result<Operand> variable(SymbolIndex var){
+        const SymbolInfo& sym = ast_.symbols[var];
+        if (sym.kind != IdentType::VarIdent || sym.depth > depth_) return Error<Operand>(ErrorType::ValueNotFoundError);
+        int64_t offset = frameOffset(ast_.symbols, var, options_.frame_links, options_.host_call);
+        if (sym.depth == depth_) return Ok(mem(Reg::rbp, offset));
+        loadFrame(out_, options_.frame_links, depth_, sym.depth, Reg::rcx);
+        return Ok(mem(Reg::rcx, offset));
+    }
+
+    Operand location(ValueId v) const{
+        if (f_.isConst(v)) return imm(f_.values[v].constant);
+        return allocation_.location[v];
+    }
+
+    // mov that goes through rax where x86 has no direct form
+    void move(const Operand& dst, const Operand& src){
+        if (dst == src) return;
+        if (dst.isMem() && (src.isMem() || (src.isImm() && !src.isImm32()))){
+            emit(Opcode::Mov, reg(Reg::rax), src);
+            emit(Opcode::Mov, dst, reg(Reg::rax));
+        }else emit(Opcode::Mov, dst, src);
+    }
+
+    // an operand the instruction can take as its source
+    Operand source(Operand o, Reg scratch){
+        if (o.isImm() && !o.isImm32()){
+            emit(Opcode::Mov, reg(scratch), o);
+            return reg(scratch);
+        }
+        return o;
+    }
+
+    Result<int> value(ValueId v){
+        const SSAValue& value = f_.values[v];
+        switch (value.op){
+            case SSAOp::Const:
+            case SSAOp::Phi:
+                return Ok(0);
+            case SSAOp::Add:
+            case SSAOp::Sub:
+            case SSAOp::Mul:{
+                Opcode op = value.op == SSAOp::Add ? Opcode::Add : value.op == SSAOp::Sub ? Opcode::Sub : Opcode::Imul;
+                Operand dst = location(v), a = location(value.args[0]), b = location(value.args[1]);
+                if (op != Opcode::Sub && ((b == dst && a != dst) || (op == Opcode::Imul && a.isImm()))) std::swap(a, b);
+                // straight into the destination register unless that is the right operand
+                bool direct = dst.isReg() && b != dst;
+                Operand acc = direct ? dst : reg(Reg::rax);
+                move(acc, a);
+                if (op == Opcode::Imul && b.isImm() && options_.strength_reduce) multiplyByConstant(out_, acc.reg, b.value, Reg::rcx);
+                else emit(op, acc, source(b, Reg::rcx));
+                if (!direct) move(dst, acc);
+                return Ok(0);
+            }
+            case SSAOp::Div:{
+                Operand divisor = location(value.args[1]);
+                move(reg(Reg::rax), location(value.args[0]));
+                if (divisor.isImm() && options_.strength_reduce && divideByConstant(out_, divisor.value)){
+                    move(location(v), reg(Reg::rax));
+                    return Ok(0);
+                }
+                emit(Opcode::Cqo);
+                if (divisor.isImm()){
+                    emit(Opcode::Mov, reg(Reg::rbx), divisor);
+                    divisor = reg(Reg::rbx);
+                }
+                emit(Opcode::Idiv, divisor);
+                move(location(v), reg(Reg::rax));
+                return Ok(0);
+            }
+            case SSAOp::Load:{
+                Result<Operand> var = variable(value.symbol);
+                if (!var.isOk) return Error<int>(var);
+                move(location(v), *var);
+                return Ok(0);
+            }
+            case SSAOp::Store:{
+                Result<Operand> var = variable(value.symbol);
+                if (!var.isOk) return Error<int>(var);
+                move(*var, location(value.args[0]));
+                return Ok(0);
+            }
+            case SSAOp::Call:{
+                const std::vector<std::string>& labels = plan_.procedure_labels;
+                if (value.symbol >= labels.size() || labels[value.symbol].empty()) return Error<int>(ErrorType::SymbolLookupError);
+                passFrame(out_, options_.frame_links, depth_, ast_.symbols[value.symbol].depth);
+                out_.emplace_back(Opcode::Call, labels[value.symbol]);
+                return Ok(0);
+            }
+        }
+        return Error<int>(ErrorType::CompileError);
+    }
+
+    // The copies into the phis of to along the edge from, as one parallel
+    // move: a copy waits while another still reads its destination, and a
+    // cycle of them is broken through rbx.
+    void phiMoves(BlockId from, BlockId to){
+        const SSABlock& target = f_.blocks[to];
+        size_t edge = std::find(target.preds.begin(), target.preds.end(), from) - target.preds.begin();
+        std::vector<std::pair<Operand, Operand>> moves;
+        for (ValueId v : target.code){
+            const SSAValue& phi = f_.values[v];
+            if (phi.op != SSAOp::Phi) break;
+            Operand dst = location(v), src = location(phi.args[edge]);
+            if (dst != src) moves.emplace_back(dst, src);
+        }
+        while (!moves.empty()){
+            bool progress = false;
+            for (size_t i = 0; i < moves.size() && !progress; i++){
+                bool read = false;
+                for (size_t j = 0; j < moves.size() && !read; j++) read = j != i && moves[j].second == moves[i].first;
+                if (read) continue;
+                move(moves[i].first, moves[i].second);
+                moves.erase(moves.begin() + i);
+                progress = true;
+            }
+            if (progress) continue;
+            Operand held = moves[0].first;
+            emit(Opcode::Mov, reg(Reg::rbx), held);
+            for (auto& m : moves){
+                if (m.second == held) m.second = reg(Reg::rbx);
+            }
+        }
+    }
+
+    void branch(BlockId b){
+        const SSABlock& block = f_.blocks[b];
+        Operand lhs = location(block.lhs);
+        if (block.relation == TokenKind::Odd){
+            // a literal's parity is known
+            if (lhs.isImm()){
+                BlockId to = block.succs[lhs.value & 1 ? 0 : 1];
+                if (to != b + 1) out_.emplace_back(Opcode::Jmp, blockLabel(index_, to));
+                return;
+            }
+            emit(Opcode::Test, lhs, imm(1));
+        }else{
+            Operand rhs = location(block.rhs);
+            // cmp takes neither an immediate nor, with memory, more memory on the left
+            if (lhs.isImm() || (lhs.isMem() && rhs.isMem())){
+                emit(Opcode::Mov, reg(Reg::rax), lhs);
+                lhs = reg(Reg::rax);
+            }
+            emit(Opcode::Cmp, lhs, source(rhs, Reg::rcx));
+        }
+        Opcode jump = branchOpcode(block.relation);
+        BlockId taken = block.succs[0], other = block.succs[1];
+        if (taken == b + 1){
+            out_.emplace_back(invertJump(jump), blockLabel(index_, other));
+            return;
+        }
+        out_.emplace_back(jump, blockLabel(index_, taken));
+        if (other != b + 1) out_.emplace_back(Opcode::Jmp, blockLabel(index_, other));
+    }
+
+    const AST& ast_;
+    const CodegenPlan& plan_;
+    const CodegenOptions& options_;
+    size_t index_;
+    const SSAFunction& f_;
+    const SSAAllocation& allocation_;
+    std::vector<Instruction>& out_;
+    uint32_t depth_;
+};
+
+}
+
+SSAAllocation allocateSSA(const SSAFunction& f){
+    SSAAllocation out;
+    out.location.assign(f.values.size(), Operand{});
+    size_t blocks = f.blocks.size();
+
+    // phis sit at the start of their block, a block's end is its terminator
+    // and the copies into its successor's phis
+    std::vector<uint32_t> block_start(blocks), block_end(blocks);
+    std::vector<uint32_t> position(f.values.size(), 0);
+    std::vector<Interval> intervals(f.values.size(), Interval{UINT32_MAX, 0, no_value});
+    uint32_t pos = 0;
+    for (BlockId b = 0; b < blocks; b++){
+        block_start[b] = pos++;
+        for (ValueId v : f.blocks[b].code){
+            SSAOp op = f.values[v].op;
+            if (op == SSAOp::Const) continue;
+            position[v] = op == SSAOp::Phi ? block_start[b] : pos++;
+            if (op != SSAOp::Store && op != SSAOp::Call) intervals[v] = Interval{position[v], position[v], v};
+        }
+        block_end[b] = pos++;
+    }
+
+    // uses in a block other than the definition's; liveness flows back from them
+    std::vector<std::pair<ValueId, BlockId>> far_uses;
+    auto use = [&](ValueId v, BlockId block, uint32_t at){
+        if (v == no_value || f.isConst(v) || intervals[v].value == no_value) return;
+        intervals[v].end = std::max(intervals[v].end, at);
+        if (f.values[v].block != block) far_uses.emplace_back(v, block);
+    };
+    for (BlockId b = 0; b < blocks; b++){
+        const SSABlock& block = f.blocks[b];
+        for (ValueId v : block.code){
+            const SSAValue& value = f.values[v];
+            if (value.op == SSAOp::Const) continue;
+            if (value.op != SSAOp::Phi){
+                for (ValueId arg : value.args) use(arg, b, position[v]);
+                continue;
+            }
+            // read at the end of each predecessor, and written there too
+            for (size_t i = 0; i < value.args.size() && i < block.preds.size(); i++){
+                BlockId pred = block.preds[i];
+                use(value.args[i], pred, block_end[pred]);
+                intervals[v].start = std::min(intervals[v].start, block_end[pred]);
+                intervals[v].end = std::max(intervals[v].end, block_end[pred]);
+            }
+        }
+        if (block.terminator == SSATerminator::Branch){
+            use(block.lhs, b, block_end[b]);
+            use(block.rhs, b, block_end[b]);
+        }
+    }
+    std::sort(far_uses.begin(), far_uses.end());
+    std::vector<ValueId> live_in(blocks, no_value);
+    std::vector<BlockId> work;
+    for (size_t i = 0; i < far_uses.size(); i++){
+        auto [v, block] = far_uses[i];
+        Interval& interval = intervals[v];
+        BlockId def = f.values[v].block;
+        if (live_in[block] == v) continue;
+        live_in[block] = v;
+        work.push_back(block);
+        while (!work.empty()){
+            BlockId b = work.back();
+            work.pop_back();
+            interval.start = std::min(interval.start, block_start[b]);
+            for (BlockId p : f.blocks[b].preds){
+                interval.end = std::max(interval.end, block_end[p]);
+                interval.start = std::min(interval.start, block_end[p]);
+                if (p == def || live_in[p] == v) continue;
+                live_in[p] = v;
+                work.push_back(p);
+            }
+        }
+    }
+
+    std::vector<Interval> order;
+    for (const Interval& interval : intervals){
+        if (interval.value != no_value) order.push_back(interval);
+    }
+    std::sort(order.begin(), order.end(), [](const Interval& a, const Interval& b){
+        return a.start != b.start ? a.start < b.start : a.value < b.value;
+    });
+    std::vector<Interval> active, spilled_active;
+    std::vector<ValueId> holder(allocatable_registers.size(), no_value);
+    std::vector<uint32_t> slot_of(f.values.size(), 0), free_slots, slot_end;
+    uint16_t used = 0;
+    // a victim goes to the stack for its whole interval, so it only takes a
+    // slot whose last holder ended before the victim started
+    auto spill = [&](ValueId v){
+        auto free = std::find_if(free_slots.rbegin(), free_slots.rend(), [&](uint32_t s){return slot_end[s] < intervals[v].start;});
+        uint32_t slot;
+        if (free != free_slots.rend()){
+            slot = *free;
+            free_slots.erase(std::next(free).base());
+        }else{
+            slot = out.spill_slots++;
+            slot_end.push_back(0);
+        }
+        slot_of[v] = slot;
+        slot_end[slot] = intervals[v].end;
+        out.location[v] = mem(Reg::rsp, 8*static_cast<int64_t>(slot));
+        spilled_active.push_back(intervals[v]);
+    };
+    for (const Interval& current : order){
+        auto expire = [&](std::vector<Interval>& list, bool registers){
+            size_t kept = 0;
+            for (const Interval& a : list){
+                if (a.end >= current.start){
+                    list[kept++] = a;
+                    continue;
+                }
+                if (registers){
+                    auto r = std::find(holder.begin(), holder.end(), a.value);
+                    if (r != holder.end()) *r = no_value;
+                }else free_slots.push_back(slot_of[a.value]);
+            }
+            list.resize(kept);
+        };
+        expire(active, true);
+        expire(spilled_active, false);
+        auto free = std::find(holder.begin(), holder.end(), no_value);
+        if (free != holder.end()){
+            *free = current.value;
+            size_t r = free - holder.begin();
+            out.location[current.value] = reg(allocatable_registers[r]);
+            used |= static_cast<uint16_t>(1u << r);
+            active.push_back(current);
+            continue;
+        }
+        // no register left: the interval that ends last goes to the stack
+        auto last = std::max_element(active.begin(), active.end(), [](const Interval& a, const Interval& b){return a.end < b.end;});
+        if (last->end > current.end){
+            ValueId victim = last->value;
+            auto r = std::find(holder.begin(), holder.end(), victim);
+            *r = current.value;
+            out.location[current.value] = out.location[victim];
+            *last = current;
+            spill(victim);
+        }else spill(current.value);
+    }
+    for (size_t r = 0; r < allocatable_registers.size(); r++){
+        if (used & (1u << r)) out.saved.push_back(allocatable_registers[r]);
+    }
+    for (const Interval& interval : order){
+        (out.location[interval.value].isReg() ? out.allocated : out.spilled)++;
+    }
+    return out;
+}
+
+Result<int> NASMLinuxELF64::lowerSSA(CompilationContext& ctx){
+    const AST& input = ctx.ast;
+    {
+        ScopedTimer timer(ctx.report, Phase::SSA);
+        Result<SSAProgram> program = buildSSA(input);
+        if (!program.isOk) return Error<int>(program);
+        own_plan_.ssa = std::move(*program);
+    }
+    std::vector<SSAFunction>& functions = own_plan_.ssa.functions;
+    if (options_.ssa_passes){
+        ScopedTimer timer(ctx.report, Phase::SSAOptimize);
+        for (SSAFunction& f : functions) ssa_stats_ += optimizeSSA(f, input.symbols);
+    }
+    {
+        ScopedTimer timer(ctx.report, Phase::RegisterAllocation);
+        for (size_t i = 0; i < functions.size(); i++){
+            splitCriticalEdges(functions[i]);
+            own_plan_.allocations.push_back(allocateSSA(functions[i]));
+            own_plan_.registers.allocated += own_plan_.allocations.back().allocated;
+            own_plan_.registers.spilled += own_plan_.allocations.back().spilled;
+        }
+    }
+    return runJobs(ctx, functions.size(), [&input](NASMLinuxELF64& worker, size_t function){
+        return worker.generateSSA(input, function);
+    });
+}
+
+// Runs on a private generator whose text holds just this function's label.
+Result<int> NASMLinuxELF64::generateSSA(const AST& ast, size_t function){
+    const SSAFunction& f = plan_->ssa.functions[function];
+    text = Section(".text");
+    text.labels.emplace_back(f.procedure == no_symbol_index ? std::string("_start") : plan_->procedure_labels[f.procedure]);
+    SSAEmitter emitter(ast, *plan_, options_, function, text.labels[0].lines);
+    return emitter.run();
+}
+
+}
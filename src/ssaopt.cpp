@@ -0,0 +1,727 @@
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include "../include/optimize.hpp"
+#include "../include/ssa.hpp"
+
+namespace plc {
+
+namespace {
+
+TokenKind arithmeticToken(SSAOp op){
+    switch (op){
+        case SSAOp::Add: return TokenKind::Plus;
+        case SSAOp::Sub: return TokenKind::Minus;
+        case SSAOp::Mul: return TokenKind::Times;
+        default: return TokenKind::Slash;
+    }
+}
+
+// Values replaced by others are recorded here and rewritten in one sweep,
+// so a pass never has to find the users of a value.
+class Forwarding{
+    public:
+    explicit Forwarding(const SSAFunction& f):to_(f.values.size(), no_value){}
+
+    ValueId resolve(ValueId v) const{
+        while (v != no_value && to_[v] != no_value) v = to_[v];
+        return v;
+    }
+    void replace(ValueId from, ValueId to){
+        to_[from] = to;
+        any_ = true;
+    }
+    [[nodiscard]] bool forwarded(ValueId v) const {return to_[v] != no_value;}
+
+    // drops the replaced values and points every use at what replaced them
+    void apply(SSAFunction& f) const{
+        if (!any_) return;
+        for (SSABlock& block : f.blocks){
+            size_t kept = 0;
+            for (ValueId v : block.code){
+                if (!forwarded(v)) block.code[kept++] = v;
+            }
+            block.code.resize(kept);
+            block.lhs = resolve(block.lhs);
+            block.rhs = resolve(block.rhs);
+        }
+        for (SSAValue& value : f.values){
+            for (ValueId& arg : value.args) arg = resolve(arg);
+        }
+    }
+
+    private:
+    std::vector<ValueId> to_;
+    bool any_ = false;
+};
+
+// removes the edge from -> to, with the matching argument of every phi in to
+void removeEdge(SSAFunction& f, BlockId from, BlockId to){
+    SSABlock& target = f.blocks[to];
+    for (size_t i = 0; i < target.preds.size(); i++){
+        if (target.preds[i] != from) continue;
+        target.preds.erase(target.preds.begin() + i);
+        for (ValueId v : target.code){
+            SSAValue& value = f.values[v];
+            if (value.op == SSAOp::Phi && i < value.args.size()) value.args.erase(value.args.begin() + i);
+        }
+        break;
+    }
+    std::vector<BlockId>& succs = f.blocks[from].succs;
+    for (size_t i = 0; i < succs.size(); i++){
+        if (succs[i] != to) continue;
+        succs.erase(succs.begin() + i);
+        break;
+    }
+}
+
+// keeps the blocks listed in order, in that order; edges only lead to kept blocks
+void reorder(SSAFunction& f, const std::vector<BlockId>& order){
+    std::vector<BlockId> new_id(f.blocks.size(), no_block);
+    for (size_t i = 0; i < order.size(); i++) new_id[order[i]] = static_cast<BlockId>(i);
+    std::vector<SSABlock> blocks;
+    blocks.reserve(order.size());
+    for (BlockId b : order){
+        blocks.push_back(std::move(f.blocks[b]));
+        for (BlockId& p : blocks.back().preds) p = new_id[p];
+        for (BlockId& s : blocks.back().succs) s = new_id[s];
+    }
+    for (SSAValue& value : f.values){
+        if (value.block != no_block) value.block = new_id[value.block];
+    }
+    f.blocks = std::move(blocks);
+}
+
+bool isPhi(const SSAFunction& f, ValueId v){
+    return f.values[v].op == SSAOp::Phi;
+}
+
+// stores and calls change memory; a division may trap
+bool hasSideEffects(const SSAFunction& f, const SSAValue& value){
+    switch (value.op){
+        case SSAOp::Store:
+        case SSAOp::Call:
+            return true;
+        case SSAOp::Div:{
+            ValueId divisor = value.args[1];
+            if (!f.isConst(divisor)) return true;
+            int64_t c = f.values[divisor].constant;
+            return c == 0 || c == -1;
+        }
+        default:
+            return false;
+    }
+}
+
+// Immediate dominators, iterating over reverse postorder as Cooper, Harvey
+// and Kennedy do; unreachable blocks have none.
+std::vector<BlockId> dominators(const SSAFunction& f){
+    size_t count = f.blocks.size();
+    std::vector<BlockId> postorder;
+    std::vector<uint32_t> number(count, UINT32_MAX);
+    std::vector<char> seen(count, 0);
+    std::vector<std::pair<BlockId, size_t>> stack{{0, 0}};
+    seen[0] = 1;
+    while (!stack.empty()){
+        BlockId b = stack.back().first;
+        size_t next = stack.back().second++;
+        if (next < f.blocks[b].succs.size()){
+            BlockId s = f.blocks[b].succs[next];
+            if (!seen[s]){
+                seen[s] = 1;
+                stack.push_back({s, 0});
+            }
+            continue;
+        }
+        number[b] = static_cast<uint32_t>(postorder.size());
+        postorder.push_back(b);
+        stack.pop_back();
+    }
+    std::vector<BlockId> idom(count, no_block);
+    idom[0] = 0;
+    auto intersect = [&](BlockId a, BlockId b){
+        while (a != b){
+            while (number[a] < number[b]) a = idom[a];
+            while (number[b] < number[a]) b = idom[b];
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed){
+        changed = false;
+        for (size_t i = postorder.size(); i-- > 0;){
+            BlockId b = postorder[i];
+            if (b == 0) continue;
+            BlockId d = no_block;
+            for (BlockId p : f.blocks[b].preds){
+                if (idom[p] == no_block) continue;
+                d = d == no_block ? p : intersect(p, d);
+            }
+            if (d != idom[b]){
+                idom[b] = d;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+bool dominates(const std::vector<BlockId>& idom, BlockId a, BlockId b){
+    while (b != a){
+        if (b == 0 || idom[b] == no_block) return false;
+        b = idom[b];
+    }
+    return true;
+}
+
+// a header with the back edges into it, and every block that reaches one
+// of them without passing the header
+struct Loop{
+    BlockId header;
+    std::vector<BlockId> latches;
+    std::vector<char> body;     // by BlockId
+    size_t size = 0;
+};
+
+// innermost loops first
+std::vector<Loop> findLoops(const SSAFunction& f){
+    std::vector<BlockId> idom = dominators(f);
+    std::vector<Loop> loops;
+    for (BlockId h = 0; h < f.blocks.size(); h++){
+        if (idom[h] == no_block) continue;
+        Loop loop{h, {}, {}, 0};
+        for (BlockId p : f.blocks[h].preds){
+            if (idom[p] != no_block && dominates(idom, h, p)) loop.latches.push_back(p);
+        }
+        if (loop.latches.empty()) continue;
+        loop.body.assign(f.blocks.size(), 0);
+        loop.body[h] = 1;
+        loop.size = 1;
+        std::vector<BlockId> work = loop.latches;
+        while (!work.empty()){
+            BlockId b = work.back();
+            work.pop_back();
+            if (loop.body[b]) continue;
+            loop.body[b] = 1;
+            loop.size++;
+            for (BlockId p : f.blocks[b].preds) work.push_back(p);
+        }
+        loops.push_back(std::move(loop));
+    }
+    std::stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b){return a.size < b.size;});
+    return loops;
+}
+
+// the only block entering the loop, which must lead nowhere else
+BlockId preheader(const SSAFunction& f, const Loop& loop){
+    BlockId found = no_block;
+    for (BlockId p : f.blocks[loop.header].preds){
+        if (loop.body[p]) continue;
+        if (found != no_block) return no_block;
+        found = p;
+    }
+    if (found == no_block || f.blocks[found].succs.size() != 1) return no_block;
+    return found;
+}
+
+// An empty block on the entry edge of each loop entered from a branch,
+// laid out right before the header. Loops entered from several blocks
+// are left alone.
+bool insertPreheaders(SSAFunction& f){
+    std::vector<Loop> loops = findLoops(f);
+    size_t count = f.blocks.size();
+    std::vector<BlockId> before(count, no_block);
+    for (const Loop& loop : loops){
+        BlockId h = loop.header;
+        size_t entry = SIZE_MAX;
+        for (size_t i = 0; i < f.blocks[h].preds.size(); i++){
+            if (loop.body[f.blocks[h].preds[i]]) continue;
+            entry = entry == SIZE_MAX ? i : SIZE_MAX - 1;
+        }
+        if (entry >= SIZE_MAX - 1) continue;
+        BlockId p = f.blocks[h].preds[entry];
+        if (f.blocks[p].succs.size() == 1) continue;
+        auto pre = static_cast<BlockId>(f.blocks.size());
+        f.blocks.emplace_back();
+        SSABlock& block = f.blocks.back();
+        block.terminator = SSATerminator::Jump;
+        block.preds.push_back(p);
+        block.succs.push_back(h);
+        for (BlockId& succ : f.blocks[p].succs){
+            if (succ == h) succ = pre;
+        }
+        f.blocks[h].preds[entry] = pre;
+        before[h] = pre;
+    }
+    if (f.blocks.size() == count) return false;
+    std::vector<BlockId> order;
+    order.reserve(f.blocks.size());
+    for (BlockId b = 0; b < count; b++){
+        if (before[b] != no_block) order.push_back(before[b]);
+        order.push_back(b);
+    }
+    reorder(f, order);
+    return true;
+}
+
+// Moves what only depends on values from outside the loop to the end of
+// its preheader, in an order that keeps definitions before uses. Pure
+// arithmetic may run there even if the loop body never would.
+size_t hoistInvariants(SSAFunction& f, const Loop& loop, BlockId pre){
+    std::unordered_set<SymbolIndex> stored;
+    bool calls = false;
+    for (BlockId b = 0; b < f.blocks.size(); b++){
+        if (!loop.body[b]) continue;
+        for (ValueId v : f.blocks[b].code){
+            const SSAValue& value = f.values[v];
+            if (value.op == SSAOp::Store) stored.insert(value.symbol);
+            else if (value.op == SSAOp::Call) calls = true;
+        }
+    }
+    auto outside = [&](ValueId v){
+        BlockId b = f.values[v].block;
+        return f.isConst(v) || b == no_block || !loop.body[b];
+    };
+    size_t hoisted = 0;
+    bool changed = true;
+    while (changed){
+        changed = false;
+        for (BlockId b = 0; b < f.blocks.size(); b++){
+            if (!loop.body[b]) continue;
+            std::vector<ValueId>& code = f.blocks[b].code;
+            size_t kept = 0;
+            for (ValueId v : code){
+                const SSAValue& value = f.values[v];
+                bool invariant = false;
+                switch (value.op){
+                    case SSAOp::Add: case SSAOp::Sub: case SSAOp::Mul: case SSAOp::Div:
+                        invariant = !hasSideEffects(f, value) && std::all_of(value.args.begin(), value.args.end(), outside);
+                        break;
+                    case SSAOp::Load:
+                        invariant = !calls && !stored.count(value.symbol);
+                        break;
+                    default:
+                        break;
+                }
+                if (!invariant){
+                    code[kept++] = v;
+                    continue;
+                }
+                f.values[v].block = pre;
+                f.blocks[pre].code.push_back(v);
+                hoisted++;
+                changed = true;
+            }
+            code.resize(kept);
+        }
+    }
+    return hoisted;
+}
+
+bool powerOfTwo(int64_t c){
+    uint64_t magnitude = c < 0 ? 0 - static_cast<uint64_t>(c) : static_cast<uint64_t>(c);
+    return (magnitude & (magnitude - 1)) == 0;
+}
+
+// For a basic induction variable i = phi(start, i + step), each i * c in
+// the loop becomes j = phi(start * c, j + step * c), stepped at the end of
+// the latch. Products by a power of two are a shift already and are kept.
+size_t reduceInductions(SSAFunction& f, const Loop& loop, BlockId pre){
+    if (loop.latches.size() != 1) return 0;
+    BlockId h = loop.header, latch = loop.latches[0];
+    const std::vector<BlockId>& preds = f.blocks[h].preds;
+    if (preds.size() != 2) return 0;
+    size_t from_pre = preds[0] == pre ? 0 : 1, from_latch = 1 - from_pre;
+    if (preds[from_pre] != pre || preds[from_latch] != latch) return 0;
+
+    auto constant = [&](ValueId v){return f.values[v].constant;};
+    std::unordered_map<ValueId, int64_t> steps;
+    for (ValueId v : f.blocks[h].code){
+        const SSAValue& phi = f.values[v];
+        if (phi.op != SSAOp::Phi) break;
+        const SSAValue& next = f.values[phi.args[from_latch]];
+        if (next.block == no_block || !loop.body[next.block] || next.args.size() != 2) continue;
+        ValueId a = next.args[0], b = next.args[1];
+        if (next.op == SSAOp::Add && a == v && f.isConst(b)) steps[v] = constant(b);
+        else if (next.op == SSAOp::Add && b == v && f.isConst(a)) steps[v] = constant(a);
+        else if (next.op == SSAOp::Sub && a == v && f.isConst(b)) steps[v] = static_cast<int64_t>(0 - static_cast<uint64_t>(constant(b)));
+    }
+    if (steps.empty()) return 0;
+
+    struct Product{
+        ValueId value, induction, factor;
+    };
+    std::vector<Product> products;
+    for (BlockId b = 0; b < f.blocks.size(); b++){
+        if (!loop.body[b]) continue;
+        for (ValueId v : f.blocks[b].code){
+            const SSAValue& value = f.values[v];
+            if (value.op != SSAOp::Mul) continue;
+            for (int side = 0; side < 2; side++){
+                ValueId i = value.args[side], c = value.args[1 - side];
+                if (steps.count(i) && f.isConst(c) && !powerOfTwo(constant(c))){
+                    products.push_back(Product{v, i, c});
+                    break;
+                }
+            }
+        }
+    }
+    auto add = [&](SSAOp op, BlockId block, std::vector<ValueId> args, int64_t c = 0){
+        f.values.push_back(SSAValue{op, block, no_symbol_index, c, std::move(args)});
+        return static_cast<ValueId>(f.values.size() - 1);
+    };
+    std::map<std::pair<ValueId, int64_t>, ValueId> reduced;
+    std::vector<std::pair<ValueId, ValueId>> replaced;
+    for (const Product& product : products){
+        int64_t c = constant(product.factor);
+        ValueId& j = reduced[{product.induction, c}];
+        if (!j){
+            ValueId start = f.values[product.induction].args[from_pre];
+            uint64_t step = static_cast<uint64_t>(steps[product.induction]) * static_cast<uint64_t>(c);
+            ValueId init = add(SSAOp::Mul, pre, {start, product.factor});
+            f.blocks[pre].code.push_back(init);
+            j = add(SSAOp::Phi, h, {init, init});
+            ValueId next = add(SSAOp::Add, latch, {j, add(SSAOp::Const, no_block, {}, static_cast<int64_t>(step))});
+            f.values[j].args[from_latch] = next;
+            f.blocks[latch].code.push_back(next);
+            std::vector<ValueId>& code = f.blocks[h].code;
+            code.insert(code.begin(), j);
+        }
+        replaced.emplace_back(product.value, j);
+    }
+    Forwarding forward(f);
+    for (auto [from, to] : replaced){
+        forward.replace(from, to);
+        f.values[from].block = no_block;
+    }
+    forward.apply(f);
+    return replaced.size();
+}
+
+}
+
+SSAStats foldSSA(SSAFunction& f){
+    SSAStats stats;
+    Forwarding forward(f);
+    auto constantOf = [&](ValueId v, int64_t& c){
+        if (!f.isConst(v)) return false;
+        c = f.values[v].constant;
+        return true;
+    };
+    for (BlockId b = 0; b < f.blocks.size(); b++){
+        for (ValueId v : f.blocks[b].code){
+            SSAValue& value = f.values[v];
+            for (ValueId& arg : value.args) arg = forward.resolve(arg);
+            if (value.op == SSAOp::Phi){
+                // constants folded in place are equal to the shared ones of the same value
+                auto equal = [&](ValueId x, ValueId y){
+                    return x == y || (y != no_value && f.isConst(x) && f.isConst(y) && f.values[x].constant == f.values[y].constant);
+                };
+                ValueId same = no_value;
+                bool trivial = true;
+                for (ValueId arg : value.args){
+                    if (arg == v || equal(arg, same)) continue;
+                    if (same != no_value) trivial = false;
+                    same = arg;
+                }
+                if (trivial && same != no_value){
+                    forward.replace(v, same);
+                    stats.values++;
+                }
+                continue;
+            }
+            if (value.op != SSAOp::Add && value.op != SSAOp::Sub && value.op != SSAOp::Mul && value.op != SSAOp::Div) continue;
+            int64_t a = 0, c = 0, result = 0;
+            bool left = constantOf(value.args[0], a), right = constantOf(value.args[1], c);
+            if (left && right && foldArithmetic(arithmeticToken(value.op), a, c, result)){
+                value.op = SSAOp::Const;
+                value.constant = result;
+                value.args.clear();
+                stats.values++;
+                continue;
+            }
+            // x+0, 0+x, x-0, x*1, 1*x, x/1
+            ValueId same = no_value;
+            if (right && ((c == 0 && (value.op == SSAOp::Add || value.op == SSAOp::Sub)) || (c == 1 && (value.op == SSAOp::Mul || value.op == SSAOp::Div)))){
+                same = value.args[0];
+            }else if (left && ((a == 0 && value.op == SSAOp::Add) || (a == 1 && value.op == SSAOp::Mul))){
+                same = value.args[1];
+            }
+            if (same != no_value){
+                forward.replace(v, same);
+                stats.values++;
+            }else if (value.op == SSAOp::Mul && ((left && a == 0) || (right && c == 0))){
+                value.op = SSAOp::Const;
+                value.constant = 0;
+                value.args.clear();
+                stats.values++;
+            }
+        }
+        SSABlock& block = f.blocks[b];
+        if (block.terminator != SSATerminator::Branch) continue;
+        block.lhs = forward.resolve(block.lhs);
+        block.rhs = forward.resolve(block.rhs);
+        int64_t lhs, rhs = 0;
+        bool taken;
+        if (!constantOf(block.lhs, lhs)) continue;
+        if (block.relation != TokenKind::Odd && !constantOf(block.rhs, rhs)) continue;
+        if (!foldCondition(block.relation, lhs, rhs, taken)) continue;
+        BlockId dead = block.succs[taken ? 1 : 0];
+        removeEdge(f, b, dead);
+        SSABlock& folded = f.blocks[b];
+        folded.terminator = SSATerminator::Jump;
+        folded.lhs = folded.rhs = no_value;
+        stats.values++;
+    }
+    forward.apply(f);
+    return stats;
+}
+
+SSAStats simplifyCFG(SSAFunction& f){
+    SSAStats stats;
+    size_t count = f.blocks.size();
+    std::vector<char> reachable(count, 0);
+    std::vector<BlockId> stack{0};
+    reachable[0] = 1;
+    while (!stack.empty()){
+        BlockId b = stack.back();
+        stack.pop_back();
+        for (BlockId s : f.blocks[b].succs){
+            if (!reachable[s]){
+                reachable[s] = 1;
+                stack.push_back(s);
+            }
+        }
+    }
+    for (BlockId b = 0; b < count; b++){
+        if (reachable[b]) continue;
+        std::vector<BlockId> succs = f.blocks[b].succs;
+        for (BlockId s : succs) removeEdge(f, b, s);
+        for (ValueId v : f.blocks[b].code) f.values[v].block = no_block;
+        f.blocks[b].code.clear();
+        f.blocks[b].preds.clear();
+        stats.blocks++;
+    }
+
+    // a block that is the only way into its successor absorbs it
+    Forwarding forward(f);
+    std::vector<char> merged(count, 0);
+    for (BlockId b = 0; b < count; b++){
+        if (!reachable[b] || merged[b]) continue;
+        while (f.blocks[b].terminator == SSATerminator::Jump){
+            BlockId s = f.blocks[b].succs[0];
+            if (s == b || s == 0 || f.blocks[s].preds.size() != 1) break;
+            SSABlock next = std::move(f.blocks[s]);
+            SSABlock& block = f.blocks[b];
+            for (ValueId v : next.code){
+                // with a single predecessor every phi is a copy
+                if (isPhi(f, v)) forward.replace(v, f.values[v].args[0]);
+                f.values[v].block = b;
+                block.code.push_back(v);
+            }
+            block.succs = std::move(next.succs);
+            block.terminator = next.terminator;
+            block.relation = next.relation;
+            block.lhs = next.lhs;
+            block.rhs = next.rhs;
+            for (BlockId t : block.succs){
+                for (BlockId& p : f.blocks[t].preds){
+                    if (p == s) p = b;
+                }
+            }
+            f.blocks[s] = SSABlock();
+            merged[s] = 1;
+            stats.blocks++;
+        }
+    }
+    forward.apply(f);
+    if (!stats.blocks) return stats;
+    std::vector<BlockId> order;
+    for (BlockId b = 0; b < count; b++){
+        if (reachable[b] && !merged[b]) order.push_back(b);
+    }
+    reorder(f, order);
+    return stats;
+}
+
+// Backward liveness of the variables in memory. A call may read any of
+// them; at the return, a procedure's own frame dies with it while
+// everything outside stays visible, and all of the main program's
+// variables are its result.
+SSAStats eliminateDeadStores(SSAFunction& f, const SymbolTable& symbols){
+    SSAStats stats;
+    std::unordered_map<SymbolIndex, uint32_t> index;
+    std::vector<SymbolIndex> vars;
+    for (const SSABlock& block : f.blocks){
+        for (ValueId v : block.code){
+            const SSAValue& value = f.values[v];
+            if ((value.op == SSAOp::Load || value.op == SSAOp::Store) && index.emplace(value.symbol, vars.size()).second){
+                vars.push_back(value.symbol);
+            }
+        }
+    }
+    if (vars.empty()) return stats;
+    size_t words = (vars.size() + 63) / 64;
+    using Set = std::vector<uint64_t>;
+    Set all(words, ~uint64_t{0}), at_return(words, 0);
+    for (size_t i = 0; i < vars.size(); i++){
+        if (f.procedure == no_symbol_index || symbols[vars[i]].scope != f.scope) at_return[i / 64] |= uint64_t{1} << (i % 64);
+    }
+    auto test = [](const Set& s, uint32_t i){return (s[i / 64] >> (i % 64)) & 1;};
+    auto clear = [](Set& s, uint32_t i){s[i / 64] &= ~(uint64_t{1} << (i % 64));};
+    auto set = [](Set& s, uint32_t i){s[i / 64] |= uint64_t{1} << (i % 64);};
+
+    std::vector<Set> live_in(f.blocks.size(), Set(words, 0));
+    auto liveOut = [&](BlockId b){
+        const SSABlock& block = f.blocks[b];
+        if (block.terminator == SSATerminator::Return) return at_return;
+        Set out(words, 0);
+        for (BlockId s : block.succs){
+            for (size_t w = 0; w < words; w++) out[w] |= live_in[s][w];
+        }
+        return out;
+    };
+    // the final walk drops every store to a variable that is dead after it
+    auto walk = [&](BlockId b, bool drop){
+        Set live = liveOut(b);
+        SSABlock& block = f.blocks[b];
+        std::vector<char> dead(drop ? block.code.size() : 0, 0);
+        for (size_t i = block.code.size(); i-- > 0;){
+            const SSAValue& value = f.values[block.code[i]];
+            if (value.op == SSAOp::Load) set(live, index[value.symbol]);
+            else if (value.op == SSAOp::Call) live = all;
+            else if (value.op == SSAOp::Store){
+                uint32_t var = index[value.symbol];
+                if (drop && !test(live, var)) dead[i] = 1;
+                clear(live, var);
+            }
+        }
+        if (drop){
+            size_t kept = 0;
+            for (size_t i = 0; i < block.code.size(); i++){
+                if (dead[i]){
+                    f.values[block.code[i]].block = no_block;
+                    stats.stores++;
+                }else block.code[kept++] = block.code[i];
+            }
+            block.code.resize(kept);
+        }
+        return live;
+    };
+    bool changed = true;
+    while (changed){
+        changed = false;
+        for (BlockId b = static_cast<BlockId>(f.blocks.size()); b-- > 0;){
+            Set in = walk(b, false);
+            if (in != live_in[b]){
+                live_in[b] = std::move(in);
+                changed = true;
+            }
+        }
+    }
+    for (BlockId b = 0; b < f.blocks.size(); b++) walk(b, true);
+    return stats;
+}
+
+SSAStats eliminateDeadCode(SSAFunction& f){
+    SSAStats stats;
+    std::vector<char> live(f.values.size(), 0);
+    std::vector<ValueId> work;
+    auto mark = [&](ValueId v){
+        if (v == no_value || live[v]) return;
+        live[v] = 1;
+        work.push_back(v);
+    };
+    for (const SSABlock& block : f.blocks){
+        for (ValueId v : block.code){
+            if (hasSideEffects(f, f.values[v])) mark(v);
+        }
+        if (block.terminator == SSATerminator::Branch){
+            mark(block.lhs);
+            mark(block.rhs);
+        }
+    }
+    while (!work.empty()){
+        ValueId v = work.back();
+        work.pop_back();
+        for (ValueId arg : f.values[v].args) mark(arg);
+    }
+    for (SSABlock& block : f.blocks){
+        size_t kept = 0;
+        for (ValueId v : block.code){
+            if (live[v]){
+                block.code[kept++] = v;
+                continue;
+            }
+            if (!f.isConst(v)) stats.values++;
+            f.values[v].block = no_block;
+        }
+        block.code.resize(kept);
+    }
+    return stats;
+}
+
+SSAStats optimizeLoops(SSAFunction& f){
+    SSAStats stats;
+    insertPreheaders(f);
+    for (const Loop& loop : findLoops(f)){
+        BlockId pre = preheader(f, loop);
+        if (pre == no_block) continue;
+        stats.hoisted += hoistInvariants(f, loop, pre);
+        stats.inductions += reduceInductions(f, loop, pre);
+    }
+    return stats;
+}
+
+SSAStats optimizeSSA(SSAFunction& f, const SymbolTable& symbols){
+    SSAStats total;
+    bool loops = false;
+    while (1){
+        SSAStats round = foldSSA(f);
+        round += simplifyCFG(f);
+        round += eliminateDeadStores(f, symbols);
+        round += eliminateDeadCode(f);
+        total += round;
+        if (round.values || round.stores || round.blocks) continue;
+        if (loops) return total;
+        // once, on the simplified CFG; the preheaders it leaves are merged away
+        loops = true;
+        SSAStats moved = optimizeLoops(f);
+        total += moved;
+        if (!moved.hoisted && !moved.inductions) return total;
+    }
+}
+
+void splitCriticalEdges(SSAFunction& f){
+    size_t count = f.blocks.size();
+    std::vector<std::vector<BlockId>> before(count);
+    for (BlockId s = 0; s < count; s++){
+        if (f.blocks[s].preds.size() < 2 || f.blocks[s].code.empty() || !isPhi(f, f.blocks[s].code[0])) continue;
+        for (size_t i = 0; i < f.blocks[s].preds.size(); i++){
+            BlockId p = f.blocks[s].preds[i];
+            if (f.blocks[p].succs.size() < 2) continue;
+            auto split = static_cast<BlockId>(f.blocks.size());
+            f.blocks.emplace_back();
+            SSABlock& edge = f.blocks.back();
+            edge.terminator = SSATerminator::Jump;
+            edge.preds.push_back(p);
+            edge.succs.push_back(s);
+            for (BlockId& succ : f.blocks[p].succs){
+                if (succ == s) succ = split;
+            }
+            f.blocks[s].preds[i] = split;
+            before[s].push_back(split);
+        }
+    }
+    if (f.blocks.size() == count) return;
+    std::vector<BlockId> order;
+    order.reserve(f.blocks.size());
+    for (BlockId b = 0; b < count; b++){
+        order.insert(order.end(), before[b].begin(), before[b].end());
+        order.push_back(b);
+    }
+    reorder(f, order);
+}
+
+}
@@ -0,0 +1,97 @@
+#include "../include/strength.hpp"
+
+namespace plc {
+
+namespace {
+
+int log2Exact(uint64_t v){
+    if (v == 0 || (v & (v - 1))) return -1;
+    int k = 0;
+    while (v > 1){
+        v >>= 1;
+        k++;
+    }
+    return k;
+}
+
+}
+
+// Hacker's Delight 10-1: the smallest p >= 64 with 2^p > nc * (d - 2^p mod d),
+// nc being the largest n with n mod d == d - 1
+DivisionMagic divisionMagic(int64_t d){
+    const uint64_t two63 = uint64_t(1) << 63;
+    uint64_t ad = static_cast<uint64_t>(d);
+    uint64_t anc = two63 - 1 - two63 % ad;
+    uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+    uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+    int p = 63;
+    uint64_t delta;
+    do{
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc){
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad){
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    }while (q1 < delta || (q1 == delta && r1 == 0));
+    return DivisionMagic{static_cast<int64_t>(q2 + 1), p - 64};
+}
+
+void multiplyByConstant(std::vector<Instruction>& out, Reg r, int64_t factor, Reg scratch){
+    if (factor == 1) return;
+    if (factor == 0){
+        out.emplace_back(Opcode::Xor, reg(r), reg(r));
+        return;
+    }
+    uint64_t magnitude = factor < 0 ? 0 - static_cast<uint64_t>(factor) : static_cast<uint64_t>(factor);
+    int k = log2Exact(magnitude);
+    if (k >= 0){
+        if (k > 0) out.emplace_back(Opcode::Shl, reg(r), imm(k));
+        if (factor < 0 && k < 63) out.emplace_back(Opcode::Neg, reg(r));
+        return;
+    }
+    Operand f = imm(factor);
+    if (!f.isImm32()){
+        out.emplace_back(Opcode::Mov, reg(scratch), f);
+        f = reg(scratch);
+    }
+    out.emplace_back(Opcode::Imul, reg(r), f);
+}
+
+bool divideByConstant(std::vector<Instruction>& out, int64_t divisor){
+    if (divisor == 0 || divisor == -1 || divisor == INT64_MIN) return false;
+    if (divisor == 1) return true;
+    int64_t d = divisor < 0 ? -divisor : divisor;
+    int k = log2Exact(static_cast<uint64_t>(d));
+    if (k > 0){
+        // a negative dividend is biased by d-1 so the shift rounds toward zero
+        out.emplace_back(Opcode::Mov, reg(Reg::rdx), reg(Reg::rax));
+        if (k > 1) out.emplace_back(Opcode::Sar, reg(Reg::rdx), imm(63));
+        out.emplace_back(Opcode::Shr, reg(Reg::rdx), imm(64 - k));
+        out.emplace_back(Opcode::Add, reg(Reg::rax), reg(Reg::rdx));
+        out.emplace_back(Opcode::Sar, reg(Reg::rax), imm(k));
+    }else{
+        DivisionMagic magic = divisionMagic(d);
+        out.emplace_back(Opcode::Mov, reg(Reg::rbx), reg(Reg::rax));
+        out.emplace_back(Opcode::Mov, reg(Reg::rax), imm(magic.multiplier));
+        out.emplace_back(Opcode::Imul, reg(Reg::rbx));
+        if (magic.multiplier < 0) out.emplace_back(Opcode::Add, reg(Reg::rdx), reg(Reg::rbx));
+        if (magic.shift > 0) out.emplace_back(Opcode::Sar, reg(Reg::rdx), imm(magic.shift));
+        // the quotient rounded down, plus one for a negative dividend
+        out.emplace_back(Opcode::Shr, reg(Reg::rbx), imm(63));
+        out.emplace_back(Opcode::Add, reg(Reg::rdx), reg(Reg::rbx));
+        out.emplace_back(Opcode::Mov, reg(Reg::rax), reg(Reg::rdx));
+    }
+    if (divisor < 0) out.emplace_back(Opcode::Neg, reg(Reg::rax));
+    return true;
+}
+
+}
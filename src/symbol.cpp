@@ -0,0 +1,58 @@
+#include "../include/symbol.hpp"
+
+namespace plc {
+
+ScopeId SymbolTable::pushScope(SymbolIndex procedure){
+    uint32_t depth = 0;
+    if (current_ != no_scope) depth = scopes[current_].depth + (procedure != no_symbol_index);
+    scopes.push_back(ScopeInfo{current_, depth, 0, procedure});
+    current_ = static_cast<ScopeId>(scopes.size() - 1);
+    if (procedure != no_symbol_index) symbols[procedure].body = current_;
+    open_marks_.push_back(open_symbols_.size());
+    return current_;
+}
+
+void SymbolTable::popScope(){
+    if (current_ == no_scope) return;
+    size_t mark = open_marks_.back();
+    open_marks_.pop_back();
+    while (open_symbols_.size() > mark){
+        const SymbolInfo& sym = symbols[open_symbols_.back()];
+        visible_[sym.name] = sym.shadowed;
+        open_symbols_.pop_back();
+    }
+    current_ = scopes[current_].parent;
+}
+
+Result<SymbolIndex> SymbolTable::declare(SymbolId name, IdentType kind, int64_t value){
+    if (current_ == no_scope) return Error<SymbolIndex>(ErrorType::SymbolLookupError);
+    if (name >= visible_.size()) visible_.resize(name + 1, no_symbol_index);
+    SymbolIndex previous = visible_[name];
+    if (previous != no_symbol_index && symbols[previous].scope == current_){
+        return Error<SymbolIndex>(ErrorType::Ambiguity);
+    }
+    ScopeInfo& scope = scopes[current_];
+    uint32_t slot = 0;
+    if (kind == IdentType::VarIdent) slot = scope.vars++;
+    symbols.push_back(SymbolInfo{name, kind, current_, scope.depth, slot, value, no_scope, previous});
+    auto index = static_cast<SymbolIndex>(symbols.size() - 1);
+    visible_[name] = index;
+    open_symbols_.push_back(index);
+    return Ok(index);
+}
+
+SymbolIndex SymbolTable::lookup(SymbolId name) const{
+    if (name >= visible_.size()) return no_symbol_index;
+    return visible_[name];
+}
+
+void SymbolTable::clear(){
+    symbols.clear();
+    scopes.clear();
+    visible_.clear();
+    open_symbols_.clear();
+    open_marks_.clear();
+    current_ = no_scope;
+}
+
+}
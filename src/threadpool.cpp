@@ -0,0 +1,110 @@
+#include <cerrno>
+#include <system_error>
+#include "../include/threadpool.hpp"
+
+namespace plc {
+
+namespace {
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+}
+
+ThreadPool::ThreadPool(size_t threads){
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; i++) queues_.push_back(std::make_unique<Queue>());
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) workers_.push_back(Worker{this, i});
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    bool sized = pthread_attr_setstacksize(&attr, stack_size) == 0;
+    for (Worker& worker : workers_){
+        pthread_t thread;
+        // without room for a stack that large, a default one still works
+        if (!sized || pthread_create(&thread, &attr, start, &worker) != 0){
+            if (pthread_create(&thread, nullptr, start, &worker) != 0) throw std::system_error(errno, std::generic_category(), "pthread_create");
+        }
+        threads_.push_back(thread);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void* ThreadPool::start(void* worker){
+    auto* w = static_cast<Worker*>(worker);
+    w->pool->run(w->index);
+    return nullptr;
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (pthread_t thread : threads_) pthread_join(thread, nullptr);
+}
+
+void ThreadPool::submit(Task task){
+    size_t target = current_pool == this ? current_worker : next_queue_++ % queues_.size();
+    // counted before it is published, so a worker that takes it at once
+    // never decrements below zero
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_++;
+        pending_++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+        queues_[target]->tasks.push_back(std::move(task));
+    }
+    work_cv_.notify_one();
+}
+
+void ThreadPool::wait(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this]{return pending_ == 0;});
+}
+
+bool ThreadPool::pop(size_t worker, Task& task){
+    {
+        Queue& own = *queues_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()){
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); i++){
+        Queue& victim = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()){
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t worker){
+    current_pool = this;
+    current_worker = worker;
+    while (true){
+        Task task;
+        if (pop(worker, task)){
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queued_--;
+            }
+            task(worker);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) done_cv_.notify_all();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cv_.wait(lock, [this]{return stop_ || queued_ > 0;});
+        if (stop_ && queued_ == 0) return;
+    }
+}
+
+}
@@ -0,0 +1,286 @@
+#include <algorithm>
+#include "../include/vm.hpp"
+
+namespace plc {
+
+namespace {
+
+struct ProcedureRange{
+    SymbolIndex symbol;
+    size_t entry;
+    size_t end;
+};
+
+}
+
+uint32_t QuaternaryInterpreter::slot(SymbolIndex sym){
+    if (symbol_slot_[sym] == UINT32_MAX){
+        symbol_slot_[sym] = static_cast<uint32_t>(initial_.size());
+        initial_.push_back(0);
+    }
+    return symbol_slot_[sym];
+}
+
+uint32_t QuaternaryInterpreter::constant(int64_t v){
+    auto [it, inserted] = constant_slot_.emplace(v, static_cast<uint32_t>(initial_.size()));
+    if (inserted) initial_.push_back(v);
+    return it->second;
+}
+
+Result<uint32_t> QuaternaryInterpreter::operand(const CompilationContext& ctx, QuadOperand op){
+    switch (op.kind()){
+        case QuadOperandKind::None: return Ok(constant(0));
+        case QuadOperandKind::Constant: return Ok(constant(ctx.constantValue(op)));
+        case QuadOperandKind::Slot:
+            if (op.index() >= symbol_slot_.size()) return Error<uint32_t>(ErrorType::SymbolLookupError);
+            return Ok(slot(op.index()));
+        case QuadOperandKind::Temp:{
+            // temporaries are not symbols, they only live within one statement
+            if (op.index() >= temp_slot_.size()) temp_slot_.resize(op.index() + 1, UINT32_MAX);
+            uint32_t& t = temp_slot_[op.index()];
+            if (t == UINT32_MAX){
+                t = static_cast<uint32_t>(initial_.size());
+                initial_.push_back(0);
+            }
+            return Ok(t);
+        }
+        default: return Error<uint32_t>(ErrorType::CompileError);
+    }
+}
+
+Result<int> QuaternaryInterpreter::load(const CompilationContext& ctx){
+    const std::vector<Quaternary>& quads = ctx.code;
+    const SymbolTable& symbols = ctx.ast.symbols;
+    code_.clear();
+    procedures_.clear();
+    local_slots_.clear();
+    initial_.clear();
+    temp_slot_.clear();
+    constant_slot_.clear();
+    symbol_slot_.assign(symbols.size(), UINT32_MAX);
+    executed_ = 0;
+
+    // which procedure body each quadruple belongs to, innermost wins
+    std::vector<ProcedureRange> ranges;
+    for (const auto& [sym, entry] : ctx.procedure_line){
+        auto end = ctx.procedure_end.find(sym);
+        if (end == ctx.procedure_end.end() || entry > end->second || end->second > quads.size()){
+            return Error<int>(ErrorType::CompileError);
+        }
+        ranges.push_back(ProcedureRange{sym, entry, end->second});
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const ProcedureRange& a, const ProcedureRange& b){
+        return a.end - a.entry != b.end - b.entry ? a.end - a.entry > b.end - b.entry : a.symbol < b.symbol;
+    });
+    // returns at each end position, innermost procedure first
+    std::vector<std::vector<size_t>> ending(quads.size() + 1);
+    for (size_t i = ranges.size(); i-- > 0;) ending[ranges[i].end].push_back(i);
+    std::unordered_map<size_t, size_t> entry_of;    // quadruple index -> range
+    for (size_t i = 0; i < ranges.size(); i++) entry_of.emplace(ranges[i].entry, i);
+
+    procedures_.resize(ranges.size());
+    for (size_t i = 0; i < ranges.size(); i++){
+        procedures_[i].locals_begin = static_cast<uint32_t>(local_slots_.size());
+        ScopeId body = symbols[ranges[i].symbol].body;
+        for (SymbolIndex n = 0; n < symbols.size(); n++){
+            if (symbols[n].kind == IdentType::VarIdent && symbols[n].scope == body) local_slots_.push_back(slot(n));
+        }
+        procedures_[i].locals_end = static_cast<uint32_t>(local_slots_.size());
+    }
+
+    std::vector<uint32_t> ret_pc(ranges.size());
+    std::vector<uint32_t> pc_of(quads.size() + 1);
+    for (size_t i = 0; i <= quads.size(); i++){
+        for (size_t r : ending[i]){
+            ret_pc[r] = static_cast<uint32_t>(code_.size());
+            code_.push_back(VMInstruction{VMOp::Ret});
+        }
+        pc_of[i] = static_cast<uint32_t>(code_.size());
+        if (i == quads.size()){
+            code_.push_back(VMInstruction{VMOp::Halt});
+            break;
+        }
+        const Quaternary& q = quads[i];
+        VMInstruction ins{VMOp::Move};
+        if (!isJump(q.op)){
+            static constexpr VMOp arithmetic[] = {VMOp::Move, VMOp::Add, VMOp::Sub, VMOp::Mul, VMOp::Div};
+            ins.op = arithmetic[static_cast<size_t>(q.op)];
+            Result<uint32_t> a = operand(ctx, q.a);
+            Result<uint32_t> b = operand(ctx, q.b);
+            Result<uint32_t> c = operand(ctx, q.result);
+            if (!a.isOk || !b.isOk || !c.isOk) return Error<int>(ErrorType::SymbolLookupError);
+            ins.a = *a;
+            ins.b = *b;
+            ins.c = *c;
+        }else{
+            switch (q.op){
+                case QuadOp::Jump: ins.op = VMOp::Jump; break;
+                case QuadOp::JumpEqual: ins.op = VMOp::JumpEq; break;
+                case QuadOp::JumpHash:
+                case QuadOp::JumpNotEqual: ins.op = VMOp::JumpNe; break;
+                case QuadOp::JumpLess: ins.op = VMOp::JumpLt; break;
+                case QuadOp::JumpLessEqual: ins.op = VMOp::JumpLe; break;
+                case QuadOp::JumpGreater: ins.op = VMOp::JumpGt; break;
+                case QuadOp::JumpGreaterEqual: ins.op = VMOp::JumpGe; break;
+                default: ins.op = VMOp::JumpOdd; break;
+            }
+            if (ins.op != VMOp::Jump){
+                Result<uint32_t> a = operand(ctx, q.a);
+                Result<uint32_t> b = operand(ctx, q.b);
+                if (!a.isOk || !b.isOk) return Error<int>(ErrorType::SymbolLookupError);
+                ins.a = *a;
+                ins.b = *b;
+            }
+            // the target is patched once every pc is known, keep the quadruple for now
+            size_t target = q.result.index();
+            if (q.result.kind() != QuadOperandKind::Label || target > quads.size()) return Error<int>(ErrorType::CompileError);
+            ins.c = static_cast<uint32_t>(target);
+            if (ins.op == VMOp::Jump){
+                auto it = entry_of.find(ins.c);
+                if (it != entry_of.end()){
+                    ins.op = VMOp::Call;
+                    ins.a = static_cast<uint32_t>(it->second);
+                }
+            }
+        }
+        code_.push_back(ins);
+    }
+
+    // a jump to the end of a procedure it is inside of returns from it
+    for (size_t i = 0; i < quads.size(); i++){
+        VMInstruction& ins = code_[pc_of[i]];
+        if (ins.op == VMOp::Call){
+            const ProcedureRange& r = ranges[ins.a];
+            ins.c = r.entry == r.end ? ret_pc[ins.a] : pc_of[r.entry];
+            continue;
+        }
+        if (ins.op < VMOp::Jump || ins.op > VMOp::JumpOdd) continue;
+        size_t target = ins.c;
+        ins.c = pc_of[target];
+        for (size_t r : ending[target]){
+            if (ranges[r].entry <= i){
+                ins.c = ret_pc[r];
+                break;
+            }
+        }
+    }
+    frame_ = initial_;
+    return Ok(0);
+}
+
+int64_t QuaternaryInterpreter::value(SymbolIndex var) const{
+    if (var >= symbol_slot_.size() || symbol_slot_[var] == UINT32_MAX) return 0;
+    return frame_[symbol_slot_[var]];
+}
+
+Result<int> QuaternaryInterpreter::run(uint64_t step_limit){
+    if (code_.empty()) return Error<int>(ErrorType::Empty);
+    frame_ = initial_;
+    int64_t* f = frame_.data();
+    uint64_t executed = 0;
+    uint64_t limit = step_limit ? step_limit : UINT64_MAX;
+    struct Activation{
+        uint32_t return_pc;
+        uint32_t procedure;
+    };
+    std::vector<Activation> calls;
+    std::vector<int64_t> saved;
+    bool ok = false;
+
+#if defined(__GNUC__)
+    // direct threading: each instruction carries the address of its handler
+    static const void* const handlers[] = {
+        &&vm_Move, &&vm_Add, &&vm_Sub, &&vm_Mul, &&vm_Div,
+        &&vm_Jump, &&vm_JumpEq, &&vm_JumpNe, &&vm_JumpLt, &&vm_JumpLe, &&vm_JumpGt, &&vm_JumpGe, &&vm_JumpOdd,
+        &&vm_Call, &&vm_Ret, &&vm_Halt,
+    };
+    struct Threaded{
+        const void* handler;
+        uint32_t a, b, c;
+    };
+    std::vector<Threaded> threaded(code_.size());
+    for (size_t i = 0; i < code_.size(); i++){
+        const VMInstruction& ins = code_[i];
+        threaded[i] = Threaded{handlers[static_cast<size_t>(ins.op)], ins.a, ins.b, ins.c};
+    }
+    const Threaded* base = threaded.data();
+    const Threaded* ip = base;
+#define VM_CASE(name) vm_##name
+#define VM_NEXT() do { executed++; goto *ip->handler; } while (0)
+#define VM_BRANCH(cond) do { ip = (cond) ? base + ip->c : ip + 1; if (executed >= limit) goto vm_done; VM_NEXT(); } while (0)
+    VM_NEXT();
+    {
+#else
+    const VMInstruction* base = code_.data();
+    const VMInstruction* ip = base;
+#define VM_CASE(name) case VMOp::name
+#define VM_NEXT() do { executed++; goto vm_dispatch; } while (0)
+#define VM_BRANCH(cond) do { ip = (cond) ? base + ip->c : ip + 1; if (executed >= limit) goto vm_done; VM_NEXT(); } while (0)
+    executed++;
+vm_dispatch:
+    switch (ip->op){
+#endif
+    VM_CASE(Move):
+        f[ip->c] = f[ip->a];
+        ip++;
+        VM_NEXT();
+    VM_CASE(Add):
+        f[ip->c] = static_cast<int64_t>(static_cast<uint64_t>(f[ip->a]) + static_cast<uint64_t>(f[ip->b]));
+        ip++;
+        VM_NEXT();
+    VM_CASE(Sub):
+        f[ip->c] = static_cast<int64_t>(static_cast<uint64_t>(f[ip->a]) - static_cast<uint64_t>(f[ip->b]));
+        ip++;
+        VM_NEXT();
+    VM_CASE(Mul):
+        f[ip->c] = static_cast<int64_t>(static_cast<uint64_t>(f[ip->a]) * static_cast<uint64_t>(f[ip->b]));
+        ip++;
+        VM_NEXT();
+    VM_CASE(Div):
+        // idiv traps on both of these
+        if (f[ip->b] == 0 || (f[ip->a] == INT64_MIN && f[ip->b] == -1)) goto vm_done;
+        f[ip->c] = f[ip->a] / f[ip->b];
+        ip++;
+        VM_NEXT();
+    VM_CASE(Jump): VM_BRANCH(true);
+    VM_CASE(JumpEq): VM_BRANCH(f[ip->a] == f[ip->b]);
+    VM_CASE(JumpNe): VM_BRANCH(f[ip->a] != f[ip->b]);
+    VM_CASE(JumpLt): VM_BRANCH(f[ip->a] < f[ip->b]);
+    VM_CASE(JumpLe): VM_BRANCH(f[ip->a] <= f[ip->b]);
+    VM_CASE(JumpGt): VM_BRANCH(f[ip->a] > f[ip->b]);
+    VM_CASE(JumpGe): VM_BRANCH(f[ip->a] >= f[ip->b]);
+    VM_CASE(JumpOdd): VM_BRANCH(f[ip->a] & 1);
+    VM_CASE(Call):{
+        if (calls.size() >= max_call_depth) goto vm_done;
+        const VMProcedure& p = procedures_[ip->a];
+        for (uint32_t i = p.locals_begin; i < p.locals_end; i++) saved.push_back(f[local_slots_[i]]);
+        calls.push_back(Activation{static_cast<uint32_t>(ip - base + 1), ip->a});
+        VM_BRANCH(true);
+    }
+    VM_CASE(Ret):{
+        if (calls.empty()) goto vm_done;
+        Activation a = calls.back();
+        calls.pop_back();
+        const VMProcedure& p = procedures_[a.procedure];
+        for (uint32_t i = p.locals_end; i-- > p.locals_begin;){
+            f[local_slots_[i]] = saved.back();
+            saved.pop_back();
+        }
+        ip = base + a.return_pc;
+        VM_NEXT();
+    }
+    VM_CASE(Halt):
+        ok = true;
+        goto vm_done;
+    }
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_BRANCH
+
+vm_done:
+    executed_ = executed;
+    if (!ok) return Error<int>(ErrorType::RuntimeError);
+    return Ok(0);
+}
+
+}
@@ -0,0 +1,253 @@
+#include <unordered_map>
+#include "../include/x86.hpp"
+
+namespace plc {
+
+namespace {
+
+uint8_t code(Reg r){
+    return static_cast<uint8_t>(r);
+}
+
+void put32(std::vector<uint8_t>& out, int64_t v){
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(v >> (8*i)));
+}
+
+void put64(std::vector<uint8_t>& out, int64_t v){
+    for (int i = 0; i < 8; i++) out.push_back(static_cast<uint8_t>(v >> (8*i)));
+}
+
+bool fits8(int64_t v){
+    return v >= INT8_MIN && v <= INT8_MAX;
+}
+
+// [REX] opcode ModRM [SIB] [disp]; reg is a register or an opcode extension
+bool encodeRM(std::vector<uint8_t>& out, std::initializer_list<uint8_t> opcode, uint8_t reg, const Operand& rm){
+    if (!rm.isReg() && !rm.isMem()) return false;
+    if (rm.isMem() && (rm.value < INT32_MIN || rm.value > INT32_MAX)) return false;
+    uint8_t base = code(rm.reg);
+    out.push_back(static_cast<uint8_t>(0x48 | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0)));
+    out.insert(out.end(), opcode);
+    if (rm.isReg()){
+        out.push_back(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (base & 7)));
+        return true;
+    }
+    // rbp and r13 have no displacement-free form, rsp and r12 need a SIB byte
+    uint8_t mod = rm.value == 0 && (base & 7) != 5 ? 0 : fits8(rm.value) ? 1 : 2;
+    out.push_back(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | (base & 7)));
+    if ((base & 7) == 4) out.push_back(0x24);
+    if (mod == 1) out.push_back(static_cast<uint8_t>(rm.value));
+    else if (mod == 2) put32(out, rm.value);
+    return true;
+}
+
+// push/pop and mov r,imm carry the register in the opcode byte
+void encodeOpReg(std::vector<uint8_t>& out, uint8_t opcode, Reg r, bool wide){
+    uint8_t rex = static_cast<uint8_t>((wide ? 0x48 : 0x40) | ((code(r) & 8) ? 1 : 0));
+    if (rex != 0x40) out.push_back(rex);
+    out.push_back(static_cast<uint8_t>(opcode + (code(r) & 7)));
+}
+
+// add, sub, cmp and xor share one layout: r/m,reg  reg,r/m  r/m,imm
+bool encodeALU(std::vector<uint8_t>& out, uint8_t mr, uint8_t ext, const Instruction& ins){
+    if (ins.src.isReg()) return encodeRM(out, {mr}, code(ins.src.reg), ins.dst);
+    if (ins.src.isMem()) return ins.dst.isReg() && encodeRM(out, {static_cast<uint8_t>(mr + 2)}, code(ins.dst.reg), ins.src);
+    if (!ins.src.isImm32()) return false;
+    if (fits8(ins.src.value)){
+        if (!encodeRM(out, {0x83}, ext, ins.dst)) return false;
+        out.push_back(static_cast<uint8_t>(ins.src.value));
+        return true;
+    }
+    if (!encodeRM(out, {0x81}, ext, ins.dst)) return false;
+    put32(out, ins.src.value);
+    return true;
+}
+
+bool encodeMov(std::vector<uint8_t>& out, const Instruction& ins){
+    if (ins.src.isReg()) return encodeRM(out, {0x89}, code(ins.src.reg), ins.dst);
+    if (ins.src.isMem()) return ins.dst.isReg() && encodeRM(out, {0x8B}, code(ins.dst.reg), ins.src);
+    if (!ins.src.isImm()) return false;
+    int64_t v = ins.src.value;
+    if (ins.dst.isReg() && v >= 0 && v <= UINT32_MAX){
+        // the 32-bit form zero-extends into the full register
+        encodeOpReg(out, 0xB8, ins.dst.reg, false);
+        put32(out, v);
+        return true;
+    }
+    if (ins.src.isImm32()){
+        if (!encodeRM(out, {0xC7}, 0, ins.dst)) return false;
+        put32(out, v);
+        return true;
+    }
+    if (!ins.dst.isReg()) return false;
+    encodeOpReg(out, 0xB8, ins.dst.reg, true);
+    put64(out, v);
+    return true;
+}
+
+bool encodeShift(std::vector<uint8_t>& out, uint8_t ext, const Instruction& ins){
+    if (!ins.src.isImm() || ins.src.value < 0 || ins.src.value > 63) return false;
+    if (ins.src.value == 1) return encodeRM(out, {0xD1}, ext, ins.dst);
+    if (!encodeRM(out, {0xC1}, ext, ins.dst)) return false;
+    out.push_back(static_cast<uint8_t>(ins.src.value));
+    return true;
+}
+
+// everything but jumps and calls, whose size depends on the layout
+bool encode(std::vector<uint8_t>& out, const Instruction& ins){
+    switch (ins.op){
+        case Opcode::Mov: return encodeMov(out, ins);
+        case Opcode::Add: return encodeALU(out, 0x01, 0, ins);
+        case Opcode::Sub: return encodeALU(out, 0x29, 5, ins);
+        case Opcode::Cmp: return encodeALU(out, 0x39, 7, ins);
+        case Opcode::Xor: return encodeALU(out, 0x31, 6, ins);
+        case Opcode::Test:
+            if (ins.src.isReg()) return encodeRM(out, {0x85}, code(ins.src.reg), ins.dst);
+            if (!ins.src.isImm32() || !encodeRM(out, {0xF7}, 0, ins.dst)) return false;
+            put32(out, ins.src.value);
+            return true;
+        case Opcode::Imul:
+            if (ins.src.isNone()) return encodeRM(out, {0xF7}, 5, ins.dst);
+            if (!ins.dst.isReg()) return false;
+            if (!ins.src.isImm()) return encodeRM(out, {0x0F, 0xAF}, code(ins.dst.reg), ins.src);
+            if (!ins.src.isImm32()) return false;
+            if (fits8(ins.src.value)){
+                encodeRM(out, {0x6B}, code(ins.dst.reg), ins.dst);
+                out.push_back(static_cast<uint8_t>(ins.src.value));
+            }else{
+                encodeRM(out, {0x69}, code(ins.dst.reg), ins.dst);
+                put32(out, ins.src.value);
+            }
+            return true;
+        case Opcode::Idiv: return encodeRM(out, {0xF7}, 7, ins.dst);
+        case Opcode::Neg: return encodeRM(out, {0xF7}, 3, ins.dst);
+        case Opcode::Shl: return encodeShift(out, 4, ins);
+        case Opcode::Shr: return encodeShift(out, 5, ins);
+        case Opcode::Sar: return encodeShift(out, 7, ins);
+        case Opcode::Cqo:
+            out.insert(out.end(), {0x48, 0x99});
+            return true;
+        case Opcode::Push:
+            if (ins.dst.isMem()) return encodeRM(out, {0xFF}, 6, ins.dst);
+            if (!ins.dst.isReg()) return false;
+            encodeOpReg(out, 0x50, ins.dst.reg, false);
+            return true;
+        case Opcode::Pop:
+            if (!ins.dst.isReg()) return false;
+            encodeOpReg(out, 0x58, ins.dst.reg, false);
+            return true;
+        case Opcode::Ret:
+            out.push_back(0xC3);
+            return true;
+        case Opcode::Syscall:
+            out.insert(out.end(), {0x0F, 0x05});
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint8_t conditionCode(Opcode op){
+    switch (op){
+        case Opcode::Je: case Opcode::Jz: return 0x4;
+        case Opcode::Jne: case Opcode::Jnz: return 0x5;
+        case Opcode::Jl: return 0xC;
+        case Opcode::Jge: return 0xD;
+        case Opcode::Jle: return 0xE;
+        case Opcode::Jg: return 0xF;
+        default: return 0;
+    }
+}
+
+// one label definition, jump or run of fixed-size bytes
+struct Item{
+    const Instruction* branch = nullptr;
+    const std::string* label = nullptr;
+    std::vector<uint8_t> bytes;
+    bool wide = false;
+    uint64_t offset = 0;
+
+    [[nodiscard]] uint64_t size() const{
+        if (label) return 0;
+        if (!branch) return bytes.size();
+        if (branch->op == Opcode::Call) return 5;
+        if (!wide) return 2;
+        return branch->op == Opcode::Jmp ? 5 : 6;
+    }
+};
+
+}
+
+Result<MachineCode> encodeX86(const std::vector<Label>& labels){
+    std::vector<Item> items;
+    std::unordered_map<std::string, size_t> defined;
+    auto define = [&](const std::string& name){
+        if (!defined.emplace(name, items.size()).second) return false;
+        items.emplace_back().label = &name;
+        return true;
+    };
+    for (const Label& label : labels){
+        if (!define(label.name)) return Error<MachineCode>(ErrorType::Ambiguity);
+        for (const Instruction& ins : label.lines){
+            if (ins.op == Opcode::Label){
+                if (!define(ins.target)) return Error<MachineCode>(ErrorType::Ambiguity);
+            }else if (ins.isJump() || ins.op == Opcode::Call){
+                items.emplace_back().branch = &ins;
+            }else{
+                if (items.empty() || items.back().label || items.back().branch) items.emplace_back();
+                if (!encode(items.back().bytes, ins)) return Error<MachineCode>(ErrorType::CompileError);
+            }
+        }
+    }
+    std::vector<size_t> target(items.size(), 0);
+    for (size_t i = 0; i < items.size(); i++){
+        if (!items[i].branch) continue;
+        auto it = defined.find(items[i].branch->target);
+        if (it == defined.end()) return Error<MachineCode>(ErrorType::SymbolLookupError);
+        target[i] = it->second;
+    }
+
+    // widening a jump only moves others further apart, so this terminates
+    bool changed = true;
+    while (changed){
+        changed = false;
+        uint64_t offset = 0;
+        for (Item& item : items){
+            item.offset = offset;
+            offset += item.size();
+        }
+        for (size_t i = 0; i < items.size(); i++){
+            Item& item = items[i];
+            if (!item.branch || item.wide || item.branch->op == Opcode::Call) continue;
+            int64_t disp = static_cast<int64_t>(items[target[i]].offset) - static_cast<int64_t>(item.offset + item.size());
+            if (!fits8(disp)){
+                item.wide = true;
+                changed = true;
+            }
+        }
+    }
+
+    MachineCode res;
+    for (size_t i = 0; i < items.size(); i++){
+        const Item& item = items[i];
+        if (item.label){
+            if (item.label->rfind("_temp_label", 0) != 0) res.symbols.emplace_back(*item.label, item.offset);
+            continue;
+        }
+        if (!item.branch){
+            res.bytes.insert(res.bytes.end(), item.bytes.begin(), item.bytes.end());
+            continue;
+        }
+        int64_t disp = static_cast<int64_t>(items[target[i]].offset) - static_cast<int64_t>(item.offset + item.size());
+        Opcode op = item.branch->op;
+        if (op == Opcode::Call) res.bytes.push_back(0xE8);
+        else if (op == Opcode::Jmp) res.bytes.push_back(item.wide ? 0xE9 : 0xEB);
+        else if (item.wide) res.bytes.insert(res.bytes.end(), {0x0F, static_cast<uint8_t>(0x80 | conditionCode(op))});
+        else res.bytes.push_back(static_cast<uint8_t>(0x70 | conditionCode(op)));
+        if (item.size() == 2) res.bytes.push_back(static_cast<uint8_t>(disp));
+        else put32(res.bytes, disp);
+    }
+    return Ok(res);
+}
+
+}
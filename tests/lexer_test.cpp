@@ -0,0 +1,37 @@
+#include <iostream>
+#include <keyword.hpp>
+
+// The DFA scanner and the regex reference lexer must agree on every token of
+// every file given; columns differ because the regex path splits the text first.
+
+using namespace plc;
+
+int main(int argc, char** argv){
+    int failed = 0;
+    for (int i = 1; i < argc; i++){
+        Interner interner;
+        Result<TokenList> dfa = KeyWordInterpreter(LexerMode::DFA, interner).interpretFile(argv[i]);
+        Result<TokenList> regex = KeyWordInterpreter(LexerMode::Regex, interner).interpretFile(argv[i]);
+        if (!dfa.isOk || !regex.isOk){
+            std::cerr << argv[i] << ": lexing failed\n";
+            failed++;
+            continue;
+        }
+        size_t n = std::min(dfa->size(), regex->size());
+        size_t mismatch = n;
+        for (size_t t = 0; t < n && mismatch == n; t++){
+            const Token& a = (*dfa)[t];
+            const Token& b = (*regex)[t];
+            if (a.type_ != b.type_ || a.kind_ != b.kind_ || a.id_ != b.id_ || a.value_ != b.value_ || a.line_ != b.line_) mismatch = t;
+        }
+        if (mismatch < n){
+            std::cerr << argv[i] << ": token " << mismatch << " is " << static_cast<std::string>((*dfa)[mismatch])
+                      << " from the DFA, " << static_cast<std::string>((*regex)[mismatch]) << " from the regex lexer\n";
+            failed++;
+        }else if (dfa->size() != regex->size()){
+            std::cerr << argv[i] << ": " << dfa->size() << " tokens from the DFA, " << regex->size() << " from the regex lexer\n";
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}